@@ -10,8 +10,7 @@ import UIKit
 import TunnelServices
 
 extension HAR{
-    func getHeaders(headDic:[String:String]) -> ([Header],[Cookie]) {
-        var dic = headDic
+    func getHeaders(heads:[(name:String, value:String)]) -> ([Header],[Cookie]) {
         var cookies = [Cookie]()
         var headers = [Header]()
         // TODO:1125:HTTPCookies缺失
@@ -30,11 +29,15 @@ extension HAR{
 //                cookies.append(cookie)
 //            }
 //        }
-        dic.removeValue(forKey: "Cookie")
-        for kv in dic { headers.append(Header(name: kv.key, value: kv.value)) }
+        for kv in heads where kv.name.lowercased() != "cookie" { headers.append(Header(name: kv.name, value: kv.value)) }
         return (headers,cookies)
     }
     
+    // 头部名不区分大小写，新记录的头部名是小写
+    func headerValue(_ heads:[(name:String, value:String)], _ name:String) -> String? {
+        return heads.first(where: { $0.name.caseInsensitiveCompare(name) == .orderedSame })?.value
+    }
+    
     func append(session:Session){
         
         var startTime = Date()
@@ -54,15 +57,15 @@ extension HAR{
         var reqHeaders = [Header]()
         var headersSize:Int = -1
         var bodySize:Int = -1
-        if let reqHeads = session.reqHeads {
-            var headDic = Dictionary<String, String>.fromJson(reqHeads)
-            for kv in headDic {
-                headersSize = headersSize + kv.key.count + kv.value.count + 2 // "key: value"
+        let reqHeads = session.headers(true)
+        if reqHeads.count > 0 {
+            for kv in reqHeads {
+                headersSize = headersSize + kv.name.count + kv.value.count + 2 // "key: value"
             }
-            if let contentLength = headDic["Content-Length"] {
+            if let contentLength = headerValue(reqHeads, "Content-Length") {
                 bodySize = Int(contentLength) ?? -1
             }
-            let cr = getHeaders(headDic: headDic)
+            let cr = getHeaders(heads: reqHeads)
             cookies = cr.1
             reqHeaders = cr.0
         }
@@ -125,20 +128,20 @@ extension HAR{
             var rspHeadersSize:Int = -1
             var rspBodySize:Int = -1
             var redirectURL = ""
-            if let rspHeads = session.rspHeads {
-                var headDic = Dictionary<String, String>.fromJson(rspHeads)
-                for kv in headDic {
-                    rspHeadersSize = rspHeadersSize + kv.key.count + kv.value.count + 2 // "key: value"
+            let rspHeads = session.headers(false)
+            if rspHeads.count > 0 {
+                for kv in rspHeads {
+                    rspHeadersSize = rspHeadersSize + kv.name.count + kv.value.count + 2 // "key: value"
                 }
-                if let contentLength = headDic["Content-Length"] {
+                if let contentLength = headerValue(rspHeads, "Content-Length") {
                     rspBodySize = Int(contentLength) ?? 0
                 }else{
                     rspBodySize = Int(session.getBodySize())
                 }
-                if let location = headDic["Location"] {
+                if let location = headerValue(rspHeads, "Location") {
                     redirectURL = location
                 }
-                let cr = getHeaders(headDic: headDic)
+                let cr = getHeaders(heads: rspHeads)
                 rspCookies = cr.1
                 rspHeaders = cr.0
             }
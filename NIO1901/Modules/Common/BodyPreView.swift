@@ -32,16 +32,14 @@ class BodyPreView: UIView {
     var infos = [[String:String]]()
     
     
-    static func getPreView(_ type:String, filePath:String) -> BodyPreView {
+    static func getPreView(_ type:String, session:Session, isReq:Bool) -> BodyPreView {
         let preView = BodyPreView(frame: CGRect(x: 0, y: 0, width: 100, height: 100))
-        let nfilePath = "\(MitmService.getStoreFolder())\(filePath)"
-        let fn = FileManager.default
-        if !fn.fileExists(atPath: nfilePath) {
+        if !session.hasBodyFile(isReq) {
             preView.infos.append(["Tips" : "File does not exist".localized])
             return preView
         }
         // 获取文件大小
-        let fileSize = getSize(url: URL(fileURLWithPath: nfilePath))
+        let fileSize = session.getBodySize(isReq)
         preView.infos.append(["Data size".localized : "\(Float(fileSize).bytesFormatting())"])
         
         let ts = type.components(separatedBy: ";")
@@ -54,7 +52,7 @@ class BodyPreView: UIView {
         let t = (type.components(separatedBy: ";").first ?? "").lowercased().getRealType()
         // png\jpeg\gif\webP
         if ImageTypes.contains(t) {
-            if let img = YYImage(contentsOfFile: nfilePath) {
+            if let data = session.getBodyData(isReq), let img = YYImage(data: data) {
                 preView.infos.append(["Size".localized : "\(Int(img.size.width))×\(Int(img.size.height))"])
                 preView.contentView = YYAnimatedImageView(image: img)
 //                let frameCount = img.animatedImageFrameCount()
@@ -42,19 +42,21 @@ class OutputUtil: NSObject {
     
     static func taskDoBatch(ids:[Int],type:OutputType,compeleHandle:@escaping ((String?) -> Void)) {
         DispatchQueue.global().async {
-            let sessions = Task.findAll(taskIds:ids)
             if type == .DEL {
                 if !Task.deleteAll(taskIds: ids) {
                     print("Delete Task Failure")
                 }
+                DispatchQueue.main.async { compeleHandle("") }
+                return
             }
+            let sessions = Task.findAll(taskIds:ids)
             output(sessions: sessions, type: type,compeleHandle: compeleHandle)
         }
     }
     
-    static func output(ids:[Int],type:OutputType,compeleHandle:@escaping ((String?) -> Void)){
+    static func output(taskID:Int?,ids:[Int],type:OutputType,compeleHandle:@escaping ((String?) -> Void)){
         DispatchQueue.global().async {
-            let sessions = Session.findAll(ids:ids)
+            let sessions = Session.findAll(taskID:taskID, ids:ids)
             output(sessions: sessions, type: type,compeleHandle: compeleHandle)
         }
     }
@@ -64,14 +66,8 @@ class OutputUtil: NSObject {
             DispatchQueue.main.async { compeleHandle("") }
             return
         }
-        let fm = FileManager.default
-        for s in sessions {
-            let reqBodyPath = "\(MitmService.getStoreFolder())\(s.fileFolder ?? "error")/\(s.reqBody)"
-            let rspBodyPath = "\(MitmService.getStoreFolder())\(s.fileFolder ?? "error")/\(s.rspBody)"
-            try? s.delete()
-            try? fm.removeItem(atPath: reqBodyPath)
-            try? fm.removeItem(atPath: rspBodyPath)
-        }
+        // 批量事务删除，body 文件按批清理
+        StoragePurger.deleteSessions(sessions)
         DispatchQueue.main.async { compeleHandle("") }
     }
     
@@ -169,9 +165,8 @@ extension Session {
         if let m = methods {
             curl.append(" -X \(m.uppercased())")
         }
-        let headerDic = [String:String].fromJson(reqHeads ?? "")
-        for kv in headerDic {
-            let hstr = "\"\(kv.key): \(kv.value)\""
+        for kv in headers(true) {
+            let hstr = "\"\(kv.name): \(kv.value)\""
             curl.append(" -H \(hstr)")
         }
         if let reqData = getDecodedBody(true) {
@@ -263,6 +263,15 @@ extension VisualActivityViewController {
         viewController.present(vc, animated: true, completion: nil)
     }
     
+    // body 在 Task 的 BodyStore 中，分享前导出到临时目录；还在接收中的 body 不导出
+    static func share(body session:Session, isReq:Bool, on viewController:UIViewController){
+        guard let url = session.exportBodyFile(isReq) else {
+            ZKProgressHUD.showMessage("Body is still being received".localized)
+            return
+        }
+        share(url: url, on: viewController)
+    }
+    
     static func share(file:String, on viewController:UIViewController,transcoding:Bool = false){
         guard let fileUrl = URL(string: file) else {
             ZKProgressHUD.showError("filePath error")
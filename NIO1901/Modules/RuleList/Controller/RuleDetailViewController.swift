@@ -112,6 +112,7 @@ class RuleDetailViewController: BaseViewController {
     
     override func rightBtnClick() {
         try? rule.saveToDB()
+        rule.postConfigDidChange()
         NotificationCenter.default.post(name: CurrentRuleListChange, object: nil)
         self.dismiss(animated: true, completion: nil)
     }
@@ -126,6 +127,7 @@ class RuleDetailViewController: BaseViewController {
                 self.dismiss(animated: true, completion: nil)
             }) {
                 try? self.rule.saveToDB()
+                self.rule.postConfigDidChange()
                 NotificationCenter.default.post(name: CurrentRuleListChange, object: nil)
                 self.dismiss(animated: true, completion: nil)
             }
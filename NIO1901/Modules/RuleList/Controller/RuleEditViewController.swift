@@ -118,6 +118,9 @@ extension RuleEditViewController:UITableViewDelegate,UITableViewDataSource {
         if item.annotation != nil , item.annotation != "" {
             secondLine.append("(\(item.annotation ?? ""))")
         }
+        if item.matchRule == .IPCIDR {
+            secondLine.append(" \("IP-CIDR limitation".localized)")
+        }
         cell.strategyLable.text = secondLine
         return cell
     }
@@ -17,6 +17,7 @@ class RuleOverViewController: UIViewController {
     var numbItem = RuleItemView()
     var modeItem = RuleItemView()
     var ignoreItem = RuleItemView()
+    var importItem = RuleItemView()
     var textEditItem = RuleItemView()
     var noteItem = RuleItemView()
     var shareItem = RuleItemView()
@@ -96,6 +97,16 @@ class RuleOverViewController: UIViewController {
         }
         scrollView.addSubview(ignoreItem)
         
+        importItem = RuleItemView(title: nil, "Import domain blocklist".localized, nil, true, describe: "Import domain blocklist describe".localized, type: .Label, true)
+        importItem.frame = CGRect(x: 0, y: offY, width: SCREENWIDTH, height: importItem.itemHeight)
+        offY = importItem.frame.maxY
+        importItem.contentDidClickHandle = {
+            let picker = UIDocumentPickerViewController(documentTypes: ["public.text"], in: .import)
+            picker.delegate = self
+            self.present(picker, animated: true, completion: nil)
+        }
+        scrollView.addSubview(importItem)
+        
         textEditItem = RuleItemView(title: nil, "Text editing mode".localized, nil, true, describe: nil, type: .Label, true)
         textEditItem.frame = CGRect(x: 0, y: offY, width: SCREENWIDTH, height: textEditItem.itemHeight)
         offY = textEditItem.frame.maxY
@@ -143,6 +154,30 @@ class RuleOverViewController: UIViewController {
     }
 }
 
+extension RuleOverViewController: UIDocumentPickerDelegate {
+    
+    // 编译导入的域名列表，发送规则变更通知，让正在运行的 Tunnel 重新发布快照
+    func documentPicker(_ controller: UIDocumentPickerViewController, didPickDocumentsAt urls: [URL]) {
+        guard let url = urls.first else { return }
+        ZKProgressHUD.show()
+        DispatchQueue.global().async {
+            var count: Int? = nil
+            if let text = try? String(contentsOf: url, encoding: .utf8) {
+                count = try? DomainBlocklist.importList(text)
+            }
+            DispatchQueue.main.async {
+                ZKProgressHUD.dismiss()
+                guard let domains = count else {
+                    ZKProgressHUD.showError("Import failed".localized)
+                    return
+                }
+                ZKProgressHUD.showMessage("\("Imported domains".localized)\(domains)")
+                self.rule.postConfigDidChange()
+            }
+        }
+    }
+}
+
 enum RuleItemType {
     case Switch
     case Field
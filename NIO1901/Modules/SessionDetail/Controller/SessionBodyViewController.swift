@@ -67,12 +67,10 @@ class SessionBodyViewController: BaseViewController {
     
     func updateData()
     {
-        let filePath = "\(session.fileFolder ?? "error")/\(showRSP ? session.rspBody : session.reqBody)"
-        let nfilePath = "\(MitmService.getStoreFolder())\(filePath)"
         let tvFrame = CGRect(x: 0, y: NAVGATIONBARHEIGHT, width: SCREENWIDTH, height: SCREENHEIGHT - NAVGATIONBARHEIGHT)
-        if FileManager.default.fileExists(atPath: nfilePath) {
+        if let originalData = session.getBodyData(!showRSP) {
             do{
-                var data = try Data(contentsOf: URL(fileURLWithPath: "\(nfilePath)"))
+                var data = originalData
                 if CompressTypes.contains(encoding) {  // 解码数据，解压之类
                     if encoding != "gzip"{
                         print("非gzip编码格式:\(encoding)")
@@ -96,11 +94,11 @@ class SessionBodyViewController: BaseViewController {
                             if yyImg != nil {
                                 VisualActivityViewController.share(image: yyImg!, on: self)
                             }else{
-                                VisualActivityViewController.share(url: URL(fileURLWithPath: "\(nfilePath)"), on: self)
+                                VisualActivityViewController.share(body: self.session, isReq: !self.showRSP, on: self)
                             }
                         }
                         if index == 1 {
-                            VisualActivityViewController.share(url: URL(fileURLWithPath: "\(nfilePath)"), on: self)
+                            VisualActivityViewController.share(body: self.session, isReq: !self.showRSP, on: self)
                         }
                         if index == 2 {
                             let vc = SessionDataViewController(session: self.session, showRSP: self.showRSP)
@@ -108,7 +106,6 @@ class SessionBodyViewController: BaseViewController {
                         }
                     }
                     // show image
-                    //YYImage(contentsOfFile: nfilePath)
                     imageView = YYAnimatedImageView(image: yyImg)
                     imageView.contentMode = .scaleAspectFit
                     view.addSubview(imageView)
@@ -209,7 +206,6 @@ class SessionBodyViewController: BaseViewController {
                         currentFormatter.numberOfCharactersPerLine = 16 + (16 * 3) + (12) + 1
                         currentFormatter.currentDisplaySize = FORMATTER_DISPLAY_SIZE_WORD
                         
-                        let originalData = try Data(contentsOf: URL(fileURLWithPath: "\(nfilePath)"))
                         navTitle = "Hex (\(Float(originalData.count).bytesFormatting())))"
                         navTitleColor = ColorA
                         
@@ -219,7 +215,7 @@ class SessionBodyViewController: BaseViewController {
                         outputItems = ["Export raw data".localized]
                         outputHandler = { index in
                             if index == 0 {
-                                VisualActivityViewController.share(url: URL(fileURLWithPath: "\(nfilePath)"), on: self)
+                                VisualActivityViewController.share(body: self.session, isReq: !self.showRSP, on: self)
                             }
                         }
                     }
@@ -64,25 +64,16 @@ class SessionDataViewController: BaseViewController {
     
     func updateData()
     {
-        let filePath = "\(session.fileFolder ?? "error")/\(showRSP ? session.rspBody : session.reqBody)"
-        let nfilePath = "\(MitmService.getStoreFolder())\(filePath)"
-        if FileManager.default.fileExists(atPath: nfilePath) {
-            do{
-                let data = try Data(contentsOf: URL(fileURLWithPath: "\(nfilePath)"))
-                currentFormatter.data = data
-                textView.text = currentFormatter.formattedString
-            }catch{
-                print("读取失败:\(error)")
-            }
+        if let data = session.getBodyData(!showRSP) {
+            currentFormatter.data = data
+            textView.text = currentFormatter.formattedString
         }
         
     }
     
     override func rightBtnClick() {
-        let filePath = "\(session.fileFolder ?? "error")/\(showRSP ? session.rspBody : session.reqBody)"
-        let nfilePath = "\(MitmService.getStoreFolder())\(filePath)"
         PopViewController.show(titles: ["Export".localized], viewController: self ) { index in
-            VisualActivityViewController.share(url: URL(fileURLWithPath: "\(nfilePath)"), on: self)
+            VisualActivityViewController.share(body: self.session, isReq: !self.showRSP, on: self)
         }
     }
 
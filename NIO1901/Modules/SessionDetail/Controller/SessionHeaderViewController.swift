@@ -46,16 +46,14 @@ class SessionHeaderViewController: BaseViewController {
     }
     
     func addList(){
-        guard let headerJson = isReq ? session.reqHeads : session.rspHeads else { return }
-        let headDic = [String:String].fromJson(headerJson)
         var offY:CGFloat = 0
-        var kvs = [[String:String]]()
-        for kv in headDic { kvs.append([kv.key:kv.value]) }
-        kvs.sort { (kv1, kv2) -> Bool in
-            return kv1.keys.first!.localizedCompare(kv2.keys.first!) == ComparisonResult.orderedAscending
-        }
-        for dic in kvs {
-            let itemView = SessionItemView(title: dic.keys.first ?? "", content: dic.values.first ?? "", true)
+        // 重复的头部（Set-Cookie 等）逐条显示，同名的保持原始顺序
+        let kvs = session.headers(isReq).enumerated().sorted { (kv1, kv2) -> Bool in
+            let result = kv1.element.name.localizedCompare(kv2.element.name)
+            return result == .orderedSame ? kv1.offset < kv2.offset : result == .orderedAscending
+        }.map { $0.element }
+        for kv in kvs {
+            let itemView = SessionItemView(title: kv.name, content: kv.value, true)
             itemView.frame = CGRect(x: 0, y: offY, width: SCREENWIDTH, height: itemView.itemHeight)
             itemView.didClickHandle = { text in
                 VisualActivityViewController.share(text: text, on: self)
@@ -68,17 +66,16 @@ class SessionHeaderViewController: BaseViewController {
     
     override func rightBtnClick() {
         PopViewController.show(titles: ["Export Json".localized,"Export key:value".localized], viewController: self) { (index) in
-            guard let headerJson = self.isReq ? self.session.reqHeads : self.session.rspHeads else {
+            guard let headerJson = self.session.headsJson(self.isReq) else {
                 ZKProgressHUD.showError("no headers")
                 return
             }
             if index == 0 {
                 VisualActivityViewController.share(text: headerJson, on: self, "json")
             }else{
-                let dic = [String:String].fromJson(headerJson)
                 var text = ""
-                for kv in dic {
-                    text.append("\(kv.key): \(kv.value)\n")
+                for kv in self.session.headers(self.isReq) {
+                    text.append("\(kv.name): \(kv.value)\n")
                 }
                 VisualActivityViewController.share(text: text, on: self)
             }
@@ -53,10 +53,8 @@ class SessionRequestViewController: UIViewController {
         offY = offY + urlView.frame.height
         
         if session.reqBody != "" {
-            let filePath = "\(session.fileFolder ?? "error")/\(session.reqBody)"
-            let nfilePath = "\(MitmService.getStoreFolder())\(filePath)"
-            if FileManager.default.fileExists(atPath: nfilePath) {
-                let reqBodyView = SessionBodyView(title: "Request body".localized, path: filePath, type: session.reqType, size: 300000)
+            if session.hasBodyFile(true) {
+                let reqBodyView = SessionBodyView(title: session.isBodyTruncated(true) ? "\("Request body".localized) \("(truncated)".localized)" : "Request body".localized, session: session, isReq: true, type: session.reqType, size: 300000)
                 reqBodyView.frame = CGRect(x: 0, y: offY, width: SCREENWIDTH, height: reqBodyView.itemHeight)
                 scrollView.addSubview(reqBodyView)
                 offY = offY + reqBodyView.frame.height
@@ -65,7 +63,7 @@ class SessionRequestViewController: UIViewController {
             }
         }
         
-        let reqHeadView = SessionHeadView(title: "Request header".localized, headJson: session.reqHeads ?? "")
+        let reqHeadView = SessionHeadView(title: "Request header".localized, headJson: session.headsJson(true) ?? "")
         reqHeadView.didClickHandle = {
             self.navigationController?.pushViewController(SessionHeaderViewController(session: self.session, isReq: true), animated: true)
         }
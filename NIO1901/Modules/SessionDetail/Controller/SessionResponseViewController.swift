@@ -47,10 +47,8 @@ class SessionResponseViewController: UIViewController {
         offY = offY + rspView.frame.height
         
         if session.rspBody != "" {
-            let filePath = "\(session.fileFolder ?? "error")/\(session.rspBody)"
-            let nfilePath = "\(MitmService.getStoreFolder())\(filePath)"
-            if FileManager.default.fileExists(atPath: nfilePath) {
-                let rspBodyView = SessionBodyView(title: "Response body".localized, path: filePath, type: session.rspType , size: 300000)
+            if session.hasBodyFile() {
+                let rspBodyView = SessionBodyView(title: session.isBodyTruncated() ? "\("Response body".localized) \("(truncated)".localized)" : "Response body".localized, session: session, isReq: false, type: session.rspType , size: 300000)
                 rspBodyView.frame = CGRect(x: 0, y: offY, width: SCREENWIDTH, height: rspBodyView.itemHeight)
                 scrollView.addSubview(rspBodyView)
                 offY = offY + rspBodyView.frame.height
@@ -59,7 +57,7 @@ class SessionResponseViewController: UIViewController {
             }
         }
         
-        let rspHeadView = SessionHeadView(title: "Response header".localized, headJson: session.rspHeads ?? "")
+        let rspHeadView = SessionHeadView(title: "Response header".localized, headJson: session.headsJson(false) ?? "")
         rspHeadView.didClickHandle = {
             self.navigationController?.pushViewController(SessionHeaderViewController(session: self.session, isReq: false), animated: true)
         }
@@ -10,7 +10,8 @@ import UIKit
 
 class SessionBodyView: UIView {
 
-    var path:String
+    var session:Session
+    var isReq:Bool
     var type:String
     var size:CGFloat
     
@@ -22,9 +23,10 @@ class SessionBodyView: UIView {
     var itemHeight:CGFloat = 0
     var subItemHeight:CGFloat = 30
     
-    init(title:String,path:String,type:String,size:CGFloat) {
+    init(title:String,session:Session,isReq:Bool,type:String,size:CGFloat) {
         
-        self.path = path
+        self.session = session
+        self.isReq = isReq
         self.type = type
         self.size = size
         
@@ -56,7 +58,7 @@ class SessionBodyView: UIView {
         let preViewHeight:CGFloat = 100
         var offX:CGFloat = LRSpacing
         var offY:CGFloat = LRSpacing
-        let preView = BodyPreView.getPreView(type, filePath: path)
+        let preView = BodyPreView.getPreView(type, session: session, isReq: isReq)
         preView.frame = CGRect(x: offX, y: offY, width: preViewWidth, height: preViewHeight)
         contentView.addSubview(preView)
         offX = offX + preViewWidth
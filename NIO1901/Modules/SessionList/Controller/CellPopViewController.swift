@@ -184,13 +184,13 @@ class CellPopViewController: UIViewController,PopupContentViewController {
             }
         }
         // reqHead
-        if let reqHeads = session.reqHeads {
-            let headDic = Dictionary<String, String>.fromJson(reqHeads)
+        let reqHeaders = session.headers(true)
+        if reqHeaders.count > 0 {
             var values = [String]()
-            for dic in headDic {
-                if !ignoreKey.contains(dic.key) {
-                    values.append(dic.key)
-                    values.append(dic.value)
+            for kv in reqHeaders {
+                if !ignoreKey.contains(where: { $0.caseInsensitiveCompare(kv.name) == .orderedSame }) {
+                    values.append(kv.name)
+                    values.append(kv.value)
                 }
             }
             if values.count > 0{
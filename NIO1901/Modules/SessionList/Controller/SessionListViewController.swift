@@ -86,7 +86,7 @@ class SessionListViewController: BaseViewController {
         set {
             _selectedIndexs = newValue
             if _selectedIndexs.count > 0 {
-                nextBtn.setTitle("\("Next".localized)(\(_selectedIndexs.count)/\(sessionsIDS.count))", for: .normal)
+                nextBtn.setTitle("\("Next".localized)(\(_selectedIndexs.count)/\(sessionsCount))", for: .normal)
             }else{
                 nextBtn.setTitle("Next".localized, for: .normal)
             }
@@ -100,13 +100,13 @@ class SessionListViewController: BaseViewController {
     let bigSearchBar = CGRect(x: LRSpacing, y: STATUSBARHEIGHT + (44 - SessionListViewController.searchBarHeight) / 2, width: SCREENWIDTH - 64 - LRSpacing, height: SessionListViewController.searchBarHeight)
     
     var sessions = [SessionItem]()
-    var sessionsIDS = [Int]()
+    var sessionsCount = 0
     var _currentIndex:Int = 0
     var currentIndex:Int {
         get { return _currentIndex }
         set {
             _currentIndex = newValue
-            let title = "\(_currentIndex)/\(sessionsIDS.count)"
+            let title = "\(_currentIndex)/\(sessionsCount)"
             focusSubTitleLabel.text = title
         }
     }
@@ -367,12 +367,13 @@ class SessionListViewController: BaseViewController {
             currentTime = Date().timeIntervalSince1970
             sessions.removeAll()
             updateSQLParams()
-            sessionsIDS = Session.countWith(taskID: taskID, keyWord: sqlKeyWord, params: sqlParams,
-                                            orderBy: nil, timeInterval: currentTime)
+            sessionsCount = Session.count(taskID: taskID, keyWord: sqlKeyWord, params: sqlParams, timeInterval: currentTime)
             tableView.switchRefreshFooter(to: .normal)
         }
+        // 加载更多时从已加载的最后一条之后开始
         let results = Session.findAll(taskID: taskID, keyWord: sqlKeyWord, params: sqlParams, pageSize: pageSize,
-                                      pageIndex: pageIndex, orderBy: nil, timeInterval: currentTime)
+                                      pageIndex: pageIndex, orderBy: nil, timeInterval: currentTime,
+                                      cursor: isMore ? SessionCursor(sessions.last?.session) : nil)
         pageIndex = pageIndex + 1
         for s in results {
             sessions.append(SessionItem(s))
@@ -452,9 +453,15 @@ class SessionListViewController: BaseViewController {
         }
     }
     
+    // 全选、反选时才取出全部 id
+    func allSessionIDs() -> [Int] {
+        let taskID = task?.id == nil ? nil : "\(task!.id!)"
+        return Session.countWith(taskID: taskID, keyWord: sqlKeyWord, params: sqlParams, orderBy: nil, timeInterval: currentTime)
+    }
+    
     @objc func selectAllBtnDidClick(){
         selectedIndexs.removeAll()
-        for sessionId in sessionsIDS {
+        for sessionId in allSessionIDs() {
             selectedIndexs.append(sessionId)
         }
         tableView.reloadData()
@@ -462,7 +469,7 @@ class SessionListViewController: BaseViewController {
     
     @objc func invertAllBtnDidClick(){
         var tmpIds = [Int]()
-        for sessionId in sessionsIDS {
+        for sessionId in allSessionIDs() {
             tmpIds.append(sessionId)
         }
         tmpIds.removeAll { (id) -> Bool in
@@ -474,7 +481,7 @@ class SessionListViewController: BaseViewController {
     
     @objc func nextBtnDidClick(){
         ZKProgressHUD.show()
-        OutputUtil.output(ids: selectedIndexs, type: outputType) { (filePath) in
+        OutputUtil.output(taskID: task?.id?.intValue, ids: selectedIndexs, type: outputType) { (filePath) in
             ZKProgressHUD.dismiss()
 //            print("File:\(filePath ?? "")")
             guard let fp = filePath else {
@@ -165,6 +165,7 @@ class SearchExtensionView: UIView {
                 listView.selectedList = self.searchOption.getValues(key: listView.searchKey)
             }
         }
+        updateListFilters()
         // 更新右上角数字
         initNumbs()
         for sm in self.searchOption.searchMap {
@@ -175,6 +176,20 @@ class SearchExtensionView: UIView {
         isHidden = false
     }
     
+    // 每个列表的计数使用除自身以外的筛选条件，自身已选的值仍然都能看到
+    func updateListFilters(){
+        for v in subListViews {
+            guard let listView = v as? SearchListView else { continue }
+            var params = [String:[String]]()
+            for sm in searchOption.searchMap {
+                if let kv = sm.first, kv.key != listView.searchKey, kv.value.count > 0 {
+                    params[kv.key.rawValue] = kv.value
+                }
+            }
+            listView.setFilter(keyWord: searchOption.searchWord, params: params)
+        }
+    }
+    
     func hiddenKeyborad(){
         DispatchQueue.main.async {
             NotificationCenter.default.post(name: HidenKeyBoradNoti, object: nil)
@@ -259,6 +274,7 @@ extension SearchExtensionView:SearchListViewDelegate,SearchHistoryViewDelegate {
         updateNumbs(key: searchKey, numb: list.count)
         // 更新searchOption
         searchOption.replace(key: searchKey, values: list)
+        updateListFilters()
         hiddenKeyborad()
     }
     
@@ -54,6 +54,9 @@ class SearchListView: UIView {
     var searchKey:SearchKey
     var taskID:NSNumber?
     var searchResult:[[String:String]]?
+    // 其他筛选项的当前条件，计数在这些条件的结果上统计
+    var keyWord:String?
+    var params = [String:[String]]()
     
     init(taskID:NSNumber?,searchKey:SearchKey,delegate:SearchListViewDelegate,tag:Int) {
         self.searchKey = searchKey
@@ -76,10 +79,19 @@ class SearchListView: UIView {
     }
     
     func loadData(){
-        searchResult = Session.groupBy(taskID: taskID,type: searchKey.rawValue)
+        searchResult = Session.groupBy(taskID: taskID,type: searchKey.rawValue, keyWord: keyWord, params: params)
         tableView.reloadData()
     }
     
+    // 条件变化后清空结果，下次显示时重新统计
+    func setFilter(keyWord:String?, params:[String:[String]]) {
+        if keyWord == self.keyWord, params == self.params { return }
+        self.keyWord = keyWord
+        self.params = params
+        searchResult = nil
+        if window != nil { loadData() }
+    }
+    
     @objc func clearSelected(){
         selectedList = []
         delegate?.searchListDidChange(listView: self, searchKey: searchKey, list: selectedList)
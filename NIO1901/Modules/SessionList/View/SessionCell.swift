@@ -258,19 +258,37 @@ class SessionCell: UITableViewCell {
         previewImage.image = nil
         if session?.isImage ?? false {
             previewImage.isHidden = false
-            let imgPath = "\(MitmService.getStoreFolder())\(session?.session.fileFolder ?? "error")/\(session?.session.rspBody ?? "")"
-            // 从缓存、异步获取
-            previewImage.yy_setImage(with: URL(fileURLWithPath: imgPath), placeholder: nil)
-            previewImage.stopAnimating()
-//            if let img = YYImage(contentsOfFile: imgPath) {
-//                previewImage.image = img
-//                previewImage.stopAnimating()
-//            }
+            loadPreviewImage(session?.session)
         }else{
             previewImage.isHidden = true
         }
     }
     
+    private static let previewQueue = DispatchQueue(label: "SessionCell.preview", qos: .userInitiated)
+    private static let previewCache = NSCache<NSString, UIImage>()
+    
+    // 预览图从 BodyStore 读出，后台解码；接收完毕的才缓存
+    private func loadPreviewImage(_ s:Session?) {
+        guard let target = s, let id = target.id else { return }
+        let key = "\(target.fileFolder ?? "")/\(id)" as NSString
+        if let img = SessionCell.previewCache.object(forKey: key) {
+            previewImage.image = img
+            previewImage.stopAnimating()
+            return
+        }
+        let finished = target.rspEndTime != nil || target.endTime != nil
+        SessionCell.previewQueue.async {
+            guard let data = target.getBodyData(), let img = YYImage(data: data) else { return }
+            if finished { SessionCell.previewCache.setObject(img, forKey: key) }
+            DispatchQueue.main.async {
+                // 复用的 cell 已经换了会话
+                guard self.session?.session === target else { return }
+                self.previewImage.image = img
+                self.previewImage.stopAnimating()
+            }
+        }
+    }
+    
     @objc func viewDidTouch(){
         delegate?.sessionCellSelectedChange(session: session?.session, selected: isSelected,indexPath: indexPath)
     }
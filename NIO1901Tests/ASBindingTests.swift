@@ -0,0 +1,41 @@
+//
+//  ASBindingTests.swift
+//  NIO1901Tests
+//
+//  Created by LiuJie on 2019/7/12.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import XCTest
+@testable import TunnelServices
+
+// 手写的 bindings 必须与反射得到的列一致（列名、可选性、doubleTypes），新增属性忘了加 binding 时在这里失败
+class ASBindingTests: XCTestCase {
+
+    private func check<M: ASModel & ASBindingProtocol>(_ model: M, file: StaticString = #file, line: UInt = #line) {
+        XCTAssertNotNil(model.modelBindings(), "\(M.self) uses reflection", file: file, line: line)
+        let reflected = model.reflectedColumns()
+        let bindings = M.bindings
+        XCTAssertEqual(bindings.count, Set(bindings.map { $0.column }).count, "duplicate binding", file: file, line: line)
+        XCTAssertEqual(Set(bindings.map { $0.column }), Set(reflected.map { $0.column }), file: file, line: line)
+        var kinds = [String: ASColumnKind]()
+        reflected.forEach { kinds[$0.column] = $0.kind }
+        for binding in bindings {
+            XCTAssertEqual(binding.kind, kinds[binding.column], binding.column, file: file, line: line)
+        }
+        let doubles = Set(bindings.filter { $0.kind == .double || $0.kind == .doubleOptional }.map { $0.column })
+        XCTAssertEqual(doubles, Set(model.doubleTypes()), file: file, line: line)
+    }
+
+    func testSessionBindings() {
+        check(Session())
+    }
+
+    func testTaskBindings() {
+        check(Task())
+    }
+
+    func testRuleBindings() {
+        check(Rule())
+    }
+}
@@ -0,0 +1,122 @@
+//
+//  ASCacheTests.swift
+//  NIO1901Tests
+//
+//  Created by LiuJie on 2019/7/12.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import XCTest
+import SQLite
+@testable import TunnelServices
+
+// 缓存语句（bind、step、reset）与每次拼 Setter 的写入对比
+class ASCacheNote: ASModel {
+    var title:String = ""
+    var size:NSNumber = 0
+    var note:String? = nil
+
+    override class var dbName: String? {
+        return ASCacheTests.dbName
+    }
+}
+
+// 实现 CreateColumnsProtocol 的模型不走缓存语句
+class ASCacheUncachedNote: ASCacheNote, CreateColumnsProtocol {
+    func createColumns(t: TableBuilder) {
+        t.column(Expression<Int64>("id"), primaryKey: .autoincrement)
+        t.column(Expression<Int64>("created_at"))
+        t.column(Expression<Int64>("updated_at"))
+        t.column(Expression<String>("title"))
+        t.column(Expression<Int64>("size"))
+        t.column(Expression<String?>("note"))
+    }
+}
+
+class ASCacheTests: XCTestCase {
+
+    static let dbName = "ASCacheTests"
+    static let rowCount = 1000
+
+    // 连接只打开一次：ASCache 按连接的 ObjectIdentifier 记录已验证的表
+    override class func setUp() {
+        let path = NSTemporaryDirectory() + "ASCacheTests-\(UUID().uuidString).sqlite"
+        ASConfigration.setDB(path: path, name: dbName)
+    }
+
+    private func insertRows<T: ASCacheNote>(_ type: T.Type) {
+        let db = try! T.getDB()
+        try! db.transaction {
+            for i in 0..<ASCacheTests.rowCount {
+                let note = T()
+                note.title = "title \(i)"
+                note.size = NSNumber(value: i)
+                try note.insert()
+            }
+        }
+    }
+
+    func testCachedInsertAndUpdate() throws {
+        let note = ASCacheNote()
+        XCTAssertTrue(note.canUseCachedUpdate)
+        note.title = "first"
+        note.size = 10
+        try note.insert()
+        XCTAssertNotNil(note.id)
+
+        note.title = "second"
+        note.note = "changed"
+        try note.update()
+        let found = ASCacheNote.findFirst("id", value: note.id)
+        XCTAssertEqual(found?.title, "second")
+        XCTAssertEqual(found?.size, 10)
+        XCTAssertEqual(found?.note, "changed")
+
+        // 不存在的 id 不改动任何行
+        let missing = ASCacheNote(id: 1_000_000)
+        missing.title = "missing"
+        try missing.update()
+        XCTAssertNil(ASCacheNote.findFirst("title", value: "missing"))
+    }
+
+    func testCachedAndUncachedWriteSameRow() throws {
+        let cached = ASCacheNote()
+        let uncached = ASCacheUncachedNote()
+        XCTAssertFalse(uncached.canUseCachedInsert)
+        for note in [cached, uncached] {
+            note.title = "same"
+            note.size = 42
+            note.note = nil
+            try note.insert()
+        }
+        XCTAssertEqual(ASCacheNote.findFirst("id", value: cached.id)?.size, 42)
+        XCTAssertEqual(ASCacheUncachedNote.findFirst("id", value: uncached.id)?.title, "same")
+        XCTAssertNil(ASCacheUncachedNote.findFirst("id", value: uncached.id)?.note)
+    }
+
+    // 主键冲突的写入抛出错误，savepoint 已释放，连接回到自动提交
+    func testFailedCachedInsertReleasesSavepoint() throws {
+        let note = ASCacheNote()
+        note.title = "unique"
+        try note.insert()
+        let duplicate = ASCacheNote(id: note.id!.int64Value)
+        duplicate.title = "duplicate"
+        XCTAssertThrowsError(try duplicate.insert())
+        XCTAssertTrue(try ASCacheNote.getDB().isAutocommit)
+        XCTAssertEqual(ASCacheNote.findFirst("id", value: note.id)?.title, "unique")
+    }
+
+    func testPerformanceCachedInsert() {
+        try? ASCacheNote.createTable()
+        measure {
+            insertRows(ASCacheNote.self)
+        }
+    }
+
+    func testPerformanceUncachedInsert() {
+        try? ASCacheUncachedNote.createTable()
+        measure {
+            insertRows(ASCacheUncachedNote.self)
+        }
+    }
+}
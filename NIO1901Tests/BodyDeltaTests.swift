@@ -0,0 +1,116 @@
+//
+//  BodyDeltaTests.swift
+//  NIO1901Tests
+//
+//  Created by LiuJie on 2019/7/12.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import XCTest
+@testable import TunnelServices
+
+class BodyDeltaTests: XCTestCase {
+
+    private func random(_ count: Int, seed: UInt32) -> [UInt8] {
+        var x = seed
+        return (0..<count).map { _ in
+            x = x &* 1_103_515_245 &+ 12345
+            return UInt8(truncatingIfNeeded: x >> 16)
+        }
+    }
+
+    private func readBase(_ base: [UInt8]) -> (Int, Int) -> Data? {
+        return { offset, length in
+            guard offset >= 0, length >= 0, offset + length <= base.count else { return nil }
+            return Data(base[offset..<offset + length])
+        }
+    }
+
+    // 编码后按指令还原，必须与目标完全一致
+    @discardableResult
+    private func roundTrip(_ base: [UInt8], _ target: [UInt8], limit: Int = Int.max, file: StaticString = #file, line: UInt = #line) -> [UInt8]? {
+        guard let delta = BodyDelta.encode(base: base, target: target, limit: limit) else { return nil }
+        var restored = Data()
+        XCTAssertTrue(BodyDelta.apply(Data(delta), readBase: readBase(base)) { restored.append($0) }, file: file, line: line)
+        XCTAssertEqual(restored, Data(target), file: file, line: line)
+        return delta
+    }
+
+    func testIdenticalBody() {
+        let base = random(64 * 1024, seed: 1)
+        let delta = roundTrip(base, base)
+        // 一条 COPY
+        XCTAssertNotNil(delta)
+        XCTAssertLessThan(delta?.count ?? Int.max, 16)
+    }
+
+    func testEditedJSON() {
+        let base = Array((0..<2000).map { "{\"id\":\($0),\"name\":\"item \($0)\",\"price\":\($0 * 3)}" }.joined(separator: ",").utf8)
+        var target = base
+        target.replaceSubrange(5000..<5010, with: Array("\"changed\":true,".utf8))
+        target.insert(contentsOf: Array("prefix".utf8), at: 0)
+        target.append(contentsOf: Array(",{\"id\":-1}".utf8))
+        let delta = roundTrip(base, target, limit: target.count / 2)
+        XCTAssertNotNil(delta)
+        XCTAssertLessThan(delta?.count ?? Int.max, 200)
+    }
+
+    // 错开一个字节也能靠滚动哈希找到匹配
+    func testShiftedBody() {
+        let base = random(10_000, seed: 2)
+        let target = [0x42] + base
+        XCTAssertLessThan(roundTrip(base, target)?.count ?? Int.max, 32)
+    }
+
+    func testUnrelatedBodyExceedsLimit() {
+        let base = random(10_000, seed: 3), target = random(10_000, seed: 4)
+        XCTAssertNil(BodyDelta.encode(base: base, target: target, limit: target.count / 2))
+        // 不限制时仍能正确还原（全是 ADD）
+        roundTrip(base, target)
+    }
+
+    func testShortInput() {
+        XCTAssertNil(BodyDelta.encode(base: [1, 2, 3], target: random(100, seed: 5), limit: Int.max))
+        XCTAssertNil(BodyDelta.encode(base: random(100, seed: 5), target: [1, 2, 3], limit: Int.max))
+    }
+
+    func testRandomEdits() {
+        var seed: UInt32 = 100
+        for _ in 0..<50 {
+            seed += 1
+            let base = random(4096 + Int(seed % 7) * 1000, seed: seed)
+            var target = base
+            var x = seed
+            for _ in 0..<Int(seed % 5) + 1 {
+                x = x &* 1_103_515_245 &+ 12345
+                let at = Int(x >> 8) % target.count
+                let length = min(target.count - at, Int(x % 64))
+                target.replaceSubrange(at..<at + length, with: random(Int(x % 80), seed: x))
+            }
+            roundTrip(base, target)
+        }
+    }
+
+    func testApplyRejectsBadDelta() {
+        let base = random(1000, seed: 6)
+        let delta = BodyDelta.encode(base: base, target: base, limit: Int.max)!
+        // 截断的 varint
+        XCTAssertFalse(BodyDelta.apply(Data([0x80]), readBase: readBase(base)) { _ in })
+        // ADD 的长度超出
+        XCTAssertFalse(BodyDelta.apply(Data([10 << 1, 1, 2]), readBase: readBase(base)) { _ in })
+        // COPY 超出基准
+        XCTAssertFalse(BodyDelta.apply(Data(delta), readBase: readBase(Array(base.prefix(500)))) { _ in })
+        XCTAssertTrue(BodyDelta.apply(Data(), readBase: readBase(base)) { _ in })
+    }
+
+    func testPerformanceEncode() {
+        let base = random(256 * 1024, seed: 7)
+        var target = base
+        for i in stride(from: 0, to: target.count, by: 8192) {
+            target[i] ^= 0xff
+        }
+        measure {
+            _ = BodyDelta.encode(base: base, target: target, limit: Int.max)
+        }
+    }
+}
@@ -0,0 +1,183 @@
+//
+//  BodyStoreTests.swift
+//  NIO1901Tests
+//
+//  Created by LiuJie on 2019/7/12.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import XCTest
+import NIO
+@testable import TunnelServices
+
+class BodyStoreTests: XCTestCase {
+
+    var store: String!
+    var folder: String!
+    let allocator = ByteBufferAllocator()
+
+    override func setUp() {
+        store = NSTemporaryDirectory() + "BodyStoreTests-\(UUID().uuidString)/"
+        folder = UUID().uuidString
+        MitmService.storeFolder = store
+        BodyStore.deltaEncoding = false
+        try! FileManager.default.createDirectory(atPath: store + folder, withIntermediateDirectories: true, attributes: nil)
+    }
+
+    override func tearDown() {
+        BodyStore.closeAll()
+        try? FileManager.default.removeItem(atPath: store)
+        MitmService.storeFolder = ""
+    }
+
+    private func body(_ count: Int, seed: UInt32) -> [UInt8] {
+        var x = seed
+        return (0..<count).map { _ in
+            x = x &* 1_103_515_245 &+ 12345
+            return UInt8(truncatingIfNeeded: x >> 16)
+        }
+    }
+
+    // 按 chunk 分片写入，和抓包时一样
+    private func write(_ writer: BodyStore, _ sessionID: Int, _ isReq: Bool, _ bytes: [UInt8], chunk: Int = 4096, truncated: Bool = false) {
+        var start = 0
+        while start < bytes.count {
+            let end = min(bytes.count, start + chunk)
+            var buffer = allocator.buffer(capacity: end - start)
+            buffer.writeBytes(bytes[start..<end])
+            writer.append(sessionID: sessionID, isReq: isReq, buffer: buffer)
+            start = end
+        }
+        writer.finish(sessionID: sessionID, isReq: isReq, truncated: truncated)
+    }
+
+    private func records(_ sessionID: Int) -> [BodyStore.Extent] {
+        let fd = open(store + folder + "/" + BodyStore.indexName, O_RDONLY)
+        defer { close(fd) }
+        var list = [BodyStore.Extent]()
+        BodyStore.Reader.scan(fd, from: 0, to: Int64(lseek(fd, 0, SEEK_END))) { id, _, extent in
+            if id == sessionID { list.append(extent) }
+        }
+        return list
+    }
+
+    private func isRef(_ extent: BodyStore.Extent) -> Bool {
+        if case .ref = extent { return true }
+        return false
+    }
+
+    func testAppendFinishRead() {
+        let writer = BodyStore.store(for: folder)!
+        let small = body(100, seed: 1), large = body(20_000, seed: 2)
+        write(writer, 1, true, small)
+        write(writer, 1, false, large, chunk: 3000)
+        let reader = BodyStore.Reader(folder: folder)
+        XCTAssertEqual(reader.read(sessionID: 1, isReq: true), Data(small))
+        XCTAssertEqual(reader.read(sessionID: 1, isReq: false), Data(large))
+        XCTAssertEqual(reader.size(sessionID: 1, isReq: false), UInt64(large.count))
+        XCTAssertTrue(reader.contains(sessionID: 1, isReq: true))
+        XCTAssertFalse(reader.contains(sessionID: 2, isReq: true))
+        XCTAssertFalse(reader.isTruncated(sessionID: 1, isReq: false))
+    }
+
+    func testDuplicateBodyIsRef() {
+        let writer = BodyStore.store(for: folder)!
+        let large = body(20_000, seed: 3)
+        write(writer, 1, false, large)
+        write(writer, 2, false, large)
+        XCTAssertEqual(writer.dedupCount.load(), 1)
+        XCTAssertTrue(records(2).contains(where: isRef))
+        let reader = BodyStore.Reader(folder: folder)
+        XCTAssertEqual(reader.read(sessionID: 2, isReq: false), Data(large))
+        let stats = reader.dedupStats()
+        XCTAssertEqual(stats.logical, UInt64(large.count * 2))
+        XCTAssertEqual(stats.stored, UInt64(large.count))
+    }
+
+    // 被引用的 body 删除后，引用者仍能读出
+    func testPunchOwnerKeepsReferrer() {
+        let writer = BodyStore.store(for: folder)!
+        let large = body(20_000, seed: 4)
+        write(writer, 1, false, large)
+        write(writer, 2, false, large)
+        BodyStore.punch(folder: folder, sessionIDs: [1])
+        XCTAssertEqual(BodyStore.Reader(folder: folder).read(sessionID: 2, isReq: false), Data(large))
+    }
+
+    // 没有引用者的摘要记录删除后，同样的 body 重新抓到时写完整内容，不引用已打洞的分片
+    func testDeleteThenRecapture() {
+        let writer = BodyStore.store(for: folder)!
+        let large = body(20_000, seed: 5)
+        write(writer, 1, false, large)
+        BodyStore.punch(folder: folder, sessionIDs: [1])
+        write(writer, 2, false, large)
+        XCTAssertEqual(writer.dedupCount.load(), 0)
+        XCTAssertFalse(records(2).contains(where: isRef))
+        XCTAssertEqual(BodyStore.Reader(folder: folder).read(sessionID: 2, isReq: false), Data(large))
+        // 之后的重复 body 引用新的一份
+        write(writer, 3, false, large)
+        XCTAssertTrue(records(3).contains { extent in
+            if case .ref(let owner, _) = extent { return owner == 2 * 2 + 1 }
+            return false
+        })
+    }
+
+    // 重新打开 Task（Tunnel 重启）时从索引恢复摘要，删除记录同样生效
+    func testDeleteThenRecaptureAfterReopen() {
+        let large = body(20_000, seed: 6)
+        write(BodyStore.store(for: folder)!, 1, false, large)
+        BodyStore.closeAll()
+        BodyStore.punch(folder: folder, sessionIDs: [1])
+        let writer = BodyStore.store(for: folder)!
+        write(writer, 2, false, large)
+        XCTAssertFalse(records(2).contains(where: isRef))
+        XCTAssertEqual(BodyStore.Reader(folder: folder).read(sessionID: 2, isReq: false), Data(large))
+    }
+
+    func testTruncatedBody() {
+        let writer = BodyStore.store(for: folder)!
+        let large = body(10_000, seed: 7)
+        write(writer, 1, false, large, truncated: true)
+        write(writer, 2, false, large)
+        // 截断的 body 不参与去重
+        XCTAssertEqual(writer.dedupCount.load(), 0)
+        let reader = BodyStore.Reader(folder: folder)
+        XCTAssertTrue(reader.isTruncated(sessionID: 1, isReq: false))
+        XCTAssertEqual(reader.read(sessionID: 1, isReq: false), Data(large))
+        XCTAssertFalse(reader.isTruncated(sessionID: 2, isReq: false))
+    }
+
+    // 同一个 Reader 只解析新追加的索引；内联分片按位置读回
+    func testReaderSeesAppendedBodies() {
+        let writer = BodyStore.store(for: folder)!
+        let small = body(100, seed: 8), large = body(20_000, seed: 9)
+        write(writer, 1, true, small)
+        let reader = BodyStore.Reader.reader(for: folder)
+        XCTAssertEqual(reader.read(sessionID: 1, isReq: true), Data(small))
+        XCTAssertFalse(reader.contains(sessionID: 2, isReq: false))
+        write(writer, 2, false, large, chunk: 1000)
+        XCTAssertEqual(reader.size(sessionID: 2, isReq: false), UInt64(large.count))
+        XCTAssertEqual(reader.read(sessionID: 2, isReq: false), Data(large))
+        BodyStore.Reader.drop(folder: folder)
+        XCTAssertFalse(BodyStore.Reader.reader(for: folder) === reader)
+    }
+
+    // 写入中途删除：分片已打洞，结束时不登记摘要，之后同样的 body 写完整内容
+    func testDeleteBetweenAppendAndFinish() {
+        let writer = BodyStore.store(for: folder)!
+        let large = body(20_000, seed: 10)
+        var buffer = allocator.buffer(capacity: large.count)
+        buffer.writeBytes(large)
+        writer.append(sessionID: 1, isReq: false, buffer: buffer)
+        BodyStore.punch(folder: folder, sessionIDs: [1])
+        writer.finish(sessionID: 1, isReq: false)
+        XCTAssertFalse(records(1).contains { extent in
+            if case .digest = extent { return true }
+            return false
+        })
+        write(writer, 2, false, large)
+        XCTAssertEqual(writer.dedupCount.load(), 0)
+        XCTAssertFalse(records(2).contains(where: isRef))
+        XCTAssertEqual(BodyStore.Reader(folder: folder).read(sessionID: 2, isReq: false), Data(large))
+    }
+}
@@ -0,0 +1,113 @@
+//
+//  CIDRTableTests.swift
+//  NIO1901Tests
+//
+//  Created by LiuJie on 2019/7/12.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import XCTest
+import NIO
+@testable import TunnelServices
+
+class CIDRTableTests: XCTestCase {
+
+    private func prefix(_ value: String, _ index: Int32) -> CIDRTable.Prefix {
+        let parsed = CIDRTable.parse(value)!
+        return CIDRTable.Prefix(hi: parsed.hi, lo: parsed.lo, length: parsed.length, value: index)
+    }
+
+    func testParse() {
+        XCTAssertEqual(CIDRTable.parse("10.0.0.0/8")?.length, 8)
+        XCTAssertEqual(CIDRTable.parse("1.2.3.4")?.length, 32)
+        XCTAssertEqual(CIDRTable.parse("2001:db8::/32")?.isV6, true)
+        XCTAssertNil(CIDRTable.parse("10.0.0.0/33"))
+        XCTAssertNil(CIDRTable.parse("10.0.0/8"))
+        XCTAssertNil(CIDRTable.parse("not an ip"))
+    }
+
+    func testLongestPrefixMatchV4() {
+        let table = CIDRTable(v4: [prefix("10.0.0.0/8", 0),
+                                   prefix("10.1.0.0/16", 1),
+                                   prefix("10.1.2.0/24", 2),
+                                   prefix("10.1.2.3/32", 3),
+                                   prefix("192.168.0.0/13", 4)], v6: [])
+        XCTAssertEqual(table.count, 5)
+        XCTAssertEqual(table.lookup("10.200.0.1"), 0)
+        XCTAssertEqual(table.lookup("10.1.200.1"), 1)
+        XCTAssertEqual(table.lookup("10.1.2.200"), 2)
+        XCTAssertEqual(table.lookup("10.1.2.3"), 3)
+        // /13 不在 6 bit 边界上
+        XCTAssertEqual(table.lookup("192.175.255.255"), 4)
+        XCTAssertNil(table.lookup("192.176.0.0"))
+        XCTAssertNil(table.lookup("11.0.0.1"))
+    }
+
+    func testDefaultRouteAndOrder() {
+        // 同长度时先出现的规则优先
+        let table = CIDRTable(v4: [prefix("0.0.0.0/0", 0),
+                                   prefix("172.16.0.0/12", 1),
+                                   prefix("172.16.0.0/12", 2)], v6: [])
+        XCTAssertEqual(table.lookup("8.8.8.8"), 0)
+        XCTAssertEqual(table.lookup("172.31.255.1"), 1)
+    }
+
+    func testLongestPrefixMatchV6() {
+        let table = CIDRTable(v4: [], v6: [prefix("2001:db8::/32", 0),
+                                           prefix("2001:db8:1::/48", 1),
+                                           prefix("2001:db8:1::1", 2)])
+        XCTAssertEqual(table.lookup("2001:db8:ffff::1"), 0)
+        XCTAssertEqual(table.lookup("2001:db8:1::2"), 1)
+        XCTAssertEqual(table.lookup("2001:db8:1::1"), 2)
+        XCTAssertNil(table.lookup("2001:db9::1"))
+        // IPv4 地址不会查到 IPv6 的表
+        XCTAssertNil(table.lookup("32.1.13.184"))
+    }
+
+    // 双栈 socket 上的 IPv4 连接是 ::ffff:a.b.c.d，按 IPv4 规则匹配；CONNECT 目标中的 IPv6 带方括号
+    func testMappedV4AndBracketedV6() {
+        let table = CIDRTable(v4: [prefix("10.0.0.0/8", 0)], v6: [prefix("2001:db8::/32", 1)])
+        XCTAssertEqual(table.lookup("::ffff:10.1.2.3"), 0)
+        XCTAssertNil(table.lookup("::ffff:11.1.2.3"))
+        XCTAssertEqual(table.lookup("[2001:db8::1]"), 1)
+        let mapped = try! SocketAddress(ipAddress: "::ffff:10.1.2.3", port: 443)
+        XCTAssertEqual(table.lookup(mapped), 0)
+    }
+
+    func testRandomAgainstLinearScan() {
+        var prefixes = [CIDRTable.Prefix]()
+        for i in 0..<2000 {
+            let ip = UInt64(UInt32.random(in: 0...UInt32.max)) << 32
+            prefixes.append(CIDRTable.Prefix(hi: ip, lo: 0, length: Int.random(in: 0...32), value: Int32(i)))
+        }
+        let table = CIDRTable(v4: prefixes, v6: [])
+        for _ in 0..<2000 {
+            let key = UInt64(UInt32.random(in: 0...UInt32.max)) << 32
+            var best: (length: Int, value: Int32) = (-1, -1)
+            for p in prefixes {
+                let mask: UInt64 = p.length == 0 ? 0 : ~UInt64(0) << UInt64(64 - p.length)
+                if key & mask == p.hi & mask, p.length > best.length {
+                    best = (p.length, p.value)
+                }
+            }
+            XCTAssertEqual(table.v4.lookup(key, 0), best.value)
+        }
+    }
+
+    func testPerformanceLookup() {
+        var prefixes = [CIDRTable.Prefix]()
+        for i in 0..<100_000 {
+            let ip = UInt64(UInt32.random(in: 0...UInt32.max)) << 32
+            prefixes.append(CIDRTable.Prefix(hi: ip, lo: 0, length: Int.random(in: 8...32), value: Int32(i)))
+        }
+        let table = CIDRTable(v4: prefixes, v6: [])
+        let keys = (0..<4096).map { _ in UInt64(UInt32.random(in: 0...UInt32.max)) << 32 }
+        self.measure {
+            var hits = 0
+            for i in 0..<1_000_000 {
+                if table.v4.lookup(keys[i & 4095], 0) >= 0 { hits += 1 }
+            }
+            XCTAssertGreaterThanOrEqual(hits, 0)
+        }
+    }
+}
@@ -0,0 +1,93 @@
+//
+//  CaptureFilterTests.swift
+//  NIO1901Tests
+//
+//  Created by LiuJie on 2019/7/12.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import XCTest
+import NIOHTTP1
+@testable import TunnelServices
+
+class CaptureFilterTests: XCTestCase {
+
+    private func input(status: Int = 200, size: Int = 100, type: String = "application/json",
+                       encoding: String = "gzip", host: String = "api.example.com", method: String = "GET") -> CaptureInput {
+        return CaptureInput(status: status, size: size, rspType: type, rspEncoding: encoding, host: host, method: method)
+    }
+
+    func testNumbers() {
+        XCTAssertEqual(CaptureFilter.number("512"), 512)
+        XCTAssertEqual(CaptureFilter.number("10KB"), 10 * 1024)
+        XCTAssertEqual(CaptureFilter.number("1mb"), 1024 * 1024)
+        XCTAssertEqual(CaptureFilter.number("1.5G"), 1024 * 1024 * 1024 * 3 / 2)
+        XCTAssertEqual(CaptureFilter.number("20B"), 20)
+        XCTAssertNil(CaptureFilter.number("MB"))
+    }
+
+    func testCompare() {
+        let filter = CaptureFilter("status >= 400")!
+        XCTAssertTrue(filter.evaluate(input(status: 404)))
+        XCTAssertFalse(filter.evaluate(input(status: 200)))
+        XCTAssertTrue(CaptureFilter("size < 1MB")!.evaluate(input(size: 1000)))
+        // 长度未知时跳过大小比较，chunked 响应不被 size < 1MB 排除
+        XCTAssertTrue(CaptureFilter("size < 1MB")!.evaluate(input(size: -1)))
+        XCTAssertTrue(CaptureFilter("status >= 400 && size > 1MB")!.evaluate(input(status: 500, size: -1)))
+        XCTAssertTrue(CaptureFilter("size == unknown")!.evaluate(input(size: -1)))
+        XCTAssertFalse(CaptureFilter("size == unknown")!.evaluate(input(size: 0)))
+        XCTAssertTrue(CaptureFilter("size != unknown && size < 1MB")!.evaluate(input(size: 0)))
+        XCTAssertNil(CaptureFilter("size < unknown"))
+    }
+
+    func testContentLength() {
+        XCTAssertEqual(CaptureInput.contentLength(HTTPHeaders([("content-length", "1024")])), 1024)
+        XCTAssertEqual(CaptureInput.contentLength(HTTPHeaders([("Host", "a"), ("Content-Length", "0")])), 0)
+        XCTAssertEqual(CaptureInput.contentLength(HTTPHeaders([("Transfer-Encoding", "chunked")])), -1)
+        XCTAssertEqual(CaptureInput.contentLength(HTTPHeaders([("Content-Length", "12a")])), -1)
+        XCTAssertEqual(CaptureInput.contentLength(HTTPHeaders([("Content-Length", "")])), -1)
+        XCTAssertEqual(CaptureInput.contentLength(HTTPHeaders([("Content-Length", "99999999999999999999999")])), -1)
+    }
+
+    func testStrings() {
+        XCTAssertTrue(CaptureFilter("type ~ JSON")!.evaluate(input()))
+        XCTAssertFalse(CaptureFilter("rspType !~ json")!.evaluate(input()))
+        XCTAssertTrue(CaptureFilter("host == API.example.com")!.evaluate(input()))
+        XCTAssertTrue(CaptureFilter("method != post")!.evaluate(input()))
+        XCTAssertTrue(CaptureFilter("encoding == 'gzip'")!.evaluate(input()))
+        XCTAssertTrue(CaptureFilter("type ~ \"application/\"")!.evaluate(input()))
+    }
+
+    func testPrecedence() {
+        // && 优先于 ||
+        let filter = CaptureFilter("status == 500 || status >= 400 && method == POST")!
+        XCTAssertTrue(filter.evaluate(input(status: 500)))
+        XCTAssertTrue(filter.evaluate(input(status: 404, method: "POST")))
+        XCTAssertFalse(filter.evaluate(input(status: 404, method: "GET")))
+        let grouped = CaptureFilter("(status == 500 || status >= 400) && method == POST")!
+        XCTAssertFalse(grouped.evaluate(input(status: 500)))
+        let negated = CaptureFilter("!(type ~ image) && !host ~ cdn")!
+        XCTAssertTrue(negated.evaluate(input()))
+        XCTAssertFalse(negated.evaluate(input(type: "image/png")))
+        XCTAssertFalse(negated.evaluate(input(host: "cdn.example.com")))
+    }
+
+    func testInvalidExpressions() {
+        XCTAssertNil(CaptureFilter(""))
+        XCTAssertNil(CaptureFilter("status"))
+        XCTAssertNil(CaptureFilter("status >= "))
+        XCTAssertNil(CaptureFilter("unknown == 1"))
+        XCTAssertNil(CaptureFilter("status ~ 40"))
+        XCTAssertNil(CaptureFilter("size > big"))
+        XCTAssertNil(CaptureFilter("host > a"))
+        XCTAssertNil(CaptureFilter("(status == 200"))
+        XCTAssertNil(CaptureFilter("status == 200 &&"))
+        XCTAssertNil(CaptureFilter("status == 200 extra"))
+        XCTAssertNil(CaptureFilter("host == 'unterminated"))
+    }
+
+    func testExpressionIsKept() {
+        let text = "status >= 400 && rspType ~ json && size < 1MB"
+        XCTAssertEqual(CaptureFilter(text)?.expression, text)
+    }
+}
@@ -0,0 +1,92 @@
+//
+//  DomainBlocklistTests.swift
+//  NIO1901Tests
+//
+//  Created by LiuJie on 2019/7/12.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import XCTest
+@testable import TunnelServices
+
+// 黑名单编译 -> mmap -> contains；损坏的文件不映射
+class DomainBlocklistTests: XCTestCase {
+
+    var url: URL!
+
+    override func setUp() {
+        url = URL(fileURLWithPath: NSTemporaryDirectory() + "DomainBlocklistTests-\(UUID().uuidString).knbl")
+    }
+
+    override func tearDown() {
+        try? FileManager.default.removeItem(at: url)
+    }
+
+    private func compile(_ lines: [String]) -> DomainBlocklist? {
+        XCTAssertNoThrow(try DomainBlocklist.compile(lines.joined(separator: "\n"), to: url))
+        return DomainBlocklist(url: url)
+    }
+
+    func testSuffixAndExactMatching() {
+        let list = compile(["# comment",
+                            "DOMAIN-SUFFIX,ads.example.com",
+                            "DOMAIN,exact.example.org",
+                            "0.0.0.0 tracker.net",
+                            "*.wild.io",
+                            ".dot.io  // trailing comment",
+                            "DOMAIN,both.cn",
+                            "DOMAIN-SUFFIX,both.cn",
+                            "IP-CIDR,10.0.0.0/8",
+                            "localhost"])
+        guard let blocklist = list else { return XCTFail("not mapped") }
+        XCTAssertEqual(blocklist.count, 6)
+        let expected: [String: Bool] = [
+            "ads.example.com": true, "x.y.ads.example.com": true, "example.com": false, "notads.example.com": false,
+            "exact.example.org": true, "sub.exact.example.org": false,
+            "tracker.net": true, "a.tracker.net": false,
+            "wild.io": true, "a.b.wild.io": true, "dot.io": true, "x.dot.io": true, "io": false,
+            "both.cn": true, "sub.both.cn": true,
+            "10.0.0.1": false, "localhost": false, "": false]
+        for (host, blocked) in expected {
+            XCTAssertEqual(blocklist.contains(host: host), blocked, host)
+        }
+    }
+
+    // 条数多时 Bloom 位图有多个字；不在表中的域名大多在 Bloom 处返回，误判的由二分查找排除
+    func testBloomFilterPath() {
+        let count = 20_000
+        guard let blocklist = compile((0..<count).map { "DOMAIN-SUFFIX,d\($0).block.test" }) else { return XCTFail("not mapped") }
+        XCTAssertEqual(blocklist.count, count)
+        for i in stride(from: 0, to: count, by: 7) {
+            XCTAssertTrue(blocklist.contains(host: "d\(i).block.test"))
+            XCTAssertTrue(blocklist.contains(host: "cdn.d\(i).block.test"))
+        }
+        for i in count..<count + 2000 {
+            XCTAssertFalse(blocklist.contains(host: "d\(i).block.test"))
+        }
+        XCTAssertFalse(blocklist.contains(host: "block.test"))
+    }
+
+    func testCorruptFileIsRejected() throws {
+        XCTAssertNotNil(compile(["ads.example.com", "tracker.net"]))
+        let good = try Data(contentsOf: url)
+        func rejects(_ data: Data, _ message: String) {
+            XCTAssertNoThrow(try data.write(to: url))
+            XCTAssertNil(DomainBlocklist(url: url), message)
+        }
+        rejects(good.prefix(DomainBlocklist.headerSize - 1), "short header")
+        rejects(good.dropLast(), "truncated strings")
+        var badMagic = good
+        badMagic[0] ^= 0xff
+        rejects(badMagic, "magic")
+        var badVersion = good
+        badVersion[4] = 2
+        rejects(badVersion, "version")
+        // 偏移表在 Bloom 之后，第二项改成超出字符串区
+        let bloomWords = Int(good[12]) | Int(good[13]) << 8
+        var badOffset = good
+        badOffset[DomainBlocklist.headerSize + bloomWords * 8 + 4] = 0xff
+        rejects(badOffset, "offsets")
+        XCTAssertNil(DomainBlocklist(url: url.appendingPathExtension("missing")))
+    }
+}
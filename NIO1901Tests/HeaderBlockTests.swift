@@ -0,0 +1,63 @@
+//
+//  HeaderBlockTests.swift
+//  NIO1901Tests
+//
+//  Created by LiuJie on 2019/7/12.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import XCTest
+import NIOHTTP1
+import SQLite
+@testable import TunnelServices
+
+class HeaderBlockTests: XCTestCase {
+
+    func testRoundTripKeepsOrderAndDuplicates() {
+        let headers = HTTPHeaders([("Host", "example.com"),
+                                   ("Set-Cookie", "a=1"),
+                                   ("X-Custom", ""),
+                                   ("Set-Cookie", "b=2"),
+                                   ("User-Agent", String(repeating: "x", count: 300))])
+        let data = HeaderBlock.encode(headers)
+        let decoded = HeaderBlock.decode(data)
+        XCTAssertEqual(decoded.map { $0.name }, ["host", "set-cookie", "x-custom", "set-cookie", "user-agent"])
+        XCTAssertEqual(decoded.map { $0.value }, ["example.com", "a=1", "", "b=2", String(repeating: "x", count: 300)])
+    }
+
+    // 静态表中有的头部名只写下标，值做 Huffman 编码，比 JSON 小
+    func testNamesAreIndexed() {
+        let headers = HTTPHeaders([("Content-Type", "text/html; charset=utf-8"),
+                                   ("Accept-Encoding", "gzip, deflate, br"),
+                                   ("Cache-Control", "no-cache"),
+                                   ("Cookie", "id=1")])
+        let data = HeaderBlock.encode(headers)
+        for needle in ["content-type", "accept-encoding", "cache-control", "cookie"] {
+            XCTAssertNil(data.range(of: Data(needle.utf8)), needle)
+        }
+        let json = Data([String:String](uniqueKeysWithValues: headers.map { ($0.name.lowercased(), $0.value) }).toJson().utf8)
+        XCTAssertLessThan(data.count * 2, json.count)
+        XCTAssertEqual(HeaderBlock.text(data), "content-type: text/html; charset=utf-8\naccept-encoding: gzip, deflate, br\ncache-control: no-cache\ncookie: id=1")
+    }
+
+    // 没有搜索索引时 Session.getFilter 用 headertext() 解码后匹配头部名和值
+    func testHeaderTextFunction() throws {
+        let db = try Connection(.inMemory)
+        HeaderBlock.register(db)
+        HeaderBlock.register(db)
+        try db.run("CREATE TABLE Session (id INTEGER PRIMARY KEY, reqHeadBlock BLOB)")
+        try db.run("INSERT INTO Session VALUES (1, ?)", HeaderBlock.encode(HTTPHeaders([("Content-Type", "text/html")])).datatypeValue)
+        try db.run("INSERT INTO Session VALUES (2, ?)", HeaderBlock.encode(HTTPHeaders([("Accept", "*/*")])).datatypeValue)
+        try db.run("INSERT INTO Session VALUES (3, NULL)")
+        let like = "lower(\(HeaderBlock.functionName)(reqHeadBlock)) like '%content-type%'"
+        XCTAssertEqual(try db.scalar("SELECT group_concat(id) FROM Session WHERE \(like)") as? String, "1")
+        XCTAssertEqual(try db.scalar("SELECT count(*) FROM Session WHERE \(HeaderBlock.functionName)(reqHeadBlock) IS NULL") as? Int64, 1)
+    }
+
+    func testJSONMergesDuplicates() {
+        let data = HeaderBlock.encode(HTTPHeaders([("Set-Cookie", "a=1"), ("Set-Cookie", "b=2"), ("Accept", "x"), ("accept", "y")]))
+        let dic = [String:String].fromJson(HeaderBlock.json(data))
+        XCTAssertEqual(dic["set-cookie"], "a=1\nb=2")
+        XCTAssertEqual(dic["accept"], "x, y")
+    }
+}
@@ -0,0 +1,110 @@
+//
+//  RowDecoderTests.swift
+//  NIO1901Tests
+//
+//  Created by LiuJie on 2019/7/12.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import XCTest
+import SQLite
+import NIOHTTP1
+@testable import TunnelServices
+
+// 按列下标解码（RowDecoder）与原来的方式对比：SQLite.swift 把每格装箱成 Binding，再按列名逐格分派
+// 目标是至少快 5 倍
+class RowDecoderTests: XCTestCase {
+
+    static let rowCount = 10_000
+    static let speedup = 5.0
+
+    var db: Connection!
+    let sql = "select * from Session order by id"
+
+    override func setUp() {
+        db = try! Connection(.inMemory)
+        let columns = Session.bindings.map { "\"\($0.column)\" \($0.kind.declaredDatatype)\($0.column == "id" ? " PRIMARY KEY" : "")" }
+        try! db.run("CREATE TABLE \"\(Session.nameOfTable)\" (\(columns.joined(separator: ", ")))")
+        try! db.transaction {
+            let insert = try db.prepare("INSERT INTO \"\(Session.nameOfTable)\" VALUES (\(Session.bindings.map { _ in "?" }.joined(separator: ", ")))")
+            for i in 1...RowDecoderTests.rowCount {
+                let session = Session()
+                session.id = NSNumber(value: i)
+                session.taskID = 1
+                session.host = "h\(i % 100).example.com"
+                session.reqLine = "GET /api/v1/items/\(i) HTTP/1.1"
+                session.methods = "GET"
+                session.uri = "/api/v1/items/\(i)"
+                session.state = "200"
+                session.rspType = "application/json"
+                session.startTime = NSNumber(value: 1_560_000_000.5 + Double(i))
+                session.endTime = NSNumber(value: 1_560_000_001.5 + Double(i))
+                session.uploadTraffic = NSNumber(value: i * 10)
+                session.downloadFlow = NSNumber(value: i * 100)
+                session.reqHeadBlock = HeaderBlock.encode(HTTPHeaders([("Host", session.host!), ("Accept", "*/*")]))
+                try insert.run(Session.bindings.map { $0.encode(session) })
+            }
+        }
+    }
+
+    override func tearDown() {
+        db = nil
+    }
+
+    // 原来的 getWith：每行 [Binding?]，按列名找字段再转换
+    private func decodeByName() throws -> [Session] {
+        var fields = [String: ASBinding]()
+        Session.bindings.forEach { fields[$0.column] = $0 }
+        let result = try db.prepare(sql)
+        let columnNames = result.columnNames
+        var sessions = [Session]()
+        for row in result {
+            let session = Session()
+            for i in 0..<columnNames.count {
+                guard let value = row[i], let field = fields[columnNames[i]] else { continue }
+                field.assign(session, value)
+            }
+            sessions.append(session)
+        }
+        return sessions
+    }
+
+    private func time(_ body: () throws -> [Session]) rethrows -> Double {
+        var best = Double.greatestFiniteMagnitude
+        for _ in 0..<3 {
+            let start = CFAbsoluteTimeGetCurrent()
+            let count = try body().count
+            XCTAssertEqual(count, RowDecoderTests.rowCount)
+            best = min(best, CFAbsoluteTimeGetCurrent() - start)
+        }
+        return best
+    }
+
+    func testSameResult() throws {
+        let expected = try decodeByName()
+        let decoded = try Session.rowDecoder.decode(db, sql)
+        XCTAssertEqual(decoded.count, expected.count)
+        for (a, b) in zip(decoded, expected).prefix(100) {
+            XCTAssertEqual(Session.bindings.map { "\($0.encode(a) ?? "nil")" }, Session.bindings.map { "\($0.encode(b) ?? "nil")" })
+        }
+    }
+
+    func testDecoderSpeedup() throws {
+        let byName = try time { try decodeByName() }
+        let byIndex = try time { try Session.rowDecoder.decode(db, sql) }
+        print("RowDecoder \(RowDecoderTests.rowCount) rows: by name \(byName * 1000) ms, by index \(byIndex * 1000) ms")
+        XCTAssertGreaterThanOrEqual(byName / byIndex, RowDecoderTests.speedup)
+    }
+
+    func testPerformanceDecodeByName() {
+        measure {
+            XCTAssertEqual(try! decodeByName().count, RowDecoderTests.rowCount)
+        }
+    }
+
+    func testPerformanceRowDecoder() {
+        measure {
+            XCTAssertEqual(try! Session.rowDecoder.decode(db, sql).count, RowDecoderTests.rowCount)
+        }
+    }
+}
@@ -0,0 +1,130 @@
+//
+//  SessionArchiveTests.swift
+//  NIO1901Tests
+//
+//  Created by LiuJie on 2019/7/12.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import XCTest
+import SQLite
+@testable import TunnelServices
+
+// 分库 sessions.db 转为 sessions.col 后读回；删除先记在 .del 中，超过 compactRatio 才重写
+class SessionArchiveTests: XCTestCase {
+
+    static let rowCount = 20
+    static let taskID = 1
+
+    var store: String!
+    let folder = "SessionArchiveTests"
+
+    override func setUp() {
+        store = NSTemporaryDirectory() + "SessionArchiveTests-\(UUID().uuidString)/"
+        MitmService.storeFolder = store
+        try! FileManager.default.createDirectory(atPath: store + folder, withIntermediateDirectories: true, attributes: nil)
+        let db = try! Connection(SessionStore.path(folder))
+        let columns = Session.bindings.map { "\"\($0.column)\" \($0.kind.declaredDatatype)\($0.column == "id" ? " PRIMARY KEY" : "")" }
+        try! db.run("CREATE TABLE \"\(Session.nameOfTable)\" (\(columns.joined(separator: ", ")))")
+        let insert = try! db.prepare("INSERT INTO \"\(Session.nameOfTable)\" VALUES (\(Session.bindings.map { _ in "?" }.joined(separator: ", ")))")
+        for i in 1...SessionArchiveTests.rowCount {
+            let session = Session()
+            session.id = NSNumber(value: i)
+            session.taskID = NSNumber(value: SessionArchiveTests.taskID)
+            session.host = i % 2 == 0 ? "a.example.com" : "b.example.com"
+            session.startTime = NSNumber(value: 1_560_000_000.25 + Double(i))
+            session.uploadTraffic = NSNumber(value: i * 10)
+            session.sstate = i % 5 == 0 ? "failure" : "success"
+            session.fileFolder = folder
+            try! insert.run(Session.bindings.map { $0.encode(session) })
+        }
+    }
+
+    override func tearDown() {
+        try? FileManager.default.removeItem(atPath: store)
+        MitmService.storeFolder = ""
+    }
+
+    private var tombstones: String {
+        return SessionArchive.path(folder) + SessionArchive.tombstoneSuffix
+    }
+
+    private func remove(_ ids: ClosedRange<Int64>) -> [Int] {
+        let db = try! Connection(.inMemory)
+        let rows = SessionArchive.remove(db, taskID: SessionArchiveTests.taskID, folder: folder) { reader in
+            reader.numbers("id").map { $0.map { ids.contains($0) } ?? false }
+        }
+        return rows.map { $0.id }.sorted()
+    }
+
+    func testWriteRead() {
+        XCTAssertTrue(SessionArchive.archive(taskID: SessionArchiveTests.taskID, folder: folder))
+        XCTAssertNotEqual(access(SessionStore.path(folder), F_OK), 0)
+        guard let reader = SessionArchive.Reader(path: SessionArchive.path(folder)) else { return XCTFail("no archive") }
+        XCTAssertEqual(reader.rows, SessionArchiveTests.rowCount)
+        XCTAssertEqual(reader.count, SessionArchiveTests.rowCount)
+        XCTAssertEqual(reader.numbers("id"), (1...SessionArchiveTests.rowCount).map { Int64($0) })
+        XCTAssertEqual(reader.doubles("startTime").first!!, 1_560_000_001.25, accuracy: 0.000_001)
+        XCTAssertEqual(reader.strings("host")[1], "a.example.com")
+        XCTAssertEqual(reader.value("uploadTraffic", 2) as? Double, 30)
+        let sessions = reader.sessions(reader.rows(ids: [3, 4]))
+        XCTAssertEqual(sessions.map { $0.id?.intValue ?? 0 }, [3, 4])
+        XCTAssertEqual(sessions.map { $0.host ?? "" }, ["b.example.com", "a.example.com"])
+        // 按 (startTime, id) 倒序
+        XCTAssertEqual(reader.select(keyWord: nil, params: nil, before: Date().timeIntervalSince1970), Array((0..<SessionArchiveTests.rowCount).reversed()))
+        XCTAssertEqual(reader.groupBy("host"), [["a.example.com": "10"], ["b.example.com": "10"]])
+        let stats = reader.stats()
+        XCTAssertEqual(stats.count, SessionArchiveTests.rowCount)
+        XCTAssertEqual(stats.upload, Int64((1...SessionArchiveTests.rowCount).reduce(0, +) * 10))
+        XCTAssertEqual(stats.errors, 4)
+    }
+
+    func testRemoveRecordsTombstones() {
+        XCTAssertTrue(SessionArchive.archive(taskID: SessionArchiveTests.taskID, folder: folder))
+        var st = stat()
+        stat(SessionArchive.path(folder), &st)
+        let inode = st.st_ino
+        XCTAssertEqual(remove(1...2), [1, 2])
+        // 没有重写存档
+        stat(SessionArchive.path(folder), &st)
+        XCTAssertEqual(st.st_ino, inode)
+        XCTAssertEqual(access(tombstones, F_OK), 0)
+        guard let reader = SessionArchive.reader(folder: folder) else { return XCTFail("no archive") }
+        XCTAssertEqual(reader.rows, SessionArchiveTests.rowCount)
+        XCTAssertEqual(reader.count, SessionArchiveTests.rowCount - 2)
+        XCTAssertTrue(reader.isDeleted(0))
+        XCTAssertFalse(reader.select(keyWord: nil, params: nil, before: Date().timeIntervalSince1970).contains(0))
+        XCTAssertEqual(reader.rows(ids: [1, 2, 3]), [2])
+        XCTAssertEqual(reader.stats().count, SessionArchiveTests.rowCount - 2)
+        XCTAssertEqual(reader.groupBy("host"), [["a.example.com": "9"], ["b.example.com": "9"]])
+        // 已删除的行不再返回；缓存的 Reader 按 .del 的大小重新加载
+        XCTAssertEqual(remove(1...3), [3])
+        XCTAssertEqual(SessionArchive.reader(folder: folder)?.count, SessionArchiveTests.rowCount - 3)
+    }
+
+    func testRemoveCompactsPastThreshold() {
+        XCTAssertTrue(SessionArchive.archive(taskID: SessionArchiveTests.taskID, folder: folder))
+        XCTAssertEqual(remove(1...2), [1, 2])
+        // 2 + 4 行，超过 compactRatio
+        XCTAssertEqual(remove(1...6), [3, 4, 5, 6])
+        XCTAssertNotEqual(access(tombstones, F_OK), 0)
+        guard let reader = SessionArchive.reader(folder: folder) else { return XCTFail("no archive") }
+        XCTAssertEqual(reader.rows, SessionArchiveTests.rowCount - 6)
+        XCTAssertEqual(reader.count, reader.rows)
+        XCTAssertEqual(reader.numbers("id"), (7...SessionArchiveTests.rowCount).map { Int64($0) })
+    }
+
+    // 重写中断在 rename 之后：新存档中没有 .del 里的 id
+    func testStaleTombstonesMaskNothing() throws {
+        XCTAssertTrue(SessionArchive.archive(taskID: SessionArchiveTests.taskID, folder: folder))
+        XCTAssertEqual(remove(1...6), [1, 2, 3, 4, 5, 6])
+        var stale = [UInt8]()
+        for id in Int64(1)...6 {
+            var value = id.littleEndian
+            stale.append(contentsOf: withUnsafeBytes(of: &value) { Array($0) })
+        }
+        try Data(stale).write(to: URL(fileURLWithPath: tombstones))
+        let reader = SessionArchive.Reader(path: SessionArchive.path(folder))
+        XCTAssertEqual(reader?.count, SessionArchiveTests.rowCount - 6)
+    }
+}
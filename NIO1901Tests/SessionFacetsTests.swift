@@ -0,0 +1,67 @@
+//
+//  SessionFacetsTests.swift
+//  NIO1901Tests
+//
+//  Created by LiuJie on 2019/7/12.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import XCTest
+import SQLite
+@testable import TunnelServices
+
+// 筛选面板的分类计数；与 TaskStats 一样依赖写入连接上的 recursive_triggers
+class SessionFacetsTests: XCTestCase {
+
+    var path: String!
+
+    override func setUp() {
+        path = NSTemporaryDirectory() + "SessionFacetsTests-\(UUID().uuidString).sqlite"
+        let db = try! Connection(path)
+        let columns = Session.bindings.map { "\"\($0.column)\" \($0.kind.declaredDatatype)\($0.column == "id" ? " PRIMARY KEY" : "")" }
+        try! db.run("CREATE TABLE \"\(Session.nameOfTable)\" (\(columns.joined(separator: ", ")))")
+        try! db.run("CREATE TABLE \"\(Task.nameOfTable)\" (id INTEGER PRIMARY KEY)")
+    }
+
+    override func tearDown() {
+        try? FileManager.default.removeItem(atPath: path)
+    }
+
+    private func replace(_ db: Connection, id: Int, host: String) throws {
+        let session = Session()
+        session.id = NSNumber(value: id)
+        session.taskID = 1
+        session.host = host
+        session.methods = "GET"
+        let names = Session.bindings.map { "\"\($0.column)\"" }.joined(separator: ", ")
+        let values = Session.bindings.map { _ in "?" }.joined(separator: ", ")
+        try db.run("INSERT OR REPLACE INTO \"\(Session.nameOfTable)\" (\(names)) VALUES (\(values))", Session.bindings.map { $0.encode(session) })
+    }
+
+    private func count(_ db: Connection, _ facet: String, _ value: String) -> Int64 {
+        let sql = "SELECT count FROM \(SessionFacets.tableName) WHERE taskID = 1 AND facet = ? AND value = ?"
+        return ((try? db.scalar(sql, facet, value)) as? Int64) ?? 0
+    }
+
+    // 第二个连接上 prepare 也要打开 recursive_triggers，同一会话保存两次只计一次
+    func testReplaceTwiceCountsOnce() throws {
+        XCTAssertTrue(SessionFacets.prepare(try Connection(path)))
+        let db = try Connection(path)
+        XCTAssertTrue(SessionFacets.prepare(db))
+        try replace(db, id: 1, host: "a.example.com")
+        try replace(db, id: 1, host: "a.example.com")
+        XCTAssertEqual(count(db, "host", "a.example.com"), 1)
+        XCTAssertEqual(count(db, "methods", "GET"), 1)
+
+        // 取值改变时旧值减一
+        try replace(db, id: 1, host: "b.example.com")
+        try replace(db, id: 2, host: "b.example.com")
+        XCTAssertEqual(count(db, "host", "a.example.com"), 0)
+        XCTAssertEqual(count(db, "host", "b.example.com"), 2)
+        XCTAssertEqual(count(db, "methods", "GET"), 2)
+
+        try db.run("DELETE FROM \"\(Session.nameOfTable)\" WHERE id = 1")
+        XCTAssertEqual(count(db, "host", "b.example.com"), 1)
+        XCTAssertEqual(count(db, "methods", "GET"), 1)
+    }
+}
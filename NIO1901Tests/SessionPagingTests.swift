@@ -0,0 +1,98 @@
+//
+//  SessionPagingTests.swift
+//  NIO1901Tests
+//
+//  Created by LiuJie on 2019/7/12.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import XCTest
+import SQLite
+@testable import TunnelServices
+
+// 会话列表分页：LIMIT/OFFSET 与 (startTime, id) 游标的结果和耗时对比
+// 只用到 getSQL 拼出的 select Session.id，内存库中建一张最小的 Session 表和相同的索引
+class SessionPagingTests: XCTestCase {
+
+    static let rowCount = 1_000_000
+    static let pageSize = 50
+    static let deepPage = 9_000     // taskID = 1 的会话共 500000 条
+
+    // 100 万行只建一次，各用例共用（只读）
+    static var shared: Connection?
+    var db: Connection!
+
+    override class func setUp() {
+        let db = try! Connection(.inMemory)
+        try! db.execute("""
+            create table Session (id integer primary key, taskID integer, startTime real);
+            create index session_task_time on Session (taskID, startTime, id);
+            """)
+        try! db.transaction {
+            let insert = try db.prepare("insert into Session (id, taskID, startTime) values (?, ?, ?)")
+            for i in 1...rowCount {
+                // 每 4 条共用一个 startTime，游标需要用 id 区分
+                try insert.run(i, 1 + i % 2, Double(1_560_000_000 + i / 4))
+            }
+        }
+        shared = db
+    }
+
+    override class func tearDown() {
+        shared = nil
+    }
+
+    override func setUp() {
+        db = SessionPagingTests.shared
+    }
+
+    override func tearDown() {
+        db = nil
+    }
+
+    private func ids(pageIndex: Int, cursor: SessionCursor?) -> [Int] {
+        let sql = Session.getSQL(taskID: "1", keyWord: nil, params: nil, pageSize: SessionPagingTests.pageSize, pageIndex: pageIndex,
+                                 orderBy: nil, timeInterval: 2_000_000_000, isCount: true, cursor: cursor, db: db)
+        return try! db.prepare(sql).compactMap { ($0[0] as? Int64).map { Int($0) } }
+    }
+
+    private func startTime(_ id: Int) -> Double {
+        return try! db.scalar("select startTime from Session where id = \(id)") as! Double
+    }
+
+    func testCursorMatchesOffset() {
+        var cursor: SessionCursor? = nil
+        for page in 0..<20 {
+            let byOffset = ids(pageIndex: page, cursor: nil)
+            let byCursor = ids(pageIndex: 0, cursor: cursor)
+            XCTAssertEqual(byOffset.count, SessionPagingTests.pageSize)
+            XCTAssertEqual(byOffset, byCursor)
+            let last = byCursor.last!
+            cursor = SessionCursor(startTime: startTime(last), id: last)
+        }
+    }
+
+    func testCursorUsesIndex() {
+        let cursor = SessionCursor(startTime: 1_560_010_000, id: 40_000)
+        let sql = Session.getSQL(taskID: "1", keyWord: nil, params: nil, pageSize: 50, orderBy: nil,
+                                 timeInterval: 2_000_000_000, isCount: true, cursor: cursor, db: db)
+        let plan = try! db.prepare("explain query plan \(sql)").map { ($0[3] as? String) ?? "" }.joined(separator: "\n")
+        XCTAssertTrue(plan.contains("session_task_time"), plan)
+        XCTAssertFalse(plan.contains("TEMP B-TREE"), plan)
+    }
+
+    func testPerformanceOffsetPaging() {
+        measure {
+            XCTAssertEqual(ids(pageIndex: SessionPagingTests.deepPage, cursor: nil).count, SessionPagingTests.pageSize)
+        }
+    }
+
+    func testPerformanceCursorPaging() {
+        // 与 OFFSET 用例取同一页
+        let previous = ids(pageIndex: SessionPagingTests.deepPage - 1, cursor: nil).last!
+        let cursor = SessionCursor(startTime: startTime(previous), id: previous)
+        measure {
+            XCTAssertEqual(ids(pageIndex: 0, cursor: cursor).count, SessionPagingTests.pageSize)
+        }
+    }
+}
@@ -0,0 +1,114 @@
+//
+//  SessionSearchTests.swift
+//  NIO1901Tests
+//
+//  Created by LiuJie on 2019/7/12.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import XCTest
+import SQLite
+@testable import TunnelServices
+
+// 关键词搜索：100 万条会话时 FTS5 trigram 索引查第一页应在 50ms 内，对比没有索引时的 like 全表扫描
+// 建 100 万行的索引要几十秒，库文件留在临时目录中，user_version 一致时直接复用
+// 系统 SQLite 不支持 trigram（3.34 以下）时跳过
+class SessionSearchTests: XCTestCase {
+
+    static let rowCount = 1_000_000
+    static let version: Int64 = 1
+    static let path = NSTemporaryDirectory() + "SessionSearchTests-\(rowCount).sqlite"
+    static let pageSize = 50
+    static let goal = 0.05
+
+    static var db: Connection?
+
+    override class func setUp() {
+        do {
+            let db = try Connection(path)
+            if try db.scalar("PRAGMA user_version") as? Int64 != version {
+                try build(db)
+            }
+            self.db = db
+        } catch {
+            print("SessionSearchTests: trigram unavailable, skipped:\(error)")
+        }
+    }
+
+    // checkAvailable 按 schema 缓存，不影响其他用例
+    override class func tearDown() {
+        db = nil
+        SessionSearchIndex.reset(SessionStore.catalog)
+    }
+
+    private static func build(_ db: Connection) throws {
+        try db.execute("""
+            drop table if exists Session;
+            drop table if exists \(SessionSearchIndex.tableName);
+            create table Session (id integer primary key, taskID integer, startTime real, host text, reqLine text, reqHeads text);
+            create index session_task_time on Session (taskID, startTime, id);
+            create virtual table \(SessionSearchIndex.tableName) using fts5(\(SessionSearchIndex.columns.joined(separator: ", ")), tokenize = 'trigram');
+            """)
+        let columns = SessionSearchIndex.columns
+        try db.transaction {
+            let session = try db.prepare("insert into Session values (?, 1, ?, ?, ?, ?)")
+            let search = try db.prepare("insert into \(SessionSearchIndex.tableName)(rowid, \(columns.joined(separator: ", "))) values (?, \(columns.map { _ in "?" }.joined(separator: ", ")))")
+            for i in 1...rowCount {
+                let host = "h\(i % 1000).example.com"
+                let reqLine = "GET /api/v1/items/\(i) HTTP/1.1"
+                let reqHeads = "host: \(host)\nuser-agent: Knot/1.0\nx-request-id: \(i)"
+                try session.run(i, Double(1_560_000_000 + i), host, reqLine, reqHeads)
+                let values: [Binding?] = columns.map { column in
+                    switch column {
+                    case "host": return host
+                    case "reqLine": return reqLine
+                    case "reqHeads": return reqHeads
+                    default: return nil
+                    }
+                }
+                try search.run([Int64(i) as Binding?] + values)
+            }
+        }
+        try db.run("PRAGMA user_version = \(version)")
+    }
+
+    private func search(_ db: Connection, _ keyWord: String) -> [Int64] {
+        let sql = Session.getSQL(taskID: nil, keyWord: keyWord, params: nil, pageSize: SessionSearchTests.pageSize,
+                                 orderBy: nil, timeInterval: 2_000_000_000, isCount: true, db: db)
+        return try! db.prepare(sql).compactMap { $0[0] as? Int64 }
+    }
+
+    // items/12345 只出现在 12345 和 123450...123459 中
+    func testSelectiveKeywordWithinGoal() {
+        guard let db = SessionSearchTests.db else { return }
+        XCTAssertTrue(SessionSearchIndex.checkAvailable(db))
+        XCTAssertEqual(search(db, "items/12345").sorted(), [12345] + (123450...123459).map { Int64($0) })
+        let start = CFAbsoluteTimeGetCurrent()
+        _ = search(db, "items/12345")
+        XCTAssertLessThan(CFAbsoluteTimeGetCurrent() - start, SessionSearchTests.goal)
+    }
+
+    func testPerformanceIndexedSelectiveKeyword() {
+        guard let db = SessionSearchTests.db else { return }
+        measure {
+            XCTAssertEqual(search(db, "items/12345").count, 11)
+        }
+    }
+
+    // h42.example 匹配约 1000 条，按时间取第一页
+    func testPerformanceIndexedCommonKeyword() {
+        guard let db = SessionSearchTests.db else { return }
+        measure {
+            XCTAssertEqual(search(db, "h42.example").count, SessionSearchTests.pageSize)
+        }
+    }
+
+    // 没有索引时的 like 全表扫描，作为对比
+    func testPerformanceLikeScan() {
+        guard let db = SessionSearchTests.db else { return }
+        let sql = "select id from Session where lower(reqLine) like '%items/12345%' or lower(host) like '%items/12345%' order by startTime desc, id desc limit \(SessionSearchTests.pageSize)"
+        measure {
+            XCTAssertEqual(try! db.prepare(sql).map { $0[0] }.count, 11)
+        }
+    }
+}
@@ -0,0 +1,83 @@
+//
+//  StaticFileCacheTests.swift
+//  NIO1901Tests
+//
+//  Created by LiuJie on 2019/7/12.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import XCTest
+import NIO
+@testable import TunnelServices
+
+class StaticFileCacheTests: XCTestCase {
+
+    var group: MultiThreadedEventLoopGroup!
+    var threadPool: NIOThreadPool!
+    var path: String!
+
+    override func setUp() {
+        group = MultiThreadedEventLoopGroup(numberOfThreads: 1)
+        threadPool = NIOThreadPool(numberOfThreads: 2)
+        threadPool.start()
+        path = NSTemporaryDirectory() + "StaticFileCacheTests-\(UUID().uuidString).html"
+        let content = Data((0..<(64 * 1024)).map { UInt8(truncatingIfNeeded: $0) })
+        FileManager.default.createFile(atPath: path, contents: content, attributes: nil)
+    }
+
+    override func tearDown() {
+        try? FileManager.default.removeItem(atPath: path)
+        try? threadPool.syncShutdownGracefully()
+        try? group.syncShutdownGracefully()
+    }
+
+    func testLoadReturnsFileContent() throws {
+        let cache = StaticFileCache(threadPool: threadPool)
+        let eventLoop = group.next()
+        let first = try cache.load(path: path, eventLoop: eventLoop).wait()
+        let second = try cache.load(path: path, eventLoop: eventLoop).wait()
+        let expected = try Data(contentsOf: URL(fileURLWithPath: path))
+        XCTAssertEqual(first?.getBytes(at: 0, length: first?.readableBytes ?? 0).map { Data($0) }, expected)
+        XCTAssertEqual(second?.readableBytes, expected.count)
+    }
+
+    func testLargeFileIsNotCached() throws {
+        let large = NSTemporaryDirectory() + "StaticFileCacheTests-large-\(UUID().uuidString)"
+        FileManager.default.createFile(atPath: large, contents: Data(count: StaticFileCache.maxFileSize + 1), attributes: nil)
+        defer { try? FileManager.default.removeItem(atPath: large) }
+        let cache = StaticFileCache(threadPool: threadPool)
+        XCTAssertNil(try cache.load(path: large, eventLoop: group.next()).wait())
+    }
+
+    func testMissingFileFails() {
+        let cache = StaticFileCache(threadPool: threadPool)
+        XCTAssertThrowsError(try cache.load(path: path + ".missing", eventLoop: group.next()).wait())
+    }
+
+    // 对比：同一个小文件重复请求 1000 次
+    func testPerformanceStaticFileCache() {
+        let cache = StaticFileCache(threadPool: threadPool)
+        let eventLoop = group.next()
+        measure {
+            for _ in 0..<1000 {
+                _ = try? cache.load(path: path, eventLoop: eventLoop).wait()
+            }
+        }
+    }
+
+    func testPerformanceNonBlockingFileIO() {
+        let fileIO = NonBlockingFileIO(threadPool: threadPool)
+        let allocator = ByteBufferAllocator()
+        let eventLoop = group.next()
+        measure {
+            for _ in 0..<1000 {
+                let buffer = fileIO.openFile(path: path, eventLoop: eventLoop).flatMap { (handle, region) -> EventLoopFuture<ByteBuffer> in
+                    fileIO.read(fileRegion: region, allocator: allocator, eventLoop: eventLoop).always { _ in
+                        try? handle.close()
+                    }
+                }
+                _ = try? buffer.wait()
+            }
+        }
+    }
+}
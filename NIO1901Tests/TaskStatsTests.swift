@@ -0,0 +1,63 @@
+//
+//  TaskStatsTests.swift
+//  NIO1901Tests
+//
+//  Created by LiuJie on 2019/7/12.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import XCTest
+import SQLite
+@testable import TunnelServices
+
+// 触发器维护的会话统计；SessionWriter 用 insert or replace 写入，recursive_triggers 要在写入的连接上打开
+class TaskStatsTests: XCTestCase {
+
+    var path: String!
+
+    override func setUp() {
+        path = NSTemporaryDirectory() + "TaskStatsTests-\(UUID().uuidString).sqlite"
+        let db = try! Connection(path)
+        let columns = Session.bindings.map { "\"\($0.column)\" \($0.kind.declaredDatatype)\($0.column == "id" ? " PRIMARY KEY" : "")" }
+        try! db.run("CREATE TABLE \"\(Session.nameOfTable)\" (\(columns.joined(separator: ", ")))")
+        try! db.run("CREATE TABLE \"\(Task.nameOfTable)\" (id INTEGER PRIMARY KEY)")
+    }
+
+    override func tearDown() {
+        try? FileManager.default.removeItem(atPath: path)
+    }
+
+    private func replace(_ db: Connection, id: Int, upload: Int, state: String) throws {
+        let session = Session()
+        session.id = NSNumber(value: id)
+        session.taskID = 1
+        session.uploadTraffic = NSNumber(value: upload)
+        session.sstate = state
+        let names = Session.bindings.map { "\"\($0.column)\"" }.joined(separator: ", ")
+        let values = Session.bindings.map { _ in "?" }.joined(separator: ", ")
+        try db.run("INSERT OR REPLACE INTO \"\(Session.nameOfTable)\" (\(names)) VALUES (\(values))", Session.bindings.map { $0.encode(session) })
+    }
+
+    private func stat(_ db: Connection, _ column: String) -> Int64? {
+        return (try? db.scalar("SELECT \(column) FROM \(TaskStats.tableName) WHERE taskID = 1")) as? Int64
+    }
+
+    // 第二个连接上 prepare 也要打开 recursive_triggers，同一会话保存两次只计一次
+    func testReplaceTwiceCountsOnce() throws {
+        XCTAssertTrue(TaskStats.prepare(try Connection(path)))
+        let db = try Connection(path)
+        XCTAssertTrue(TaskStats.prepare(db))
+        try replace(db, id: 1, upload: 10, state: "success")
+        try replace(db, id: 1, upload: 30, state: "failure")
+        XCTAssertEqual(stat(db, "sessionCount"), 1)
+        XCTAssertEqual(stat(db, "uploadTraffic"), 30)
+        XCTAssertEqual(stat(db, "errorCount"), 1)
+
+        try replace(db, id: 2, upload: 5, state: "success")
+        XCTAssertEqual(stat(db, "sessionCount"), 2)
+        try db.run("DELETE FROM \"\(Session.nameOfTable)\" WHERE id = 1")
+        XCTAssertEqual(stat(db, "sessionCount"), 1)
+        XCTAssertEqual(stat(db, "uploadTraffic"), 5)
+        XCTAssertEqual(stat(db, "errorCount"), 0)
+    }
+}
@@ -0,0 +1,97 @@
+//
+//  URLRegexMatcherTests.swift
+//  NIO1901Tests
+//
+//  Created by LiuJie on 2019/7/12.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import XCTest
+@testable import TunnelServices
+
+class URLRegexMatcherTests: XCTestCase {
+
+    private func item(_ pattern: String, _ index: Int) -> RuleItem {
+        let item = RuleItem()
+        item.matchRule = .URLREGEX
+        item.value = pattern
+        item.index = index
+        return item
+    }
+
+    func testLiteralPrefix() {
+        let l = URLRegexMatcher.literals(of: "https://www\\.google\\.com/.*")
+        XCTAssertEqual(l.prefix, "https://www.google.com/")
+        XCTAssertEqual(l.literal, "https://www.google.com/")
+        // 开头的 ^ 不影响前缀
+        XCTAssertEqual(URLRegexMatcher.literals(of: "^http://.*").prefix, "http://")
+    }
+
+    func testLongestLiteral() {
+        let l = URLRegexMatcher.literals(of: "^http://.*\\.apple\\.com/x")
+        XCTAssertEqual(l.prefix, "http://")
+        XCTAssertEqual(l.literal, ".apple.com/x")
+    }
+
+    func testOptionalCharacterIsDropped() {
+        // ? * {n} 作用于前一个字符，这个字符不能算进字面量
+        XCTAssertEqual(URLRegexMatcher.literals(of: "https?://a").prefix, "http")
+        XCTAssertEqual(URLRegexMatcher.literals(of: "ab*cdef").prefix, "a")
+        XCTAssertEqual(URLRegexMatcher.literals(of: "ab*cdef").literal, "cdef")
+        XCTAssertEqual(URLRegexMatcher.literals(of: "ab{2}cd").prefix, "a")
+    }
+
+    func testNoPrefix() {
+        XCTAssertEqual(URLRegexMatcher.literals(of: "[a-z]+\\.example\\.com").prefix, "")
+        XCTAssertEqual(URLRegexMatcher.literals(of: "[a-z]+\\.example\\.com").literal, ".example.com")
+        XCTAssertEqual(URLRegexMatcher.literals(of: "\\d+abc").prefix, "")
+        XCTAssertEqual(URLRegexMatcher.literals(of: "\\d+abc").literal, "abc")
+    }
+
+    func testGroupsAndAlternation() {
+        // 顶层 | 和内联选项不做过滤
+        XCTAssertEqual(URLRegexMatcher.literals(of: "abc|def").literal, "")
+        XCTAssertEqual(URLRegexMatcher.literals(of: "(?i)abc").prefix, "")
+        // 分组内的 | 不影响分组外的字面量
+        let l = URLRegexMatcher.literals(of: "host(a|b)+/path/x")
+        XCTAssertEqual(l.prefix, "host")
+        XCTAssertEqual(l.literal, "/path/x")
+    }
+
+    // 带参数的转义连同参数一起跳过，参数里的数字、字母不能成为必须出现的字面量
+    func testEscapePayloadIsNotLiteral() {
+        XCTAssertEqual(URLRegexMatcher.literals(of: "ab\\x41cd").prefix, "ab")
+        XCTAssertEqual(URLRegexMatcher.literals(of: "ab\\x41cd").literal, "ab")
+        XCTAssertEqual(URLRegexMatcher.literals(of: "\\x{263a}xyz").literal, "xyz")
+        XCTAssertEqual(URLRegexMatcher.literals(of: "a\\u0041bcd").literal, "bcd")
+        XCTAssertEqual(URLRegexMatcher.literals(of: "a\\0101bcd").literal, "bcd")
+        XCTAssertEqual(URLRegexMatcher.literals(of: "a\\cMbcd").literal, "bcd")
+        XCTAssertEqual(URLRegexMatcher.literals(of: "a\\p{L}bcd").literal, "bcd")
+        XCTAssertEqual(URLRegexMatcher.literals(of: "(a)\\1234").literal, "")
+        XCTAssertEqual(URLRegexMatcher.literals(of: "\\Qa.b\\E").literal, "")
+        let patterns = ["^/api/\\x41pi/v1", "^/a\\u0042c/.*", "^/\\0101x/.*", "^/k\\cIv"]
+        let matcher = URLRegexMatcher(items: patterns.enumerated().map { item($0.element, $0.offset) })
+        XCTAssertEqual(matcher.firstMatch(["/api/Api/v1"]), 0)
+        XCTAssertEqual(matcher.firstMatch(["/aBc/x"]), 1)
+        XCTAssertEqual(matcher.firstMatch(["/Ax/y"]), 2)
+        XCTAssertEqual(matcher.firstMatch(["/k\tv"]), 3)
+    }
+
+    func testFirstMatchAgreesWithRegex() {
+        let patterns = ["https://www\\.google\\.com/.*",
+                        "^http://.*\\.apple\\.com/x",
+                        "https?://[a-z]+\\.example\\.com/.*",
+                        "host(a|b)+/path/x"]
+        let matcher = URLRegexMatcher(items: patterns.enumerated().map { item($0.element, $0.offset) })
+        XCTAssertEqual(matcher.entries.count, patterns.count)
+        XCTAssertEqual(matcher.firstMatch(["https://www.google.com/search"]), 0)
+        XCTAssertEqual(matcher.firstMatch(["http://img.apple.com/x"]), 1)
+        XCTAssertEqual(matcher.firstMatch(["http://cdn.example.com/a.js"]), 2)
+        XCTAssertEqual(matcher.firstMatch(["hostabba/path/x"]), 3)
+        // 整串匹配：多出来的后缀不算命中
+        XCTAssertNil(matcher.firstMatch(["http://img.apple.com/xy"]))
+        XCTAssertNil(matcher.firstMatch(["https://www.google.cn/"]))
+        // 多个候选串时任一命中即可
+        XCTAssertEqual(matcher.firstMatch(["www.google.com", "https://www.google.com/"]), 0)
+    }
+}
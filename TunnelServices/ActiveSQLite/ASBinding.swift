@@ -0,0 +1,159 @@
+//
+//  ASBinding.swift
+//  ActiveSQLite
+//
+//  Created by LiuJie on 2019/7/6.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import SQLite
+import SQLite3
+
+//MARK: - Bindings
+// A typed column table written next to the model, one entry per persisted property.
+// It must list the same columns as recursionProperties() (names, optionality, doubleTypes()).
+// When a model has one, save and load call these closures instead of walking Mirror and KVC.
+
+public protocol ASBindingProtocol {
+    static var bindings:[ASBinding] { get }
+}
+
+public struct ASBinding {
+    let column:String
+    let kind:ASColumnKind
+    let encode:(ASModel) -> Binding?
+    let setter:(ASModel) -> Setter
+    let decodeRow:(ASModel, Row) throws -> Void
+    // NULL leaves the default value, like RowDecoder
+    let decodeStatement:(ASModel, OpaquePointer, Int32) -> Void
+    // Values read outside SQLite (String, Int64, Double, Blob)
+    let assign:(ASModel, Binding) -> Void
+}
+
+public extension ASBinding {
+
+    static func string<M:ASModel>(_ column:String, _ key:ReferenceWritableKeyPath<M,String>) -> ASBinding {
+        return ASBinding(column: column, kind: .string,
+                         encode: { cast(M.self, $0)[keyPath: key] },
+                         setter: { Expression<String>(column) <- cast(M.self, $0)[keyPath: key] },
+                         decodeRow: { cast(M.self, $0)[keyPath: key] = try $1.get(Expression<String>(column)) },
+                         decodeStatement: { m, s, i in if let v = columnText(s, i) { cast(M.self, m)[keyPath: key] = v } },
+                         assign: { m, v in if let v = v as? String { cast(M.self, m)[keyPath: key] = v } })
+    }
+
+    static func string<M:ASModel>(_ column:String, _ key:ReferenceWritableKeyPath<M,String?>) -> ASBinding {
+        return ASBinding(column: column, kind: .stringOptional,
+                         encode: { cast(M.self, $0)[keyPath: key] },
+                         setter: { Expression<String?>(column) <- cast(M.self, $0)[keyPath: key] },
+                         decodeRow: { cast(M.self, $0)[keyPath: key] = try $1.get(Expression<String?>(column)) },
+                         decodeStatement: { m, s, i in if let v = columnText(s, i) { cast(M.self, m)[keyPath: key] = v } },
+                         assign: { m, v in if let v = v as? String { cast(M.self, m)[keyPath: key] = v } })
+    }
+
+    static func number<M:ASModel>(_ column:String, _ key:ReferenceWritableKeyPath<M,NSNumber>) -> ASBinding {
+        return ASBinding(column: column, kind: .number,
+                         encode: { cast(M.self, $0)[keyPath: key].datatypeValue },
+                         setter: { Expression<NSNumber>(column) <- cast(M.self, $0)[keyPath: key] },
+                         decodeRow: { cast(M.self, $0)[keyPath: key] = try $1.get(Expression<NSNumber>(column)) },
+                         decodeStatement: { m, s, i in if let v = columnNumber(s, i) { cast(M.self, m)[keyPath: key] = v } },
+                         assign: { m, v in if let v = bindingNumber(v) { cast(M.self, m)[keyPath: key] = v } })
+    }
+
+    static func number<M:ASModel>(_ column:String, _ key:ReferenceWritableKeyPath<M,NSNumber?>) -> ASBinding {
+        return ASBinding(column: column, kind: .numberOptional,
+                         encode: { cast(M.self, $0)[keyPath: key]?.datatypeValue },
+                         setter: { Expression<NSNumber?>(column) <- cast(M.self, $0)[keyPath: key] },
+                         decodeRow: { cast(M.self, $0)[keyPath: key] = try $1.get(Expression<NSNumber?>(column)) },
+                         decodeStatement: { m, s, i in if let v = columnNumber(s, i) { cast(M.self, m)[keyPath: key] = v } },
+                         assign: { m, v in if let v = bindingNumber(v) { cast(M.self, m)[keyPath: key] = v } })
+    }
+
+    // doubleTypes() columns
+    static func double<M:ASModel>(_ column:String, _ key:ReferenceWritableKeyPath<M,NSNumber>) -> ASBinding {
+        return ASBinding(column: column, kind: .double,
+                         encode: { cast(M.self, $0)[keyPath: key].doubleValue },
+                         setter: { Expression<Double>(column) <- cast(M.self, $0)[keyPath: key].doubleValue },
+                         decodeRow: { cast(M.self, $0)[keyPath: key] = NSNumber(value: try $1.get(Expression<Double>(column))) },
+                         decodeStatement: { m, s, i in if let v = columnDouble(s, i) { cast(M.self, m)[keyPath: key] = v } },
+                         assign: { m, v in if let v = bindingDouble(v) { cast(M.self, m)[keyPath: key] = v } })
+    }
+
+    static func double<M:ASModel>(_ column:String, _ key:ReferenceWritableKeyPath<M,NSNumber?>) -> ASBinding {
+        return ASBinding(column: column, kind: .doubleOptional,
+                         encode: { cast(M.self, $0)[keyPath: key]?.doubleValue },
+                         setter: { Expression<Double?>(column) <- cast(M.self, $0)[keyPath: key]?.doubleValue },
+                         decodeRow: { m, row in
+                            if let v = try row.get(Expression<Double?>(column)) {
+                                cast(M.self, m)[keyPath: key] = NSNumber(value: v)
+                            } },
+                         decodeStatement: { m, s, i in if let v = columnDouble(s, i) { cast(M.self, m)[keyPath: key] = v } },
+                         assign: { m, v in if let v = bindingDouble(v) { cast(M.self, m)[keyPath: key] = v } })
+    }
+
+    static func data<M:ASModel>(_ column:String, _ key:ReferenceWritableKeyPath<M,Data?>) -> ASBinding {
+        return ASBinding(column: column, kind: .data,
+                         encode: { cast(M.self, $0)[keyPath: key]?.datatypeValue },
+                         setter: { Expression<Data?>(column) <- cast(M.self, $0)[keyPath: key] },
+                         decodeRow: { cast(M.self, $0)[keyPath: key] = try $1.get(Expression<Data?>(column)) },
+                         decodeStatement: { m, s, i in if let v = columnData(s, i) { cast(M.self, m)[keyPath: key] = v } },
+                         assign: { m, v in if let v = v as? Blob { cast(M.self, m)[keyPath: key] = Data.fromDatatypeValue(v) } })
+    }
+}
+
+// The table belongs to M, so the cast never fails.
+@inline(__always)
+private func cast<M:ASModel>(_ type:M.Type, _ model:ASModel) -> M {
+    return unsafeDowncast(model, to: type)
+}
+
+private func bindingNumber(_ value:Binding) -> NSNumber? {
+    switch value {
+    case let v as Int64: return NSNumber(value: v)
+    case let v as Double: return NSNumber(value: v)
+    default: return nil
+    }
+}
+
+private func bindingDouble(_ value:Binding) -> NSNumber? {
+    switch value {
+    case let v as Double: return NSNumber(value: v)
+    case let v as Int64: return NSNumber(value: Double(v))
+    default: return nil
+    }
+}
+
+private func columnText(_ statement:OpaquePointer, _ i:Int32) -> String? {
+    guard sqlite3_column_type(statement, i) == SQLITE_TEXT, let text = sqlite3_column_text(statement, i) else { return nil }
+    let count = Int(sqlite3_column_bytes(statement, i))
+    return String(decoding: UnsafeBufferPointer(start: text, count: count), as: UTF8.self)
+}
+
+private func columnNumber(_ statement:OpaquePointer, _ i:Int32) -> NSNumber? {
+    switch sqlite3_column_type(statement, i) {
+    case SQLITE_INTEGER: return NSNumber(value: sqlite3_column_int64(statement, i))
+    case SQLITE_FLOAT: return NSNumber(value: sqlite3_column_double(statement, i))
+    default: return nil
+    }
+}
+
+private func columnDouble(_ statement:OpaquePointer, _ i:Int32) -> NSNumber? {
+    guard sqlite3_column_type(statement, i) != SQLITE_NULL else { return nil }
+    return NSNumber(value: sqlite3_column_double(statement, i))
+}
+
+private func columnData(_ statement:OpaquePointer, _ i:Int32) -> Data? {
+    guard sqlite3_column_type(statement, i) == SQLITE_BLOB else { return nil }
+    let count = Int(sqlite3_column_bytes(statement, i))
+    guard count > 0, let bytes = sqlite3_column_blob(statement, i) else { return Data() }
+    return Data(bytes: bytes, count: count)
+}
+
+public extension ASProtocol where Self:ASModel{
+
+    // Timestamp columns are reflection-only, such models keep the Mirror path.
+    internal func modelBindings() -> [ASBinding]? {
+        guard !type(of: self).isSaveDefaulttimestamp, let model = type(of: self) as? ASBindingProtocol.Type else { return nil }
+        return model.bindings
+    }
+}
@@ -0,0 +1,119 @@
+//
+//  ASCheckpointer.swift
+//  ActiveSQLite
+//
+//  Created by LiuJie on 2019/7/5.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import SQLite
+import SQLite3
+
+// 后台 checkpoint 线程，使用独立连接，不占用写连接
+// WAL 超过 passiveThreshold 时执行 PASSIVE（不等待读写）；超过 truncateThreshold 时尝试 TRUNCATE 收缩 WAL 文件
+// 连接不设 busyTimeout，有读者或写者时 TRUNCATE 直接放弃，下一轮再试，不会阻塞抓包写入
+// 写连接 ATTACH 的其他库（wal_autocheckpoint 对整个连接生效）用 watch 加入，同样处理
+final class ASCheckpointer {
+
+    let walPath:String
+    let interval:TimeInterval
+    let passiveThreshold:Int64
+    let truncateThreshold:Int64
+
+    private let db:Connection
+    private let semaphore = DispatchSemaphore(value: 0)
+    private let lock = NSLock()
+    private var stopped = false
+    private var watched = [String:Connection]()     // 数据库路径 -> 连接
+
+    init?(path:String, interval:TimeInterval = 1, passiveThreshold:Int64 = 4 * 1024 * 1024, truncateThreshold:Int64 = 64 * 1024 * 1024) {
+        do{
+            db = try Connection(path)
+        }catch{
+            Log.e("open checkpointer connection failure: \(error)")
+            return nil
+        }
+        walPath = path + "-wal"
+        self.interval = interval
+        self.passiveThreshold = passiveThreshold
+        self.truncateThreshold = truncateThreshold
+    }
+
+    func start(){
+        let thread = Thread { [weak self] in self?.run() }
+        thread.name = "ActiveSQLite.Checkpointer"
+        thread.qualityOfService = .utility
+        thread.start()
+    }
+
+    // 停止前做一次 PASSIVE
+    func stop(){
+        lock.lock()
+        stopped = true
+        lock.unlock()
+        semaphore.signal()
+    }
+
+    func watch(_ path:String){
+        lock.lock()
+        defer { lock.unlock() }
+        if watched[path] != nil { return }
+        do{
+            watched[path] = try Connection(path)
+        }catch{
+            Log.e("open checkpointer connection failure: \(error)")
+        }
+    }
+
+    // 删除数据库文件前调用
+    func unwatch(_ path:String){
+        lock.lock()
+        watched[path] = nil
+        lock.unlock()
+    }
+
+    private var isStopped:Bool {
+        lock.lock()
+        defer { lock.unlock() }
+        return stopped
+    }
+
+    private func run(){
+        while !isStopped {
+            _ = semaphore.wait(timeout: .now() + interval)
+            check(db, walPath)
+            lock.lock()
+            let list = watched
+            lock.unlock()
+            for (path, connection) in list {
+                check(connection, path + "-wal")
+            }
+        }
+        checkpoint(db, SQLITE_CHECKPOINT_PASSIVE)
+    }
+
+    private func check(_ db:Connection, _ walPath:String){
+        let size = walSize(walPath)
+        if size >= truncateThreshold {
+            checkpoint(db, SQLITE_CHECKPOINT_TRUNCATE)
+        }else if size >= passiveThreshold {
+            checkpoint(db, SQLITE_CHECKPOINT_PASSIVE)
+        }
+    }
+
+    private func walSize(_ walPath:String) -> Int64 {
+        var st = stat()
+        guard stat(walPath, &st) == 0 else { return 0 }
+        return Int64(st.st_size)
+    }
+
+    private func checkpoint(_ db:Connection, _ mode:Int32){
+        var logFrames:Int32 = 0
+        var checkpointed:Int32 = 0
+        let code = sqlite3_wal_checkpoint_v2(db.handle, nil, mode, &logFrames, &checkpointed)
+        if code != SQLITE_OK && code != SQLITE_BUSY {
+            Log.e("wal checkpoint failure: \(code)")
+        }
+    }
+}
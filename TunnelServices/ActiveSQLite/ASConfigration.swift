@@ -17,6 +17,14 @@ open class ASConfigration {
     
     private static var defaultDB:Connection!
     private static var defaultDBName:String?
+    private static var defaultDBPath:String?
+    
+    // 只读连接池，界面查询使用；WAL 模式下读不阻塞写
+    public static var readerCount = 2
+    private static var readers = [Connection]()
+    private static var nextReader = 0
+    private static let readerLock = NSLock()
+    private static var checkpointer:ASCheckpointer?
     
     /// 创建数据库
     ///
@@ -61,9 +69,12 @@ open class ASConfigration {
             do{
                 let db = try Connection(path)
                 db.busyTimeout = 5
+                configure(db, readonly: false)
                 dbMap[name] = db
                 
                 defaultDB = db
+                defaultDBPath = path
+                openReaders(path)
             }catch{
                 Log.e(error)
             }
@@ -81,6 +92,76 @@ open class ASConfigration {
             }
         }
         
+        /// 只读连接，轮流分配；连接池没有打开时返回默认连接
+        public static func getReadDB() throws -> Connection{
+            readerLock.lock()
+            defer { readerLock.unlock() }
+            if readers.isEmpty {
+                return try getDefaultDB()
+            }
+            nextReader = (nextReader + 1) % readers.count
+            return readers[nextReader]
+        }
+        
+        /// 写入进程调用：关闭写连接的自动 checkpoint，由后台线程按 WAL 大小执行
+        public static func startCheckpointer(){
+            guard checkpointer == nil, let path = defaultDBPath, let db = defaultDB else { return }
+            guard let c = ASCheckpointer(path: path) else { return }
+            _ = try? db.run("PRAGMA wal_autocheckpoint = 0")
+            c.start()
+            checkpointer = c
+        }
+        
+        /// 写连接 ATTACH 的其他库也由后台线程 checkpoint；没有启动 checkpointer 时连接自己自动 checkpoint
+        public static func watchCheckpoint(path:String){
+            checkpointer?.watch(path)
+        }
+        
+        public static func unwatchCheckpoint(path:String){
+            checkpointer?.unwatch(path)
+        }
+        
+        public static func stopCheckpointer(){
+            guard let c = checkpointer else { return }
+            c.stop()
+            checkpointer = nil
+            _ = try? defaultDB?.run("PRAGMA wal_autocheckpoint = 1000")
+        }
+        
+        // WAL：读写互不阻塞；synchronous = NORMAL 在 WAL 下只在 checkpoint 时 fsync
+        private static func configure(_ db:Connection, readonly:Bool){
+            do{
+                if !readonly {
+                    _ = try db.scalar("PRAGMA journal_mode = WAL")
+                    try db.run("PRAGMA synchronous = NORMAL")
+                }else{
+                    try db.run("PRAGMA query_only = 1")
+                }
+                try db.run("PRAGMA cache_size = -4096")
+                _ = try db.scalar("PRAGMA mmap_size = 33554432")
+                try db.run("PRAGMA temp_store = MEMORY")
+            }catch{
+                Log.e("configure db failure: \(error)")
+            }
+        }
+        
+        private static func openReaders(_ path:String){
+            var list = [Connection]()
+            for _ in 0..<readerCount {
+                do{
+                    let db = try Connection(path, readonly: true)
+                    db.busyTimeout = 5
+                    configure(db, readonly: true)
+                    list.append(db)
+                }catch{
+                    Log.e(error)
+                }
+            }
+            readerLock.lock()
+            readers = list
+            readerLock.unlock()
+        }
+        
         public static func getDB(name:String) throws -> Connection{
             if let db = dbMap[name]{
                 return db
@@ -0,0 +1,258 @@
+//
+//  ASProtocol+Cache.swift
+//  ActiveSQLite
+//
+//  Created by LiuJie on 2019/7/5.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import SQLite
+
+//MARK: - Cache
+// Columns are reflected once per model type, tables are verified once per connection,
+// and insert/update statements are prepared once per (connection, SQL). The steady-state
+// write path reads values by KVC (or ASBinding closures), then binds, steps and resets a cached statement.
+
+internal enum ASColumnKind {
+    case string, stringOptional
+    case number, numberOptional
+    case double, doubleOptional
+    case date, dateOptional
+    case data
+
+    var declaredDatatype:String {
+        switch self {
+        case .string, .stringOptional: return String.declaredDatatype
+        case .number, .numberOptional: return NSNumber.declaredDatatype
+        case .double, .doubleOptional: return Double.declaredDatatype
+        case .date, .dateOptional: return NSDate.declaredDatatype
+        case .data: return Data.declaredDatatype
+        }
+    }
+}
+
+internal struct ASColumn {
+    let attribute:String
+    let column:String
+    let kind:ASColumnKind
+    let encode:((ASModel) -> Binding?)?     // ASBindingProtocol models only
+}
+
+internal final class ASCache {
+
+    // A connection's cached statements are guarded by their own lock, so writers on different connections don't wait on each other.
+    private final class Statements {
+        let lock = NSLock()
+        var cached = [String:Statement]()
+    }
+
+    private static let lock = NSLock()
+    private static var columns = [ObjectIdentifier:[ASColumn]]()
+    private static var insertSQLs = [String:String]()
+    private static var verifiedTables = [ObjectIdentifier:Set<String>]()
+    private static var statements = [ObjectIdentifier:Statements]()
+
+    private static func connection(_ db:Connection) -> Statements {
+        let key = ObjectIdentifier(db)
+        lock.lock()
+        defer { lock.unlock() }
+        if let existing = statements[key] {
+            return existing
+        }
+        let created = Statements()
+        statements[key] = created
+        return created
+    }
+
+    static func columns(of type:AnyClass, _ build:() -> [ASColumn]) -> [ASColumn] {
+        let key = ObjectIdentifier(type)
+        lock.lock()
+        if let cached = columns[key] {
+            lock.unlock()
+            return cached
+        }
+        lock.unlock()
+        let built = build()
+        lock.lock()
+        columns[key] = built
+        lock.unlock()
+        return built
+    }
+
+    static func insertSQL(_ key:String, _ build:() -> String) -> String {
+        lock.lock()
+        if let cached = insertSQLs[key] {
+            lock.unlock()
+            return cached
+        }
+        lock.unlock()
+        let built = build()
+        lock.lock()
+        insertSQLs[key] = built
+        lock.unlock()
+        return built
+    }
+
+    static func isVerified(_ db:Connection, _ table:String) -> Bool {
+        lock.lock()
+        defer { lock.unlock() }
+        return verifiedTables[ObjectIdentifier(db)]?.contains(table) ?? false
+    }
+
+    // Schema changes (drop, rename, add column) clear the flag and the connection's statements.
+    static func setVerified(_ db:Connection, _ table:String, _ verified:Bool) {
+        let key = ObjectIdentifier(db)
+        lock.lock()
+        if verified {
+            verifiedTables[key, default: []].insert(table)
+        }else{
+            verifiedTables[key]?.remove(table)
+        }
+        lock.unlock()
+        if !verified {
+            let cache = connection(db)
+            cache.lock.lock()
+            cache.cached.removeAll()
+            cache.lock.unlock()
+        }
+    }
+
+    // Runs a cached statement and returns the last rowid and the changed row count.
+    // The savepoint body runs on SQLite.swift's connection queue, which every other statement and transaction on this
+    // connection also goes through, so no other write can land between the step and the two reads. The statement lock
+    // is only taken inside the queue, never around it. Errors are rethrown after the savepoint is released: SQLite.swift
+    // rolls back to a failed savepoint without releasing it, and a failed step has already been undone by SQLite.
+    static func run(_ db:Connection, _ sql:String, _ bindings:[Binding?]) throws -> (rowid:Int64, changes:Int) {
+        let cache = connection(db)
+        var result:(rowid:Int64, changes:Int) = (0, 0)
+        var failure:Error?
+        try db.savepoint("ASCache.run") {
+            cache.lock.lock()
+            defer { cache.lock.unlock() }
+            do {
+                var statement = cache.cached[sql]
+                if statement == nil {
+                    statement = try db.prepare(sql)
+                    cache.cached[sql] = statement
+                }
+                try statement!.run(bindings)
+                result = (db.lastInsertRowid, db.changes)
+            } catch {
+                failure = error
+            }
+        }
+        if let error = failure {
+            throw error
+        }
+        return result
+    }
+}
+
+public extension ASProtocol where Self:ASModel{
+
+    internal func cachedColumns() -> [ASColumn] {
+        return ASCache.columns(of: type(of: self)) {
+            if let bindings = modelBindings() {
+                return bindings.map { ASColumn(attribute: $0.column, column: $0.column, kind: $0.kind, encode: $0.encode) }
+            }
+            return reflectedColumns()
+        }
+    }
+
+    // The Mirror path; a model's bindings must describe the same columns.
+    internal func reflectedColumns() -> [ASColumn] {
+        var list = [ASColumn]()
+        for case let (attribute?,column?, value) in recursionProperties() {
+            let isDouble = doubleTypes().contains(attribute)
+            var kind:ASColumnKind?
+            switch Mirror(reflecting:value).subjectType {
+            case _ as String.Type: kind = .string
+            case _ as String?.Type: kind = .stringOptional
+            case _ as NSNumber.Type: kind = isDouble ? .double : .number
+            case _ as NSNumber?.Type: kind = isDouble ? .doubleOptional : .numberOptional
+            case _ as NSDate.Type: kind = .date
+            case _ as NSDate?.Type: kind = .dateOptional
+            case _ as Data?.Type: kind = .data
+            default: break
+            }
+            if let k = kind {
+                list.append(ASColumn(attribute: attribute, column: column, kind: k, encode: nil))
+            }
+        }
+        return list
+    }
+
+    // Same values as buildSetters(), in cachedColumns() order.
+    internal func cachedBindings() -> [Binding?] {
+        return cachedColumns().map { c -> Binding? in
+            if let encode = c.encode {
+                return encode(self)
+            }
+            let value = self.value(forKey: c.attribute)
+            switch c.kind {
+            case .string: return value as? String ?? ""
+            case .stringOptional: return value as? String
+            case .number: return (value as? NSNumber)?.datatypeValue ?? 0
+            case .numberOptional: return (value as? NSNumber)?.datatypeValue
+            case .double: return (value as? NSNumber)?.doubleValue ?? 0
+            case .doubleOptional: return (value as? NSNumber)?.doubleValue
+            case .date: return (value as? NSDate)?.datatypeValue ?? 0
+            case .dateOptional: return (value as? NSDate)?.datatypeValue
+            case .data: return (value as? Data)?.datatypeValue
+            }
+        }
+    }
+
+    internal func cachedInsertSQL(or onConflict:OnConflict? = nil) -> String {
+        let key = "\(nameOfTable)|\(onConflict?.rawValue ?? "")"
+        return ASCache.insertSQL(key) { buildInsertSQL(or: onConflict) }
+    }
+
+    private func buildInsertSQL(or onConflict:OnConflict?) -> String {
+        let names = cachedColumns().map { "\"\($0.column.replacingOccurrences(of: "\"", with: "\"\""))\"" }
+        let values = Array(repeating: "?", count: names.count)
+        let verb = onConflict == nil ? "INSERT" : "INSERT OR \(onConflict!.rawValue)"
+        return "\(verb) INTO \"\(nameOfTable)\" (\(names.joined(separator: ", "))) VALUES (\(values.joined(separator: ", ")))"
+    }
+
+    // Custom schemas may not have every reflected column, keep them on the setter path.
+    internal var canUseCachedInsert:Bool {
+        return !(self is CreateColumnsProtocol)
+    }
+
+    internal var canUseCachedUpdate:Bool {
+        return canUseCachedInsert
+    }
+
+    internal func runCachedInsert(or onConflict:OnConflict? = nil) throws -> Int64 {
+        return try ASCache.run(getDB(), cachedInsertSQL(or: onConflict), cachedBindings()).rowid
+    }
+
+    // update() by id: every column except the primary key, updated_at only when timestamps are kept.
+    private func updateColumnFilter() -> (ASColumn) -> Bool {
+        let primaryKey = type(of: self).PRIMARY_KEY
+        let updatedAt = type(of: self).isSaveDefaulttimestamp ? nil : type(of: self).UPDATE_AT_KEY
+        return { $0.column != primaryKey && $0.column != updatedAt }
+    }
+
+    internal func cachedUpdateSQL() -> String {
+        let key = "\(nameOfTable)|UPDATE"
+        return ASCache.insertSQL(key) {
+            let quote = { (name:String) -> String in "\"\(name.replacingOccurrences(of: "\"", with: "\"\""))\"" }
+            let sets = cachedColumns().filter(updateColumnFilter()).map { "\(quote($0.column)) = ?" }
+            return "UPDATE \(quote(nameOfTable)) SET \(sets.joined(separator: ", ")) WHERE \(quote(type(of: self).PRIMARY_KEY)) = ?"
+        }
+    }
+
+    // Returns the changed row count, like Connection.run(table.update(...)).
+    internal func runCachedUpdate() throws -> Int {
+        let include = updateColumnFilter()
+        var bindings = [Binding?]()
+        for (column, binding) in zip(cachedColumns(), cachedBindings()) where include(column) {
+            bindings.append(binding)
+        }
+        bindings.append(id!.datatypeValue)
+        return try ASCache.run(getDB(), cachedUpdateSQL(), bindings).changes
+    }
+}
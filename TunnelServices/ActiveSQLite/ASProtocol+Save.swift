@@ -18,10 +18,25 @@ public extension ASProtocol where Self:ASModel{
         do {
             try createTable()
             
-            var settersInsert = buildSetters(skips: [type(of: self).PRIMARY_KEY, type(of: self).CREATE_AT_KEY, type(of: self).UPDATE_AT_KEY])
+            let timeinterval = NSNumber(value:NSDate().timeIntervalSince1970 * 1000)
             
+            //cached statement: bind, step, reset
+            if canUseCachedInsert {
+                if type(of: self).isSaveDefaulttimestamp {
+                    if self.created_at.int64Value <= 0 { self.created_at = timeinterval }
+                    if self.updated_at.int64Value <= 0 { self.updated_at = timeinterval }
+                }
+                let rowid = try runCachedInsert()
+                id = NSNumber(value:rowid)
+                if type(of: self).isSaveDefaulttimestamp {
+                    created_at = timeinterval
+                    updated_at = timeinterval
+                }
+                Log.d("Insert row of \(rowid) into \(nameOfTable) table success ")
+                return
+            }
             
-            let timeinterval = NSNumber(value:NSDate().timeIntervalSince1970 * 1000)
+            var settersInsert = buildSetters(skips: [type(of: self).PRIMARY_KEY, type(of: self).CREATE_AT_KEY, type(of: self).UPDATE_AT_KEY])
             
             if type(of: self).isSaveDefaulttimestamp {
                 
@@ -73,6 +88,16 @@ public extension ASProtocol where Self:ASModel{
                     
                     let timeinterval = NSNumber(value:Int64(NSDate().timeIntervalSince1970 * 1000))
                     
+                    if model.canUseCachedInsert {
+                        if isSaveDefaulttimestamp {
+                            if model.created_at.int64Value <= 0 { model.created_at = timeinterval }
+                            if model.updated_at.int64Value <= 0 { model.updated_at = timeinterval }
+                        }
+                        let rowid = try model.runCachedInsert()
+                        autoInsertValues.append((NSNumber(value:rowid),timeinterval,timeinterval))
+                        continue
+                    }
+                    
                     var settersInsert = model.buildSetters(skips: [PRIMARY_KEY, CREATE_AT_KEY, UPDATE_AT_KEY])
                     
                     if isSaveDefaulttimestamp {
@@ -133,15 +158,27 @@ public extension ASProtocol where Self:ASModel{
             
             let timeinterval = NSNumber(value:NSDate().timeIntervalSince1970 * 1000)
             
-            var settersUpdate = buildSetters(skips: [type(of: self).PRIMARY_KEY, type(of: self).UPDATE_AT_KEY])
-            if type(of: self).isSaveDefaulttimestamp {
-                settersUpdate.append(type(of: self).updated_at <- timeinterval)
+            var rowid = 0
+            //cached statement: bind, step, reset
+            if canUseCachedUpdate {
+                let oldUpdatedAt = updated_at
+                if type(of: self).isSaveDefaulttimestamp {
+                    updated_at = timeinterval
+                }
+                rowid = try runCachedUpdate()
+                if rowid <= 0 {
+                    updated_at = oldUpdatedAt
+                }
+            } else {
+                var settersUpdate = buildSetters(skips: [type(of: self).PRIMARY_KEY, type(of: self).UPDATE_AT_KEY])
+                if type(of: self).isSaveDefaulttimestamp {
+                    settersUpdate.append(type(of: self).updated_at <- timeinterval)
+                }
+                
+                let table = getTable().where(type(of: self).id == id!)
+                rowid = try getDB().run(table.update(settersUpdate))
             }
             
-            
-            let table = getTable().where(type(of: self).id == id!)
-            let rowid = try getDB().run(table.update(settersUpdate))
-            
             if rowid > 0 {
                 if type(of: self).isSaveDefaulttimestamp {
                     updated_at = timeinterval
@@ -215,18 +252,26 @@ public extension ASProtocol where Self:ASModel{
                         continue
                     }
                     
-                    var settersUpdate = model.buildSetters(skips: [PRIMARY_KEY, UPDATE_AT_KEY])
-                    
                     let timeinterval = NSNumber(value:NSDate().timeIntervalSince1970 * 1000)
                     
-                    if isSaveDefaulttimestamp{
-                        settersUpdate.append(updated_at <- timeinterval)
+                    if model.canUseCachedUpdate {
+                        let oldUpdatedAt = model.updated_at
+                        if isSaveDefaulttimestamp {
+                            model.updated_at = timeinterval
+                        }
+                        _ = try model.runCachedUpdate()
+                        model.updated_at = oldUpdatedAt
+                    } else {
+                        var settersUpdate = model.buildSetters(skips: [PRIMARY_KEY, UPDATE_AT_KEY])
+                        
+                        if isSaveDefaulttimestamp{
+                            settersUpdate.append(updated_at <- timeinterval)
+                        }
+                        
+                        let table = model.getTable().where(id == model.id!)
+                        try self.getDB().run(table.update(settersUpdate))
                     }
                     
-                    
-                    let table = model.getTable().where(id == model.id!)
-                    try self.getDB().run(table.update(settersUpdate))
-                    
                     if isSaveDefaulttimestamp{
                         autoUpdateValues.append((timeinterval))
                     }
@@ -331,6 +376,18 @@ public extension ASProtocol where Self:ASModel{
                 created_at_value = created_at
             }
             
+            //cached statement: bind, step, reset
+            if canUseCachedInsert {
+                if type(of: self).isSaveDefaulttimestamp{
+                    created_at = created_at_value
+                    updated_at = updated_at_value
+                }
+                let rowid = try runCachedInsert(or: .replace)
+                id = NSNumber(value:rowid)
+                Log.d("Insert row of \(rowid) into \(nameOfTable) table success ")
+                return
+            }
+            
             var settersInsert = buildSetters(skips: [type(of: self).PRIMARY_KEY, type(of: self).CREATE_AT_KEY, type(of: self).UPDATE_AT_KEY])
             
             if type(of: self).isSaveDefaulttimestamp{
@@ -374,6 +431,9 @@ public extension ASProtocol where Self:ASModel{
     }
     
     internal func buildSetters(skips:[String] = [PRIMARY_KEY])->[Setter]{
+        if let bindings = modelBindings() {
+            return bindings.filter { !skips.contains($0.column) }.map { $0.setter(self) }
+        }
         var setters = [Setter]()
         
         for case let (attribute?,column?, value) in recursionProperties() {
@@ -433,6 +493,9 @@ public extension ASProtocol where Self:ASModel{
                     setters.append(Expression<NSDate?>(column) <- nil)
                 }
                 
+            case _ as Data?.Type:
+                setters.append(Expression<Data?>(column) <- value as? Data)
+                
             default: break
                 
             }
@@ -510,6 +573,9 @@ public extension ASProtocol where Self:ASModel{
                         setters.append(Expression<NSDate?>(column) <- nil)
                     }
                     
+                case _ as Data?.Type:
+                    setters.append(Expression<Data?>(column) <- value as? Data)
+                    
                 default: break
                     
                 }
@@ -19,6 +19,11 @@ public extension ASProtocol where Self:ASModel{
     internal func createTable()throws{
         //        type(of: self).createTable()
         
+        //checked once per connection
+        if let db = try? getDB(), ASCache.isVerified(db, nameOfTable) {
+            return
+        }
+        
         do{
             try getDB().run(getTable().create(ifNotExists: true) { t in
                 
@@ -38,6 +43,7 @@ public extension ASProtocol where Self:ASModel{
                 
             })
             
+            ASCache.setVerified(try getDB(), nameOfTable, true)
             Log.i("Create  Table \(nameOfTable) success")
         }catch let e{
             Log.e("Create  Table \(nameOfTable)failure：\(e.localizedDescription)")
@@ -95,6 +101,9 @@ public extension ASProtocol where Self:ASModel{
             case _ as NSDate?.Type:
                 t.column(Expression<NSDate?>(column))
                 
+            case _ as Data?.Type:
+                t.column(Expression<Data?>(column))
+                
             default: break
                 
             }
@@ -105,6 +114,7 @@ public extension ASProtocol where Self:ASModel{
     static func dropTable()throws{
         do{
             try getDB().run(getTable().drop(ifExists: true))
+            ASCache.setVerified(try getDB(), nameOfTable, false)
             Log.i("Delete  Table \(nameOfTable) success")
             
         }catch{
@@ -119,6 +129,7 @@ public extension ASProtocol where Self:ASModel{
     static func renameTable(oldName:String, newName:String)throws{
         do{
             try getDB().run(Table(oldName).rename(Table(newName)))
+            ASCache.setVerified(try getDB(), oldName, false)
             Log.i("alter name of table from \(oldName) to \(newName) success")
             
         }catch{
@@ -140,6 +151,7 @@ public extension ASProtocol where Self:ASModel{
                 
                 //            }
             })
+            ASCache.setVerified(try getDB(), nameOfTable, false)
             Log.i("Add \(columnNames) columns to \(nameOfTable) table success")
             
         }catch{
@@ -193,6 +205,9 @@ public extension ASProtocol where Self:ASModel{
             case _ as NSDate?.Type:
                 return t.addColumn(Expression<NSDate?>(column))
                 
+            case _ as Data?.Type:
+                return t.addColumn(Expression<Data?>(column))
+                
             default:
                 return nil
             }
@@ -147,6 +147,13 @@ public extension ASProtocol where Self:ASModel{
     //MARK: - Build
     internal func buildFromRow(row:Row){
 
+        if let bindings = modelBindings() {
+            for binding in bindings {
+                try? binding.decodeRow(self, row)
+            }
+            return
+        }
+
         for case let (attribute?,column?, value) in recursionProperties() {
             //            let s = "Attribute ：\(attribute) Value：\(value),   " +
             //                    "Mirror: \(Mirror(reflecting:value)),  " +
@@ -211,6 +218,9 @@ public extension ASProtocol where Self:ASModel{
                     setValue(nil, forKey: attribute)
                 }
 
+            case _ as Data?.Type:
+                setValue(try! row.get(Expression<Data?>(column)), forKey: attribute)
+
             default: break
 
             }
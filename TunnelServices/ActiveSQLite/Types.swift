@@ -20,7 +20,8 @@ func isSupportTypes(_ value:Any)->Bool{
 //         _ as Double.Type,_ as Double?.Type,
 //         _ as Date.Type,_ as Date?.Type,
          _ as NSNumber.Type,_ as NSNumber?.Type,
-         _ as NSDate.Type,_ as NSDate?.Type:
+         _ as NSDate.Type,_ as NSDate?.Type,
+         _ as Data?.Type:
         return true
         
     default:
@@ -0,0 +1,838 @@
+//
+//  BodyStore.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/6/29.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import NIO
+import NIOConcurrencyHelpers
+import CNIOBoringSSL
+import AxLogger
+
+// 每个 Task 一组只追加的 body 存储，替代每个会话两个文件
+//   bodies.seg：数据段，按块预分配，大 body 的每个分片直接 pwrite 写入
+//   bodies.idx：索引，每条记录 24 字节头部：sessionID(8) | 方向(1) | 类型(1) | 保留(2) | 长度(4) | 段内偏移(8)
+//              小分片（<= inlineLimit）不写数据段，内容直接跟在索引头部后面
+//   bodies.rel：已删除的、参与去重的会话 id（8 字节一个），删除端在文件锁中追加
+// 写入位置用原子变量预留，多个 EventLoop 并发写不加锁，每个分片没有 open/stat/close
+// 去重：抓包线程边写边算 SHA-256，body 结束时与本 Task 已有的 body 比较：
+//   第一次出现的写一条摘要记录（内容为摘要，偏移字段为 body 长度）；
+//   重复的写一条引用记录（偏移字段为第一份的 sessionID * 2 + 方向），已写入的分片打洞回收
+//   被引用的 body 要等它和所有引用它的会话都删除后才回收
+// 差分（BodyStorageOptions.deltaEncoding）：同一 method + URL 的响应体先缓存在内存中，结束时对这个 URL 最近一份完整的 body 做差分，
+//   差分足够小时只写一条差分记录（内容为 基准 key(8) | body 长度(8) | 差分），否则写完整内容并作为之后的基准；基准按引用计数回收
+// 截断：抓包队列满时丢弃了分片的 body 结束时写一条截断记录（内容为已保存的长度），不去重、不做差分
+public struct BodyStorageOptions {
+    public var deltaEncoding: Bool
+
+    public init(deltaEncoding: Bool) {
+        self.deltaEncoding = deltaEncoding
+    }
+
+    private static let key = "BodyStorageOptions"
+
+    // Tunnel 启动时读取
+    public static var current: BodyStorageOptions {
+        get {
+            let dic = UserDefaults(suiteName: GROUPNAME)?.dictionary(forKey: key)
+            return BodyStorageOptions(deltaEncoding: (dic?["deltaEncoding"] as? NSNumber)?.boolValue ?? false)
+        }
+        set {
+            UserDefaults(suiteName: GROUPNAME)?.set(["deltaEncoding": NSNumber(value: newValue.deltaEncoding)], forKey: key)
+        }
+    }
+}
+
+final class BodyStore {
+
+    static let segmentName = "bodies.seg"
+    static let indexName = "bodies.idx"
+    static let releaseName = "bodies.rel"
+    static let headerSize = 24
+    static let inlineLimit = 2048
+    static let growStep: Int64 = 8 * 1024 * 1024
+    static let digestSize = Int(SHA256_DIGEST_LENGTH)
+    static let deltaLimit = 256 * 1024      // 超过的响应体不缓存、不做差分
+    static let deltaMaxSize = 64 * 1024     // 差分记录内联在索引中，小于索引扫描窗口
+    static let discardBatch = 64            // 被丢弃的会话攒够一批再扫描索引打洞
+
+    static var deltaEncoding = false        // MitmService 启动时按 BodyStorageOptions 设置
+
+    enum Kind: UInt8 {
+        case segment = 0
+        case inline = 1
+        case ref = 2
+        case digest = 3
+        case delta = 4
+        case truncated = 5
+    }
+
+    // 正在写入的 body：摘要上下文和已写入数据段的分片；同一个 body 只由一个抓包线程处理
+    private final class Pending {
+        var context = SHA256_CTX()
+        var length = 0
+        var segments = [(Int64, Int64)]()
+        let deltaKey: String?
+        var buffer: [UInt8]?        // 差分模式下缓存的内容，超过 deltaLimit 后写出并置为 nil
+
+        init(deltaKey: String?) {
+            self.deltaKey = deltaKey
+            buffer = deltaKey == nil ? nil : []
+            CNIOBoringSSL_SHA256_Init(&context)
+        }
+    }
+
+    let folder: String
+    private let segmentFD: Int32
+    private let indexFD: Int32
+    private let segmentTail: Atomic<Int64>
+    private let indexTail: Atomic<Int64>
+    private let growLock = Lock()
+    private var allocated: Int64
+    private let dedupLock = Lock()
+    private var pending = [Int: Pending]()                  // key = sessionID * 2 + 方向
+    private var blobs = [Data: (key: Int, length: Int)]()   // 摘要 -> 第一次写入的 body
+    private var deltaBases = [String: (key: Int, extents: [Extent])]()    // method + URL -> 最近一份完整的响应体
+    private var released = Set<Int>()
+    private var releasedOffset: Int64 = 0
+    private var discarded = Set<Int>()
+    private let deltaEncoding = BodyStore.deltaEncoding
+    let dedupCount = Atomic<Int>(value: 0)
+    let dedupBytes = Atomic<Int>(value: 0)
+    let deltaCount = Atomic<Int>(value: 0)
+    let deltaSaved = Atomic<Int>(value: 0)
+
+    private init?(folder: String) {
+        let dir = "\(MitmService.getStoreFolder())\(folder)/"
+        let segmentFD = open(dir + BodyStore.segmentName, O_RDWR | O_CREAT, 0o644)
+        let indexFD = open(dir + BodyStore.indexName, O_RDWR | O_CREAT, 0o644)
+        guard segmentFD >= 0, indexFD >= 0 else {
+            print("BodyStore open failure:\(dir) errno:\(errno)")
+            if segmentFD >= 0 { close(segmentFD) }
+            if indexFD >= 0 { close(indexFD) }
+            return nil
+        }
+        self.folder = folder
+        self.segmentFD = segmentFD
+        self.indexFD = indexFD
+        // 重新打开同一个 Task 时接着索引里记录的末尾写
+        let indexSize = Int64(lseek(indexFD, 0, SEEK_END))
+        indexTail = Atomic<Int64>(value: indexSize)
+        var segmentEnd: Int64 = 0
+        var blobs = [Data: (key: Int, length: Int)]()
+        Reader.scan(indexFD, from: 0, to: indexSize) { sessionID, isReq, extent in
+            switch extent {
+            case .segment(let offset, let length):
+                segmentEnd = max(segmentEnd, offset + Int64(length))
+            case .digest(let digest, let length):
+                blobs[digest] = (sessionID * 2 + (isReq ? 0 : 1), length)
+            default:
+                break
+            }
+        }
+        segmentTail = Atomic<Int64>(value: segmentEnd)
+        allocated = Int64(lseek(segmentFD, 0, SEEK_END))
+        self.blobs = blobs
+    }
+
+    deinit {
+        // 去掉预分配但没用到的部分
+        ftruncate(segmentFD, segmentTail.load())
+        close(segmentFD)
+        close(indexFD)
+    }
+
+    // MARK: - writer
+
+    private static let storesLock = Lock()
+    private static var stores = [String: BodyStore]()
+
+    static func store(for folder: String) -> BodyStore? {
+        return storesLock.withLock {
+            if let store = stores[folder] { return store }
+            let store = BodyStore(folder: folder)
+            stores[folder] = store
+            return store
+        }
+    }
+
+    // Task 结束时关闭所有写入，还没结束的缓存 body 写出
+    static func closeAll() {
+        storesLock.withLockVoid {
+            for store in stores.values {
+                store.finishAll()
+                store.punchDiscarded(force: true)
+                if store.dedupCount.load() > 0 || store.deltaCount.load() > 0 {
+                    AxLogger.log("BodyStore \(store.folder) dedup \(store.dedupCount.load()) bodies, \(store.dedupBytes.load()) bytes; delta \(store.deltaCount.load()) bodies, \(store.deltaSaved.load()) bytes saved", level: .Info)
+                }
+            }
+            stores.removeAll()
+        }
+    }
+
+    // deltaKey 为 method + URL，只有响应体传入
+    func append(sessionID: Int, isReq: Bool, buffer: ByteBuffer, deltaKey: String? = nil) {
+        let length = buffer.readableBytes
+        if length == 0 { return }
+        let key = sessionID * 2 + (isReq ? 0 : 1)
+        let state: Pending = dedupLock.withLock {
+            if let state = pending[key] { return state }
+            let state = Pending(deltaKey: deltaEncoding ? deltaKey : nil)
+            pending[key] = state
+            return state
+        }
+        state.length += length
+        buffer.withUnsafeReadableBytes { bytes in
+            _ = CNIOBoringSSL_SHA256_Update(&state.context, bytes.baseAddress, bytes.count)
+            if state.buffer != nil {
+                if state.length <= BodyStore.deltaLimit {
+                    state.buffer!.append(contentsOf: bytes)
+                    return
+                }
+                // 超过上限不再做差分，已缓存的部分先写出
+                let buffered = state.buffer!
+                state.buffer = nil
+                buffered.withUnsafeBytes { _ = writeChunk(sessionID, isReq, $0, state) }
+            }
+            writeChunk(sessionID, isReq, bytes, state)
+        }
+    }
+
+    // 大分片写数据段，小分片内联在索引中
+    @discardableResult
+    private func writeChunk(_ sessionID: Int, _ isReq: Bool, _ bytes: UnsafeRawBufferPointer, _ state: Pending) -> Extent {
+        let length = bytes.count
+        if length <= BodyStore.inlineLimit {
+            writeRecord(BodyStore.header(sessionID, isReq, .inline, length, 0), bytes)
+            return .inline(Data(bytes))
+        }
+        let offset = segmentTail.add(Int64(length))
+        ensureAllocated(offset + Int64(length))
+        BodyStore.writeFully(segmentFD, bytes, offset)
+        state.segments.append((offset, offset + Int64(length)))
+        let header = BodyStore.header(sessionID, isReq, .segment, length, offset)
+        let position = indexTail.add(Int64(BodyStore.headerSize))
+        header.withUnsafeBytes { BodyStore.writeFully(indexFD, $0, position) }
+        return .segment(offset, length)
+    }
+
+    private func finishAll() {
+        let keys = dedupLock.withLock { Array(pending.keys) }
+        for key in keys {
+            finish(sessionID: key / 2, isReq: key % 2 == 0)
+        }
+    }
+
+    // body 结束（Session.writeBody 传入 nil）时由抓包线程调用
+    func finish(sessionID: Int, isReq: Bool, truncated: Bool = false) {
+        let key = sessionID * 2 + (isReq ? 0 : 1)
+        let pendingState = dedupLock.withLock { pending.removeValue(forKey: key) }
+        if truncated {
+            // 内容不完整，摘要和差分都没有意义：缓存中的内容原样写出，再写截断记录
+            var stored = 0
+            if let state = pendingState {
+                stored = state.length
+                if let buffered = state.buffer {
+                    buffered.withUnsafeBytes { _ = writeChunk(sessionID, isReq, $0, state) }
+                }
+            }
+            var payload = [UInt8](repeating: 0, count: 8)
+            payload.withUnsafeMutableBytes { $0.storeBytes(of: Int64(stored).littleEndian, as: Int64.self) }
+            payload.withUnsafeBytes { writeRecord(BodyStore.header(sessionID, isReq, .truncated, 8, 0), $0) }
+            return
+        }
+        guard let state = pendingState else { return }
+        // 内联在索引中的小 body 不去重，缓存中还没写出的除外
+        guard state.length > BodyStore.inlineLimit || state.buffer != nil else { return }
+        var digest = [UInt8](repeating: 0, count: BodyStore.digestSize)
+        _ = CNIOBoringSSL_SHA256_Final(&digest, &state.context)
+        let hash = Data(digest)
+        // 检查和写入引用都在 bodies.rel 的共享锁中，删除端（排他锁）扫描时一定能看到这条引用
+        let releaseFD = open("\(MitmService.getStoreFolder())\(folder)/\(BodyStore.releaseName)", O_RDWR | O_CREAT, 0o644)
+        guard releaseFD >= 0 else { return }
+        flock(releaseFD, LOCK_SH)
+        defer {
+            flock(releaseFD, LOCK_UN)
+            close(releaseFD)
+        }
+        var owner: Int?
+        var base: (key: Int, extents: [Extent])?
+        var deleted = false
+        dedupLock.withLockVoid {
+            refreshReleased(releaseFD)
+            // 写入过程中会话已被删除：已写的分片被打洞，不能再作为去重或差分的来源
+            if released.contains(sessionID) {
+                deleted = true
+            } else if let blob = blobs[hash], blob.length == state.length, !released.contains(blob.key / 2) {
+                owner = blob.key
+            } else if let deltaKey = state.deltaKey, let b = deltaBases[deltaKey], !released.contains(b.key / 2) {
+                base = b
+            }
+        }
+        if deleted {
+            BodyStore.punchRanges(segmentFD, state.segments, folder)
+            return
+        }
+        if let ownerKey = owner {
+            writeRecord(BodyStore.header(sessionID, isReq, .ref, state.length, Int64(ownerKey)), nil)
+            BodyStore.punchRanges(segmentFD, state.segments, folder)
+            _ = dedupCount.add(1)
+            _ = dedupBytes.add(state.length)
+            return
+        }
+        if let buffered = state.buffer, let deltaKey = state.deltaKey {
+            // 差分不到原长度一半时写完整内容，作为之后的基准，避免基准越来越旧
+            if let b = base, let baseBytes = readExtents(b.extents),
+                let delta = BodyDelta.encode(base: baseBytes, target: buffered, limit: min(buffered.count / 2, BodyStore.deltaMaxSize)) {
+                var payload = [UInt8](repeating: 0, count: 16)
+                payload.withUnsafeMutableBytes { raw in
+                    raw.storeBytes(of: Int64(b.key).littleEndian, toByteOffset: 0, as: Int64.self)
+                    raw.storeBytes(of: Int64(buffered.count).littleEndian, toByteOffset: 8, as: Int64.self)
+                }
+                payload.append(contentsOf: delta)
+                payload.withUnsafeBytes { writeRecord(BodyStore.header(sessionID, isReq, .delta, payload.count, 0), $0) }
+                _ = deltaCount.add(1)
+                _ = deltaSaved.add(buffered.count - delta.count)
+                return
+            }
+            let extent = buffered.withUnsafeBytes { writeChunk(sessionID, isReq, $0, state) }
+            dedupLock.withLockVoid { deltaBases[deltaKey] = (key, [extent]) }
+        }
+        if state.length > BodyStore.inlineLimit {
+            dedupLock.withLockVoid { blobs[hash] = (key, state.length) }
+            digest.withUnsafeBytes { writeRecord(BodyStore.header(sessionID, isReq, .digest, BodyStore.digestSize, Int64(state.length)), $0) }
+        }
+    }
+
+    // 读出作为差分基准的 body
+    private func readExtents(_ extents: [Extent]) -> [UInt8]? {
+        var result = [UInt8]()
+        for extent in extents {
+            switch extent {
+            case .inline(let data):
+                result.append(contentsOf: data)
+            case .segment(let offset, let length):
+                var chunk = [UInt8](repeating: 0, count: length)
+                let count = chunk.withUnsafeMutableBytes { pread(segmentFD, $0.baseAddress, length, off_t(offset)) }
+                guard count == length else { return nil }
+                result.append(contentsOf: chunk)
+            default:
+                return nil
+            }
+        }
+        return result
+    }
+
+    // 头部和内容拼成一块，一次 pwrite 写入；单次写入对同一文件的读取是原子的，读取端不会看到只有头部的记录
+    // iOS 12 SDK 没有 pwritev，内容最多 deltaMaxSize，复制一次的开销远小于多一次系统调用
+    private func writeRecord(_ header: [UInt8], _ payload: UnsafeRawBufferPointer?) {
+        var record = header
+        if let bytes = payload {
+            record.append(contentsOf: bytes)
+        }
+        let position = indexTail.add(Int64(record.count))
+        record.withUnsafeBytes { BodyStore.writeFully(indexFD, $0, position) }
+    }
+
+    // 抓包过滤丢弃的会话：还没结束的分片直接打洞；已结束的 body 可能参与去重，攒够一批后按删除流程回收
+    func discard(sessionID: Int) {
+        var segments = [(Int64, Int64)]()
+        dedupLock.withLockVoid {
+            for key in [sessionID * 2, sessionID * 2 + 1] {
+                if let state = pending.removeValue(forKey: key) {
+                    segments.append(contentsOf: state.segments)
+                }
+            }
+            discarded.insert(sessionID)
+        }
+        BodyStore.punchRanges(segmentFD, segments, folder)
+        punchDiscarded(force: false)
+    }
+
+    private func punchDiscarded(force: Bool) {
+        let batch: Set<Int> = dedupLock.withLock {
+            guard force || discarded.count >= BodyStore.discardBatch else { return [] }
+            let batch = discarded
+            discarded.removeAll()
+            return batch
+        }
+        BodyStore.punch(folder: folder, sessionIDs: batch)
+    }
+
+    // 在 dedupLock 中调用，只读新追加的部分
+    private func refreshReleased(_ fd: Int32) {
+        let size = Int64(lseek(fd, 0, SEEK_END))
+        if size <= releasedOffset { return }
+        released.formUnion(BodyStore.readReleased(fd, from: releasedOffset, to: size))
+        releasedOffset = size / 8 * 8
+    }
+
+    // 数据段按 growStep 预分配，减少文件系统扩展元数据的次数
+    private func ensureAllocated(_ end: Int64) {
+        growLock.withLockVoid {
+            if end <= allocated { return }
+            var newSize = allocated + BodyStore.growStep
+            while newSize < end { newSize += BodyStore.growStep }
+            var store = fstore_t(fst_flags: UInt32(F_ALLOCATEALL), fst_posmode: F_PEOFPOSMODE, fst_offset: 0,
+                                 fst_length: off_t(newSize - allocated), fst_bytesalloc: 0)
+            _ = fcntl(segmentFD, F_PREALLOCATE, &store)
+            if ftruncate(segmentFD, off_t(newSize)) == 0 {
+                allocated = newSize
+            } else {
+                print("BodyStore grow failure:\(folder) errno:\(errno)")
+            }
+        }
+    }
+
+    // 直接从 ByteBuffer 的存储写入，不复制成 Data
+    private static func writeFully(_ fd: Int32, _ bytes: UnsafeRawBufferPointer, _ position: Int64) {
+        var written = 0
+        while written < bytes.count {
+            let count = pwrite(fd, bytes.baseAddress! + written, bytes.count - written, off_t(position + Int64(written)))
+            if count < 0 {
+                if errno == EINTR { continue }
+                print("BodyStore write failure errno:\(errno)")
+                return
+            }
+            written += count
+        }
+    }
+
+    private static func header(_ sessionID: Int, _ isReq: Bool, _ kind: Kind, _ length: Int, _ offset: Int64) -> [UInt8] {
+        var bytes = [UInt8](repeating: 0, count: headerSize)
+        bytes.withUnsafeMutableBytes { raw in
+            raw.storeBytes(of: Int64(sessionID).littleEndian, toByteOffset: 0, as: Int64.self)
+            raw[8] = isReq ? 0 : 1
+            raw[9] = kind.rawValue
+            raw.storeBytes(of: UInt32(length).littleEndian, toByteOffset: 12, as: UInt32.self)
+            raw.storeBytes(of: offset.littleEndian, toByteOffset: 16, as: Int64.self)
+        }
+        return bytes
+    }
+
+    private static func readReleased(_ fd: Int32, from: Int64, to: Int64) -> Set<Int> {
+        let count = Int(to - from) / 8
+        guard count > 0 else { return [] }
+        var ids = [Int64](repeating: 0, count: count)
+        let read = ids.withUnsafeMutableBytes { pread(fd, $0.baseAddress, $0.count, off_t(from)) }
+        return Set(ids.prefix(max(0, read / 8)).map { Int(Int64(littleEndian: $0)) })
+    }
+
+    // MARK: - purge
+
+    static let punchBlock: Int64 = 4096
+    static let scanWindow: Int64 = 1024 * 1024
+
+    // 回收已删除会话在数据段中的空间：按块打洞，文件长度和其他记录的偏移不变
+    // 内联在索引中的小分片不单独回收，随 Task 目录一起删除；不支持打洞的文件系统直接跳过
+    // 被引用的 body 在它和所有引用者都删除后回收；参与去重的会话记入 bodies.rel，后续删除时仍能计数
+    // 有摘要记录的会话（可能被之后的 body 引用或作为差分基准）即使还没有引用者也记入，写入端不再引用它
+    // 还在写入的会话同样记入，写入端结束时看到后不登记摘要和差分基准
+    static func punch(folder: String, sessionIDs: Set<Int>) {
+        guard !folder.isEmpty, !sessionIDs.isEmpty else { return }
+        let dir = "\(MitmService.getStoreFolder())\(folder)/"
+        let indexFD = open(dir + indexName, O_RDONLY)
+        guard indexFD >= 0 else { return }
+        defer { close(indexFD) }
+        let releaseFD = open(dir + releaseName, O_RDWR | O_CREAT | O_APPEND, 0o644)
+        guard releaseFD >= 0 else { return }
+        flock(releaseFD, LOCK_EX)
+        defer {
+            flock(releaseFD, LOCK_UN)
+            close(releaseFD)
+        }
+        let size = Int64(lseek(indexFD, 0, SEEK_END))
+        // 第一遍：引用关系，引用者 key -> 被引用的 key；本次删除的会话中有摘要记录的
+        var owners = [Int: Int]()
+        var involved = Set<Int>()   // 本次删除中参与去重的会话
+        var unfinished = Set<Int>() // 本次删除中有分片、还没有结束记录的 body，写入端结束时不能再登记它
+        Reader.scan(indexFD, from: 0, to: size) { sessionID, isReq, extent in
+            let key = sessionID * 2 + (isReq ? 0 : 1)
+            switch extent {
+            case .ref(let owner, _), .delta(let owner, _, _):
+                owners[key] = owner
+                unfinished.remove(key)
+            case .digest:
+                if sessionIDs.contains(sessionID) { involved.insert(sessionID) }
+                unfinished.remove(key)
+            case .truncated:
+                unfinished.remove(key)
+            case .segment:
+                if sessionIDs.contains(sessionID) { unfinished.insert(key) }
+            case .inline:
+                break
+            }
+        }
+        involved.formUnion(unfinished.map { $0 / 2 })
+        var referrers = [Int: [Int]]()
+        for (referrer, owner) in owners {
+            referrers[owner, default: []].append(referrer)
+        }
+        let released = readReleased(releaseFD, from: 0, to: Int64(lseek(releaseFD, 0, SEEK_END))).union(sessionIDs)
+        var freed = Set<Int>()      // 可以回收的被引用 body
+        for (owner, list) in referrers {
+            let keys = [owner] + list
+            if keys.contains(where: { sessionIDs.contains($0 / 2) }) {
+                involved.formUnion(keys.map { $0 / 2 }.filter { sessionIDs.contains($0) })
+                if keys.allSatisfy({ released.contains($0 / 2) }) { freed.insert(owner) }
+            }
+        }
+        if !involved.isEmpty {
+            let ids = involved.map { Int64($0).littleEndian }
+            _ = ids.withUnsafeBytes { write(releaseFD, $0.baseAddress, $0.count) }
+        }
+        // 第二遍：要回收的分片
+        var ranges = [(Int64, Int64)]()
+        Reader.scan(indexFD, from: 0, to: size) { sessionID, isReq, extent in
+            guard case .segment(let offset, let length) = extent else { return }
+            let key = sessionID * 2 + (isReq ? 0 : 1)
+            if referrers[key] == nil ? sessionIDs.contains(sessionID) : freed.contains(key) {
+                ranges.append((offset, offset + Int64(length)))
+            }
+        }
+        if ranges.isEmpty { return }
+        let segmentFD = open(dir + segmentName, O_RDWR)
+        guard segmentFD >= 0 else { return }
+        defer { close(segmentFD) }
+        punchRanges(segmentFD, ranges, folder)
+    }
+
+    private static func punchRanges(_ segmentFD: Int32, _ list: [(Int64, Int64)], _ folder: String) {
+        var ranges = list
+        if ranges.isEmpty { return }
+        // 相邻分片合并后再按块对齐，和其他会话共用的块不动
+        ranges.sort { $0.0 < $1.0 }
+        var merged = [(Int64, Int64)]()
+        for range in ranges {
+            if let last = merged.last, range.0 <= last.1 {
+                merged[merged.count - 1].1 = max(last.1, range.1)
+            } else {
+                merged.append(range)
+            }
+        }
+        for (start, end) in merged {
+            let first = (start + punchBlock - 1) / punchBlock * punchBlock
+            let last = end / punchBlock * punchBlock
+            if last <= first { continue }
+            var hole = fpunchhole_t(fp_flags: 0, reserved: 0, fp_offset: off_t(first), fp_length: off_t(last - first))
+            if fcntl(segmentFD, F_PUNCHHOLE, &hole) != 0 {
+                if errno != ENOTSUP { print("BodyStore punch failure:\(folder) errno:\(errno)") }
+                return
+            }
+        }
+    }
+
+    // MARK: - reader
+
+    enum Extent {
+        case segment(Int64, Int)
+        case inline(Data)
+        case ref(Int, Int)          // 被引用的 key，body 长度
+        case digest(Data, Int)      // 摘要，body 长度
+        case delta(Int, Int, Data)  // 基准的 key，body 长度，差分
+        case truncated              // body 不完整
+    }
+
+    // 读取端（主 App）：增量解析索引，按 (sessionID, 方向) 记录每段内容的位置，内容用到时再 pread
+    // 索引和数据段的 fd 一直打开，索引没有变长时不解析；最近用过的 cacheLimit 个 Reader 缓存，删除 Task 时移除
+    final class Reader {
+        let folder: String
+        private let lock = Lock()
+        private var indexFD: Int32 = -1
+        private var segmentFD: Int32 = -1
+        private var parsedOffset: Int64 = 0
+        private var entries = [Int: [Entry]]()      // key = sessionID * 2 + (isReq ? 0 : 1)
+        private var truncated = Set<Int>()
+
+        // 内联和差分记录只记在索引文件中的位置
+        private enum Entry {
+            case segment(Int64, Int)            // 数据段偏移，长度
+            case inline(Int64, Int)             // 索引偏移，长度
+            case ref(Int, Int)                  // 被引用的 key，body 长度
+            case delta(Int, Int, Int64, Int)    // 基准的 key，body 长度，差分的索引偏移、长度
+        }
+
+        init(folder: String) {
+            self.folder = folder
+        }
+
+        deinit {
+            if indexFD >= 0 { close(indexFD) }
+            if segmentFD >= 0 { close(segmentFD) }
+        }
+
+        static let cacheLimit = 8
+        private static let readersLock = Lock()
+        private static var readers = [String: Reader]()
+        private static var recent = [String]()      // 最近用过的在后面
+
+        static func reader(for folder: String) -> Reader {
+            return readersLock.withLock {
+                if let reader = readers[folder] {
+                    if recent.last != folder, let index = recent.firstIndex(of: folder) {
+                        recent.remove(at: index)
+                        recent.append(folder)
+                    }
+                    return reader
+                }
+                let reader = Reader(folder: folder)
+                readers[folder] = reader
+                recent.append(folder)
+                // 被移出的 Reader 在正在进行的读取结束后释放，关闭文件
+                if recent.count > cacheLimit {
+                    readers.removeValue(forKey: recent.removeFirst())
+                }
+                return reader
+            }
+        }
+
+        // Task 删除时调用
+        static func drop(folder: String) {
+            readersLock.withLockVoid {
+                readers.removeValue(forKey: folder)
+                if let index = recent.firstIndex(of: folder) {
+                    recent.remove(at: index)
+                }
+            }
+        }
+
+        // 在 lock 中调用
+        private func refresh() {
+            if indexFD < 0 {
+                indexFD = open("\(MitmService.getStoreFolder())\(folder)/\(BodyStore.indexName)", O_RDONLY)
+                if indexFD < 0 { return }
+            }
+            var st = stat()
+            guard fstat(indexFD, &st) == 0 else { return }
+            let size = Int64(st.st_size)
+            if size < parsedOffset {
+                // 文件被重建，重新解析
+                parsedOffset = 0
+                entries.removeAll()
+                truncated.removeAll()
+            }
+            if size == parsedOffset { return }
+            parsedOffset = Reader.scanRecords(indexFD, from: parsedOffset, to: size) { record, _ in
+                let key = record.sessionID * 2 + (record.isReq ? 0 : 1)
+                switch record.kind {
+                case .digest: break
+                case .truncated: truncated.insert(key)
+                case .segment: entries[key, default: []].append(.segment(record.offset, record.length))
+                case .inline: entries[key, default: []].append(.inline(record.position, record.length))
+                // 引用、差分记录在这个 body 的分片之后写入，替换之前的分片
+                case .ref: entries[key] = [.ref(Int(record.offset), record.length)]
+                case .delta: entries[key] = [.delta(record.base, record.total, record.position + 16, record.length - 16)]
+                }
+            }
+        }
+
+        // 索引记录的头部；position 为内容在索引文件中的位置，差分记录附带基准的 key 和 body 长度
+        struct Record {
+            let sessionID: Int
+            let isReq: Bool
+            let kind: Kind
+            let length: Int
+            let offset: Int64
+            let position: Int64
+            var base = 0
+            var total = 0
+        }
+
+        // 遍历 [from, to) 的索引记录，按 scanWindow 分段读取，遇到还没写完的记录停下，返回解析到的位置
+        // 回调中的内容只在回调期间有效
+        @discardableResult
+        static func scanRecords(_ fd: Int32, from: Int64, to: Int64, _ body: (Record, UnsafeRawBufferPointer) -> Void) -> Int64 {
+            guard to > from else { return from }
+            var window = [UInt8](repeating: 0, count: Int(min(to - from, BodyStore.scanWindow)))
+            var start = from
+            while start < to {
+                let size = Int(min(to - start, Int64(window.count)))
+                let count = window.withUnsafeMutableBytes { pread(fd, $0.baseAddress, size, off_t(start)) }
+                guard count > 0 else { break }
+                let parsed = window.withUnsafeBytes { parse(UnsafeRawBufferPointer(rebasing: $0[0..<count]), start, body) }
+                if parsed == 0 { break }
+                start += Int64(parsed)
+            }
+            return start
+        }
+
+        private static func parse(_ data: UnsafeRawBufferPointer, _ base: Int64, _ body: (Record, UnsafeRawBufferPointer) -> Void) -> Int {
+            var position = 0
+            while position + BodyStore.headerSize <= data.count {
+                let sessionID = Int(load(Int64.self, data, position))
+                let length = Int(load(UInt32.self, data, position + 12))
+                let offset = load(Int64.self, data, position + 16)
+                if sessionID == 0 || length == 0 { break }
+                let isReq = data[position + 8] == 0
+                let kind = Kind(rawValue: data[position + 9]) ?? .segment
+                let start = position + BodyStore.headerSize
+                var record = Record(sessionID: sessionID, isReq: isReq, kind: kind, length: length, offset: offset, position: base + Int64(start))
+                switch kind {
+                case .segment, .ref:
+                    body(record, UnsafeRawBufferPointer(rebasing: data[start..<start]))
+                    position = start
+                case .inline, .digest, .truncated, .delta:
+                    guard start + length <= data.count, kind != .delta || length >= 16 else { return position }
+                    if kind == .delta {
+                        record.base = Int(load(Int64.self, data, start))
+                        record.total = Int(load(Int64.self, data, start + 8))
+                    }
+                    body(record, UnsafeRawBufferPointer(rebasing: data[start..<(start + length)]))
+                    position = start + length
+                }
+            }
+            return position
+        }
+
+        // 内联内容之后的记录不按 8 字节对齐，逐字节复制
+        private static func load<T: FixedWidthInteger>(_ type: T.Type, _ data: UnsafeRawBufferPointer, _ at: Int) -> T {
+            var value: T = 0
+            withUnsafeMutableBytes(of: &value) { $0.copyMemory(from: UnsafeRawBufferPointer(rebasing: data[at..<(at + MemoryLayout<T>.size)])) }
+            return T(littleEndian: value)
+        }
+
+        // 写入端、清理用：带内容的记录
+        @discardableResult
+        static func scan(_ fd: Int32, from: Int64, to: Int64, _ body: (Int, Bool, Extent) -> Void) -> Int64 {
+            return scanRecords(fd, from: from, to: to) { record, payload in
+                switch record.kind {
+                case .segment: body(record.sessionID, record.isReq, .segment(record.offset, record.length))
+                case .inline: body(record.sessionID, record.isReq, .inline(Data(payload)))
+                case .ref: body(record.sessionID, record.isReq, .ref(Int(record.offset), record.length))
+                case .digest: body(record.sessionID, record.isReq, .digest(Data(payload), Int(record.offset)))
+                case .delta: body(record.sessionID, record.isReq, .delta(record.base, record.total, Data(payload[16...])))
+                case .truncated: body(record.sessionID, record.isReq, .truncated)
+                }
+            }
+        }
+
+        func contains(sessionID: Int, isReq: Bool) -> Bool {
+            return lock.withLock {
+                refresh()
+                return entries[sessionID * 2 + (isReq ? 0 : 1)] != nil
+            }
+        }
+
+        // 抓包队列满时丢过分片，保存的只是开头一部分
+        func isTruncated(sessionID: Int, isReq: Bool) -> Bool {
+            return lock.withLock {
+                refresh()
+                return truncated.contains(sessionID * 2 + (isReq ? 0 : 1))
+            }
+        }
+
+        func size(sessionID: Int, isReq: Bool) -> UInt64 {
+            return lock.withLock {
+                refresh()
+                return Reader.size(entries[sessionID * 2 + (isReq ? 0 : 1)] ?? [])
+            }
+        }
+
+        private static func size(_ list: [Entry]) -> UInt64 {
+            var size: UInt64 = 0
+            for entry in list {
+                switch entry {
+                case .segment(_, let length), .inline(_, let length), .ref(_, let length), .delta(_, let length, _, _):
+                    size += UInt64(length)
+                }
+            }
+            return size
+        }
+
+        // 去重效果：body 总长度和实际存储的长度（引用不计）
+        func dedupStats() -> (logical: UInt64, stored: UInt64) {
+            return lock.withLock {
+                refresh()
+                var logical: UInt64 = 0, stored: UInt64 = 0
+                for list in entries.values {
+                    let size = Reader.size(list)
+                    logical += size
+                    switch list.first {
+                    case .ref?: break
+                    case .delta(_, _, _, let length)?: stored += UInt64(length)
+                    default: stored += size
+                    }
+                }
+                return (logical, stored)
+            }
+        }
+
+        func read(sessionID: Int, isReq: Bool) -> Data? {
+            var result = Data()
+            return stream(sessionID: sessionID, isReq: isReq) { result.append($0) } ? result : nil
+        }
+
+        // 导出到文件，边还原边写
+        func export(sessionID: Int, isReq: Bool, to path: String) -> Bool {
+            guard FileManager.default.createFile(atPath: path, contents: nil), let handle = FileHandle(forWritingAtPath: path) else { return false }
+            let done = stream(sessionID: sessionID, isReq: isReq) { handle.write($0) }
+            handle.closeFile()
+            if !done { unlink(path) }
+            return done
+        }
+
+        // 逐段输出 body；差分记录逐条指令还原，COPY 只读取基准中用到的一段
+        @discardableResult
+        func stream(sessionID: Int, isReq: Bool, _ body: (Data) -> Void) -> Bool {
+            let resolved: (list: [Entry], base: [Entry], index: Int32, segment: Int32)? = lock.withLock {
+                refresh()
+                guard var list = entries[sessionID * 2 + (isReq ? 0 : 1)] else { return nil }
+                if segmentFD < 0 {
+                    segmentFD = open("\(MitmService.getStoreFolder())\(folder)/\(BodyStore.segmentName)", O_RDONLY)
+                }
+                // 重复的 body 读第一份
+                if case .ref(let owner, _)? = list.first { list = entries[owner] ?? [] }
+                if case .delta(let base, _, _, _)? = list.first { return (list, entries[base] ?? [], indexFD, segmentFD) }
+                return (list, [], indexFD, segmentFD)
+            }
+            guard let r = resolved else { return false }
+            // fd 随 Reader 释放才关闭，读取期间 self 一直被持有
+            func readAt(_ fd: Int32, _ offset: Int64, _ length: Int) -> Data? {
+                guard fd >= 0 else { return nil }
+                var chunk = Data(count: length)
+                let count = chunk.withUnsafeMutableBytes { pread(fd, $0.baseAddress, length, off_t(offset)) }
+                return count == length ? chunk : nil
+            }
+            func readEntry(_ entry: Entry, _ from: Int, _ length: Int) -> Data? {
+                switch entry {
+                case .segment(let offset, _): return readAt(r.segment, offset + Int64(from), length)
+                case .inline(let offset, _): return readAt(r.index, offset + Int64(from), length)
+                default: return nil
+                }
+            }
+            // 基准中 [from, from + length) 的内容
+            func readBase(_ from: Int, _ length: Int) -> Data? {
+                var result = Data()
+                var start = 0
+                for entry in r.base where result.count < length {
+                    let size: Int
+                    switch entry {
+                    case .inline(_, let l), .segment(_, let l): size = l
+                    default: return nil
+                    }
+                    defer { start += size }
+                    let lower = max(from + result.count, start), upper = min(from + length, start + size)
+                    if lower >= upper { continue }
+                    guard let chunk = readEntry(entry, lower - start, upper - lower) else { return nil }
+                    result.append(chunk)
+                }
+                return result.count == length ? result : nil
+            }
+            for entry in r.list {
+                switch entry {
+                case .inline(_, let length), .segment(_, let length):
+                    guard let chunk = readEntry(entry, 0, length) else { return false }
+                    body(chunk)
+                case .delta(_, _, let offset, let length):
+                    guard let delta = readAt(r.index, offset, length), BodyDelta.apply(delta, readBase: readBase, body) else { return false }
+                case .ref:
+                    break
+                }
+            }
+            return true
+        }
+    }
+}
@@ -0,0 +1,306 @@
+//
+//  CaptureStage.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/6/30.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import NIO
+import NIOConcurrencyHelpers
+import AxLogger
+
+// 抓包写入阶段
+// EventLoop 只把 (会话 id, 方向, ByteBuffer 切片) 放入本线程的有界环形队列，由抓包线程写入 BodyStore
+// 每个环只有一个生产者（所属 EventLoop）和一个消费者（分配到的抓包线程），读写位置用原子变量，不加锁
+// 转发延迟不再受磁盘延迟影响；队列满时按 overflowPolicy 处理，EventLoop 上从不等待
+// 结束标记和丢弃标记不能丢，环满时放入加锁的溢出链表，抓包线程处理完环中的记录后再处理链表，顺序不变
+final class CaptureStage {
+
+    // 队列满时的处理方式
+    enum OverflowPolicy {
+        case dropBodies     // 丢弃这个 body 剩下的分片，只保存已写入的前一部分并标记为截断
+        case overflow       // 放入溢出链表，保证 body 完整；内存不受 ringByteLimit 限制
+    }
+
+    struct Record {
+        let folder: String
+        let sessionID: Int
+        let isReq: Bool
+        let buffer: ByteBuffer?     // nil 表示 body 结束
+        let deltaKey: String?       // 差分模式下响应体的 method + URL
+        var discard = false         // 会话不保存，回收已写入的 body
+        var truncated = false       // 结束标记：这个 body 有分片因队列满被丢弃
+
+        init(folder: String, sessionID: Int, isReq: Bool, buffer: ByteBuffer?, deltaKey: String?) {
+            self.folder = folder
+            self.sessionID = sessionID
+            self.isReq = isReq
+            self.buffer = buffer
+            self.deltaKey = deltaKey
+        }
+    }
+
+    static let shared = CaptureStage()
+
+    static let ringCapacity = 1024                  // 每个 EventLoop 的记录数上限
+    static let ringByteLimit = 4 * 1024 * 1024      // 每个 EventLoop 排队中的 body 字节数上限
+    static let workerCount = 1
+
+    var overflowPolicy: OverflowPolicy = .dropBodies
+
+    private let lock = Lock()
+    private let localRing = ThreadSpecificVariable<Ring>()
+    private var workers = [Worker]()
+    private var nextWorker = 0
+
+    let droppedRecords = Atomic<Int>(value: 0)
+    let droppedBytes = Atomic<Int>(value: 0)
+
+    private init() {
+        for i in 0..<CaptureStage.workerCount {
+            workers.append(Worker(name: "Knot.Capture.\(i)"))
+        }
+    }
+
+    // EventLoop 上调用
+    func submit(folder: String, sessionID: Int, isReq: Bool, buffer: ByteBuffer, deltaKey: String? = nil) {
+        let ring = currentRing()
+        let key = sessionID * 2 + (isReq ? 0 : 1)
+        // 已经丢过分片的 body 后面的分片也丢弃，保存的内容只缺结尾，不会中间缺一段
+        if ring.truncated.contains(key) {
+            _ = droppedRecords.add(1)
+            _ = droppedBytes.add(buffer.readableBytes)
+            return
+        }
+        let record = Record(folder: folder, sessionID: sessionID, isReq: isReq, buffer: buffer, deltaKey: deltaKey)
+        if ring.push(record) {
+            ring.worker.wake()
+            return
+        }
+        switch overflowPolicy {
+        case .dropBodies:
+            ring.truncated.insert(key)
+            _ = droppedRecords.add(1)
+            _ = droppedBytes.add(buffer.readableBytes)
+        case .overflow:
+            ring.pushOverflow(record)
+            ring.worker.wake()
+        }
+    }
+
+    // body 结束标记：抓包线程写完前面的分片后计算摘要去重；截断的 body 不去重、不做差分
+    func finish(folder: String, sessionID: Int, isReq: Bool) {
+        var record = Record(folder: folder, sessionID: sessionID, isReq: isReq, buffer: nil, deltaKey: nil)
+        record.truncated = currentRing().truncated.remove(sessionID * 2 + (isReq ? 0 : 1)) != nil
+        pushMarker(record)
+    }
+
+    // 会话被抓包过滤丢弃：排在这个会话已提交的分片之后，由抓包线程回收
+    // 两个方向的截断记录一起清掉，之后不会再有结束标记
+    func discard(folder: String, sessionID: Int) {
+        let ring = currentRing()
+        ring.truncated.remove(sessionID * 2)
+        ring.truncated.remove(sessionID * 2 + 1)
+        var record = Record(folder: folder, sessionID: sessionID, isReq: true, buffer: nil, deltaKey: nil)
+        record.discard = true
+        pushMarker(record)
+    }
+
+    private func pushMarker(_ record: Record) {
+        let ring = currentRing()
+        if !ring.push(record) {
+            ring.pushOverflow(record)
+        }
+        ring.worker.wake()
+    }
+
+    private func currentRing() -> Ring {
+        if let ring = localRing.currentValue { return ring }
+        let ring: Ring = lock.withLock {
+            let worker = workers[nextWorker % workers.count]
+            nextWorker += 1
+            let ring = Ring(capacity: CaptureStage.ringCapacity, byteLimit: CaptureStage.ringByteLimit, worker: worker)
+            worker.attach(ring)
+            return ring
+        }
+        localRing.currentValue = ring
+        return ring
+    }
+
+    // 等待已提交的记录全部写入，服务关闭时调用
+    func flushNow() {
+        workers.forEach { $0.flush() }
+        let dropped = droppedRecords.load()
+        if dropped > 0 {
+            AxLogger.log("Capture dropped \(dropped) body chunks, \(droppedBytes.load()) bytes", level: .Warning)
+        }
+    }
+
+    // MARK: - ring
+
+    final class Ring {
+        let worker: Worker
+        private let capacity: Int
+        private let byteLimit: Int
+        private let slots: UnsafeMutablePointer<Record?>
+        private let head = Atomic<Int>(value: 0)    // 只由消费者推进
+        private let tail = Atomic<Int>(value: 0)    // 只由生产者推进
+        private let pendingBytes = Atomic<Int>(value: 0)
+        private let overflowLock = Lock()
+        private var overflow = [Record]()
+        private let overflowCount = Atomic<Int>(value: 0)
+        private let submitted = Atomic<Int>(value: 0)
+        private let processed = Atomic<Int>(value: 0)
+        var truncated = Set<Int>()      // 只由生产者访问：丢过分片、还没结束的 body，key = sessionID * 2 + 方向
+
+        init(capacity: Int, byteLimit: Int, worker: Worker) {
+            self.capacity = capacity
+            self.byteLimit = byteLimit
+            self.worker = worker
+            slots = UnsafeMutablePointer<Record?>.allocate(capacity: capacity)
+            slots.initialize(repeating: nil, count: capacity)
+        }
+
+        deinit {
+            slots.deinitialize(count: capacity)
+            slots.deallocate()
+        }
+
+        var isEmpty: Bool {
+            return head.load() == tail.load() && overflowCount.load() == 0
+        }
+
+        var position: Int {
+            return submitted.load()
+        }
+
+        var consumed: Int {
+            return processed.load()
+        }
+
+        // 生产者调用；单个超过上限的 body 在队列为空时仍然放入，避免永远写不进去
+        // 溢出链表不为空时不再放入环中，保证后提交的记录不会先被处理
+        func push(_ record: Record) -> Bool {
+            if overflowCount.load() > 0 { return false }
+            let tail = self.tail.load()
+            if tail - head.load() >= capacity { return false }
+            let bytes = record.buffer?.readableBytes ?? 0
+            let pending = pendingBytes.load()
+            if pending > 0, pending + bytes > byteLimit { return false }
+            slots[tail % capacity] = record
+            _ = pendingBytes.add(bytes)
+            _ = submitted.add(1)
+            self.tail.store(tail + 1)
+            return true
+        }
+
+        // 生产者调用，不受容量限制
+        func pushOverflow(_ record: Record) {
+            overflowLock.withLockVoid {
+                overflow.append(record)
+                _ = submitted.add(1)
+                _ = overflowCount.add(1)
+            }
+        }
+
+        // 消费者调用，返回处理的记录数；溢出链表中的记录都晚于环中的记录
+        func drain(_ body: (Record) -> Void) -> Int {
+            let head = self.head.load()
+            let tail = self.tail.load()
+            for i in head..<tail {
+                let index = i % capacity
+                let record = slots[index]!
+                slots[index] = nil
+                body(record)
+                _ = pendingBytes.add(-(record.buffer?.readableBytes ?? 0))
+                self.head.store(i + 1)
+                _ = processed.add(1)
+            }
+            var count = tail - head
+            if overflowCount.load() > 0, self.tail.load() == tail {
+                let list: [Record] = overflowLock.withLock {
+                    let list = overflow
+                    overflow.removeAll()
+                    _ = overflowCount.add(-list.count)
+                    return list
+                }
+                for record in list {
+                    body(record)
+                    _ = processed.add(1)
+                }
+                count += list.count
+            }
+            return count
+        }
+    }
+
+    // MARK: - worker
+
+    final class Worker {
+        private let lock = Lock()
+        private var rings = [Ring]()
+        private let semaphore = DispatchSemaphore(value: 0)
+        private let sleeping = Atomic<Bool>(value: false)
+
+        init(name: String) {
+            let thread = Thread { [unowned self] in self.run() }
+            thread.name = name
+            thread.qualityOfService = .utility
+            thread.start()
+        }
+
+        func attach(_ ring: Ring) {
+            lock.withLockVoid { rings.append(ring) }
+        }
+
+        // 只在抓包线程进入等待后才发信号，避免每条记录一次系统调用
+        func wake() {
+            if sleeping.load(), sleeping.exchange(with: false) {
+                semaphore.signal()
+            }
+        }
+
+        private func run() {
+            while true {
+                let current = lock.withLock { rings }
+                var count = 0
+                for ring in current {
+                    count += ring.drain(write)
+                }
+                if count > 0 { continue }
+                sleeping.store(true)
+                // 进入等待前再检查一次，防止漏掉刚放入的记录
+                if current.contains(where: { !$0.isEmpty }) || lock.withLock({ rings.count }) != current.count {
+                    sleeping.store(false)
+                    continue
+                }
+                _ = semaphore.wait(timeout: .now() + .milliseconds(100))
+                sleeping.store(false)
+            }
+        }
+
+        private func write(_ record: Record) {
+            guard let store = BodyStore.store(for: record.folder) else { return }
+            if let buffer = record.buffer {
+                store.append(sessionID: record.sessionID, isReq: record.isReq, buffer: buffer, deltaKey: record.deltaKey)
+            } else if record.discard {
+                store.discard(sessionID: record.sessionID)
+            } else {
+                store.finish(sessionID: record.sessionID, isReq: record.isReq, truncated: record.truncated)
+            }
+        }
+
+        // 等待调用时已提交的记录全部写完
+        func flush() {
+            let targets = lock.withLock { rings.map { ($0, $0.position) } }
+            for (ring, position) in targets {
+                while ring.consumed < position {
+                    wake()
+                    usleep(1000)
+                }
+            }
+        }
+    }
+}
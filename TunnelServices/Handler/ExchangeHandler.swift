@@ -49,8 +49,25 @@ class ExchangeHandler: ChannelInboundHandler, RemovableChannelHandler {
                 proxyContext.session.suffix = ss.components(separatedBy: "/").last ?? ""
             }
             proxyContext.session.rspEncoding = head.headers["Content-Encoding"].first ?? ""
-            proxyContext.session.rspHeads = Session.getHeadsJson(headers: head.headers)//
+            proxyContext.session.rspHeadBlock = HeaderBlock.encode(head.headers)
             proxyContext.session.rspDisposition = head.headers["Content-Disposition"].first ?? ""
+            // 按抓包过滤表达式决定保存方式
+            if !proxyContext.session.ignore {
+                let input = CaptureInput(status: Int(head.status.code),
+                                         size: CaptureInput.contentLength(head.headers),
+                                         rspType: contentType,
+                                         rspEncoding: proxyContext.session.rspEncoding,
+                                         host: proxyContext.session.host ?? "",
+                                         method: proxyContext.session.methods ?? "")
+                switch proxyContext.task.rule.captureMode(input) {
+                case .full:
+                    break
+                case .headers:
+                    proxyContext.session.dropRequestBody()
+                case .none:
+                    proxyContext.session.discard()
+                }
+            }
             try? proxyContext.session.saveToDB()
             
             _ = proxyContext.serverChannel?.writeAndFlush(HTTPServerResponsePart.head(head))
@@ -75,7 +92,7 @@ class ExchangeHandler: ChannelInboundHandler, RemovableChannelHandler {
             if body.readableBytes > 1024*1024 {
                 print("超大：\(body.readableBytes)")
             }
-            if !proxyContext.session.ignore {
+            if !proxyContext.session.ignore, proxyContext.session.captureBody {
                 proxyContext.session.writeBody(type: .RSP, buffer: body, realName: proxyContext.session.fileName)
             }
             _ = proxyContext.serverChannel?.writeAndFlush(HTTPServerResponsePart.body(.byteBuffer(body)))
@@ -85,7 +102,7 @@ class ExchangeHandler: ChannelInboundHandler, RemovableChannelHandler {
             proxyContext.session.rspEndTime = NSNumber(value: Date().timeIntervalSince1970) // 接收完毕响应
             gotEnd = true
             // TODO:关闭写文件
-            if !proxyContext.session.ignore {
+            if !proxyContext.session.ignore, proxyContext.session.captureBody {
                 proxyContext.session.writeBody(type: .RSP, buffer: nil, realName: proxyContext.session.fileName )
             }
             let promise = proxyContext.serverChannel?.eventLoop.makePromise(of: Void.self)
@@ -50,17 +50,13 @@ class HTTPHandler : ChannelInboundHandler, RemovableChannelHandler {
             proxyContext.session.uri = head.uri//
             proxyContext.session.reqHttpVersion = "\(head.version)"//
             proxyContext.session.target = Session.getUserAgent(target: head.headers["User-Agent"].first)
-            proxyContext.session.reqHeads = Session.getHeadsJson(headers: head.headers)
+            proxyContext.session.reqHeadBlock = HeaderBlock.encode(head.headers)
             proxyContext.session.reqEncoding = head.headers["Content-Encoding"].first ?? ""
             proxyContext.session.reqType = head.headers["Content-Type"].first ?? ""
             
             // 判断规则，是否拦截，copy等
             if !proxyContext.request!.ssl {
-                proxyContext.session.ignore = proxyContext.task.rule.matching(host: proxyContext.session.host ?? "",uri: head.uri, target: proxyContext.session.target ?? "")
-//                print("HTTPHandler匹配")
-                if proxyContext.task.rule.defaultStrategy == .COPY {
-                    proxyContext.session.ignore = !proxyContext.session.ignore
-                }
+                proxyContext.session.ignore = proxyContext.task.rule.strategy(host: proxyContext.session.host ?? "",uri: head.uri, target: proxyContext.session.target ?? "") == .DIRECT
             }
             try? proxyContext.session.saveToDB()
             
@@ -85,14 +81,14 @@ class HTTPHandler : ChannelInboundHandler, RemovableChannelHandler {
         case .body(let body):
             // TODO:修改请求体
             // let newBody = changeBody(body)
-            if !proxyContext.session.ignore {
+            if !proxyContext.session.ignore, proxyContext.session.captureBody {
                 proxyContext.session.writeBody(type: .REQ, buffer: body)
             }
             handleData(body)
             break
         case .end(let end):
             // TODO:结束写reqbody文件
-            if !proxyContext.session.ignore {
+            if !proxyContext.session.ignore, proxyContext.session.captureBody {
                 proxyContext.session.writeBody(type: .REQ, buffer: nil)
             }
             handleData(end,isEnd: true)
@@ -158,6 +154,14 @@ class HTTPHandler : ChannelInboundHandler, RemovableChannelHandler {
                 self.proxyContext.clientChannel = outChannel
                 self.proxyContext.session.outState = "open"
                 self.proxyContext.session.remoteAddress = Session.getIPAddress(socketAddress: outChannel.remoteAddress)
+                // IP-CIDR 规则需要拿到远程地址后再匹配，命中时与域名规则命中的处理一致
+                if let strategy = self.proxyContext.task.rule.strategy(address: outChannel.remoteAddress) {
+                    let ignore = strategy == .DIRECT
+                    if ignore, !self.proxyContext.session.ignore {
+                        self.proxyContext.session.discard()
+                    }
+                    self.proxyContext.session.ignore = ignore
+                }
                 
                 if !request.ssl {
 //                    print("《------\(self.proxyContext)------》:HTTP与外部服务器连接成功！")
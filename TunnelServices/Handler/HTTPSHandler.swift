@@ -66,7 +66,7 @@ class HTTPSHandler: ChannelInboundHandler, RemovableChannelHandler {
                 proxyContext.session.uri = head.uri//
                 proxyContext.session.reqHttpVersion = "\(head.version)"//
                 proxyContext.session.target = Session.getUserAgent(target: head.headers["User-Agent"].first)
-                proxyContext.session.reqHeads = Session.getHeadsJson(headers: head.headers)// //
+                proxyContext.session.reqHeadBlock = HeaderBlock.encode(head.headers)
                 proxyContext.session.connectTime = NSNumber(value: Date().timeIntervalSince1970)  // 开始建立连接
                 //TODO:判断是否匹配
                 
@@ -93,11 +93,12 @@ class HTTPSHandler: ChannelInboundHandler, RemovableChannelHandler {
                     context.channel.close(mode: .all,promise: nil)
                 }
                 // 判断规则，是否拦截，copy等
-                proxyContext.session.ignore = proxyContext.task.rule.matching(host: proxyContext.session.host ?? "",uri: head.uri, target: proxyContext.session.target ?? "")
-//                print("HTTPSHandler匹配")
-                if proxyContext.task.rule.defaultStrategy == .COPY {
-                    proxyContext.session.ignore = !proxyContext.session.ignore
+                var strategy = proxyContext.task.rule.strategy(host: proxyContext.session.host ?? "",uri: head.uri, target: proxyContext.session.target ?? "")
+                // 目标是 IP 时 IP-CIDR 规则在这里匹配，命中 COPY 的才能解密；域名目标连接后才匹配，已经不能解密
+                if let cidrStrategy = proxyContext.task.rule.strategy(ip: proxyContext.session.host ?? "") {
+                    strategy = cidrStrategy
                 }
+                proxyContext.session.ignore = strategy == .DIRECT
                 if proxyContext.task.sslEnable == 1, !proxyContext.session.ignore {
                     _ = context.pipeline.addHandler(SSLHandler(proxyContext: proxyContext,scheduled:cancelTask), name: "SSLHandler", position: .first)
                 }else{
@@ -55,12 +55,13 @@ public class LocalHTTPServer {
     
     func newBootstrap() -> ServerBootstrap {
         let fileIO = NonBlockingFileIO(threadPool: threadPool!)
+        let fileCache = StaticFileCache(threadPool: threadPool!)
         let bootstrap = ServerBootstrap(group: group)
             .serverChannelOption(ChannelOptions.backlog, value: 256)
             .serverChannelOption(ChannelOptions.socket(SocketOptionLevel(SOL_SOCKET), SO_REUSEADDR), value: 1)
             .childChannelInitializer { channel in
                 channel.pipeline.configureHTTPServerPipeline(withErrorHandling: true).flatMap {
-                    channel.pipeline.addHandler(HTTPServerHandler(fileIO: fileIO, htdocsPath: self.htdocs))
+                    channel.pipeline.addHandler(HTTPServerHandler(fileIO: fileIO, fileCache: fileCache, htdocsPath: self.htdocs))
                 }
             }
             .childChannelOption(ChannelOptions.socket(IPPROTO_TCP, TCP_NODELAY), value: 1)
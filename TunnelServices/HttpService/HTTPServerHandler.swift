@@ -93,11 +93,13 @@ class HTTPServerHandler: ChannelInboundHandler {
     private var handler: ((ChannelHandlerContext, HTTPServerRequestPart) -> Void)?
     private var handlerFuture: EventLoopFuture<Void>?
     private let fileIO: NonBlockingFileIO
+    private let fileCache: StaticFileCache
     private let defaultResponse = "Hello NIO\r\n"
     
-    public init(fileIO: NonBlockingFileIO, htdocsPath: String) {
+    public init(fileIO: NonBlockingFileIO, fileCache: StaticFileCache, htdocsPath: String) {
         self.htdocsPath = htdocsPath
         self.fileIO = fileIO
+        self.fileCache = fileCache
     }
     
     private func handleFile(context: ChannelHandlerContext, request: HTTPServerRequestPart, ioMethod: FileIOMethod, path: String) {
@@ -127,9 +129,9 @@ class HTTPServerHandler: ChannelInboundHandler {
             context.channel.close(promise: nil)
         }
         
-        func responseHead(request: HTTPRequestHead, fileRegion region: FileRegion, path:String) -> HTTPResponseHead {
+        func responseHead(request: HTTPRequestHead, contentLength: Int, path:String) -> HTTPResponseHead {
             var response = httpResponseHead(request: request, status: .ok)
-            response.headers.add(name: "Content-Length", value: "\(region.endIndex)")
+            response.headers.add(name: "Content-Length", value: "\(contentLength)")
             if path.lowercased().contains(".pem") {
                 response.headers.add(name: "Content-Type", value: "application/x-x509-ca-cert")
                 response.headers.add(name: "Content-Disposition", value: "filename=nio-ca-certificate-\(Date().fullSting).pem")
@@ -141,17 +143,7 @@ class HTTPServerHandler: ChannelInboundHandler {
             return response
         }
         
-        switch request {
-        case .head(let request):
-            self.keepAlive = request.isKeepAlive
-            self.state.requestReceived()
-            guard !request.uri.containsDotDot() else {
-                let response = httpResponseHead(request: request, status: .forbidden)
-                context.write(self.wrapOutboundOut(.head(response)), promise: nil)
-                self.completeResponse(context, trailers: nil, promise: nil)
-                return
-            }
-            let path = self.htdocsPath + "/" + (path == "/" ? "/index.html" : path)
+        func streamFile(request: HTTPRequestHead, path: String) {
             let fileHandleAndRegion = self.fileIO.openFile(path: path, eventLoop: context.eventLoop)
             fileHandleAndRegion.whenFailure {
                 sendErrorResponse(request: request, $0)
@@ -160,7 +152,7 @@ class HTTPServerHandler: ChannelInboundHandler {
                 switch ioMethod {
                 case .nonblockingFileIO:
                     var responseStarted = false
-                    let response = responseHead(request: request, fileRegion: region, path: path)
+                    let response = responseHead(request: request, contentLength: region.endIndex, path: path)
                     if region.readableBytes == 0 {
                         responseStarted = true
                         context.write(self.wrapOutboundOut(.head(response)), promise: nil)
@@ -194,7 +186,7 @@ class HTTPServerHandler: ChannelInboundHandler {
                             _ = try? file.close()
                     }
                 case .sendfile:
-                    let response = responseHead(request: request, fileRegion: region, path: path)
+                    let response = responseHead(request: request, contentLength: region.endIndex, path: path)
                     context.write(self.wrapOutboundOut(.head(response)), promise: nil)
                     context.writeAndFlush(self.wrapOutboundOut(.body(.fileRegion(region)))).flatMap {
                         let p = context.eventLoop.makePromise(of: Void.self)
@@ -207,11 +199,41 @@ class HTTPServerHandler: ChannelInboundHandler {
                     }
                 }
             }
+        }
+        
+        switch request {
+        case .head(let request):
+            self.keepAlive = request.isKeepAlive
+            self.state.requestReceived()
+            guard !request.uri.containsDotDot() else {
+                let response = httpResponseHead(request: request, status: .forbidden)
+                context.write(self.wrapOutboundOut(.head(response)), promise: nil)
+                self.completeResponse(context, trailers: nil, promise: nil)
+                return
+            }
+            let path = self.htdocsPath + "/" + (path == "/" ? "/index.html" : path)
+            // 小文件从缓存整块返回，大文件才分块读取
+            self.fileCache.load(path: path, eventLoop: context.eventLoop).whenComplete { result in
+                switch result {
+                case .failure(let error):
+                    sendErrorResponse(request: request, error)
+                case .success(.some(let buffer)):
+                    let response = responseHead(request: request, contentLength: buffer.readableBytes, path: path)
+                    context.write(self.wrapOutboundOut(.head(response)), promise: nil)
+                    if buffer.readableBytes > 0 {
+                        context.write(self.wrapOutboundOut(.body(.byteBuffer(buffer))), promise: nil)
+                    }
+                    self.completeResponse(context, trailers: nil, promise: nil)
+                case .success(.none):
+                    streamFile(request: request, path: path)
+                }
+            }
         case .end:
             self.state.requestComplete()
         default:
             fatalError("oh noes: \(request)")
         }
+
     }
     
     private func completeResponse(_ context: ChannelHandlerContext, trailers: HTTPHeaders?, promise: EventLoopPromise<Void>?) {
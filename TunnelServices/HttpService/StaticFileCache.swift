@@ -0,0 +1,107 @@
+//
+//  StaticFileCache.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/6/30.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import NIO
+import NIOConcurrencyHelpers
+
+// 本地 HTTP 服务的小文件缓存
+// NonBlockingFileIO 每次请求要 open、每 32KB 一次 read、再 close，每一步都是一次线程池切换
+// 这里把 stat + open + read + close 合并成线程池中的一个任务，读到的内容缓存起来，
+// revalidateInterval 内的重复请求直接在 EventLoop 上返回，不再访问文件
+// 超过 maxFileSize 的文件返回 nil，仍走 NonBlockingFileIO 分块读取
+final class StaticFileCache {
+
+    static let maxFileSize = 1024 * 1024
+    static let maxTotalSize = 8 * 1024 * 1024
+    static let revalidateInterval: TimeInterval = 1
+
+    private struct Entry {
+        let buffer: ByteBuffer
+        let size: Int
+        let modifyTime: timespec
+        var checkedAt: TimeInterval
+    }
+
+    private let threadPool: NIOThreadPool
+    private let allocator = ByteBufferAllocator()
+    private let lock = Lock()
+    private var entries = [String: Entry]()
+    private var totalSize = 0
+
+    init(threadPool: NIOThreadPool) {
+        self.threadPool = threadPool
+    }
+
+    func load(path: String, eventLoop: EventLoop) -> EventLoopFuture<ByteBuffer?> {
+        let now = Date().timeIntervalSince1970
+        let cached: ByteBuffer? = lock.withLock {
+            guard let entry = entries[path], now - entry.checkedAt < StaticFileCache.revalidateInterval else { return nil }
+            return entry.buffer
+        }
+        if let buffer = cached {
+            return eventLoop.makeSucceededFuture(buffer)
+        }
+        return threadPool.runIfActive(eventLoop: eventLoop) {
+            try self.read(path: path, now: now)
+        }
+    }
+
+    // 线程池中执行
+    private func read(path: String, now: TimeInterval) throws -> ByteBuffer? {
+        var st = stat()
+        guard stat(path, &st) == 0 else {
+            throw IOError(errnoCode: errno, reason: "stat")
+        }
+        let size = Int(st.st_size)
+        guard size <= StaticFileCache.maxFileSize else { return nil }
+        let modifyTime = st.st_mtimespec
+        let unchanged: ByteBuffer? = lock.withLock {
+            guard var entry = entries[path], entry.size == size,
+                entry.modifyTime.tv_sec == modifyTime.tv_sec, entry.modifyTime.tv_nsec == modifyTime.tv_nsec else {
+                return nil
+            }
+            entry.checkedAt = now
+            entries[path] = entry
+            return entry.buffer
+        }
+        if let buffer = unchanged { return buffer }
+
+        let fd = open(path, O_RDONLY)
+        guard fd >= 0 else {
+            throw IOError(errnoCode: errno, reason: "open")
+        }
+        defer { close(fd) }
+        var buffer = allocator.buffer(capacity: size)
+        var remaining = size
+        while remaining > 0 {
+            var readErrno: Int32 = 0
+            let count = buffer.writeWithUnsafeMutableBytes { pointer -> Int in
+                let count = Darwin.read(fd, pointer.baseAddress, min(remaining, pointer.count))
+                if count < 0 { readErrno = errno }
+                return max(count, 0)
+            }
+            if readErrno == EINTR { continue }
+            if readErrno != 0 { throw IOError(errnoCode: readErrno, reason: "read") }
+            if count == 0 { break }     // 读的过程中文件变短
+            remaining -= count
+        }
+        lock.withLockVoid {
+            if let old = entries.removeValue(forKey: path) {
+                totalSize -= old.size
+            }
+            if totalSize + size > StaticFileCache.maxTotalSize {
+                entries.removeAll()
+                totalSize = 0
+            }
+            entries[path] = Entry(buffer: buffer, size: size, modifyTime: modifyTime, checkedAt: now)
+            totalSize += size
+        }
+        return buffer
+    }
+}
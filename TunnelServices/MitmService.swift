@@ -66,6 +66,8 @@ public class MitmService: NSObject {
         super.init()
         
         self.task = task
+        // 规则快照在这里编译好，不留到第一个连接的 EventLoop 上
+        task.rule.publishSnapshot()
         
         let protocolDetector = ProtocolDetector(task: task ,matchers: [HttpMatcher(),HttpsMatcher(),SSLMatcher()])
         
@@ -91,7 +93,8 @@ public class MitmService: NSObject {
     }
     
     public static func prepare() -> MitmService? {
-        // 数据库设置
+        // 数据库设置，Tunnel 只写不做界面查询，不开只读连接池
+        ASConfigration.readerCount = 0
         ASConfigration.setDefaultDB(path: MitmService.getDBPath(), name: "Session")
         ASConfigration.logLevel = .error
         // 日志记录
@@ -156,6 +159,11 @@ public class MitmService: NSObject {
         task.numberOfUse = NSNumber(value: task.numberOfUse.intValue + 1)
         
         try? task.update()
+        // 先启动 checkpointer，Task 分库建好后加入
+        ASConfigration.startCheckpointer()
+        SessionWriter.shared.prepare(taskID: task.id?.intValue, folder: task.fileFolder)
+        StoragePurger.shared.start(activeTaskID: task.id?.intValue)
+        BodyStore.deltaEncoding = BodyStorageOptions.current.deltaEncoding
         
         if task.localEnable == 1 {
             DispatchQueue.global().async {
@@ -324,6 +332,15 @@ public class MitmService: NSObject {
         
         try? task.update()
         
+        StoragePurger.shared.stop()
+        SessionWriter.shared.flushNow()
+        CaptureStage.shared.flushNow()
+        BodyStore.closeAll()
+        ASConfigration.stopCheckpointer()
+        
+        let ruleMetrics = task.rule.decisionCacheMetrics
+        AxLogger.log("Rule decision cache hits:\(ruleMetrics.hits) misses:\(ruleMetrics.misses) hitRate:\(ruleMetrics.hitRate) lookup:\(ruleMetrics.averageLookupNanos)ns", level: .Info)
+        
         if let callback = completionHandler {
             callback()
         }
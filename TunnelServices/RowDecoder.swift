@@ -0,0 +1,82 @@
+//
+//  RowDecoder.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/7/3.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import SQLite
+import SQLite3
+
+// 查询结果按列下标直接解码成模型
+// 每条语句只按列名查一次字段表，之后每一行按下标用 sqlite3_column_* 读出原生类型，
+// 不再经过 SQLite.swift 的 [Binding?] 装箱、逐列比较列名字符串、再 as? 转换
+// NULL 列不调用 setter，字段保持模型的默认值
+final class RowDecoder<Model> {
+
+    typealias Setter = (Model, OpaquePointer, Int32) -> Void
+
+    private let make: () -> Model
+    private let fields: [String: Setter]
+
+    init(_ make: @escaping () -> Model, _ fields: [String: Setter]) {
+        self.make = make
+        self.fields = fields
+    }
+
+    func decode(_ db: Connection, _ sql: String) throws -> [Model] {
+        var handle: OpaquePointer?
+        let code = sqlite3_prepare_v2(db.handle, sql, -1, &handle, nil)
+        guard code == SQLITE_OK, let statement = handle else {
+            throw SQLite.Result.error(message: String(cString: sqlite3_errmsg(db.handle)), code: code, statement: nil)
+        }
+        defer { sqlite3_finalize(statement) }
+        // 列名 -> 字段，只在这里解析一次，查询中没有的列和未知的列（searchRank 等）直接跳过
+        var bound = [(Int32, Setter)]()
+        for i in 0..<sqlite3_column_count(statement) {
+            if let name = sqlite3_column_name(statement, i), let setter = fields[String(cString: name)] {
+                bound.append((i, setter))
+            }
+        }
+        var models = [Model]()
+        while true {
+            let code = sqlite3_step(statement)
+            if code == SQLITE_DONE { break }
+            guard code == SQLITE_ROW else {
+                throw SQLite.Result.error(message: String(cString: sqlite3_errmsg(db.handle)), code: code, statement: nil)
+            }
+            let model = make()
+            for (i, setter) in bound {
+                setter(model, statement, i)
+            }
+            models.append(model)
+        }
+        return models
+    }
+
+    // MARK: - 字段
+
+    static func number(_ set: @escaping (Model, NSNumber) -> Void) -> Setter {
+        return { model, statement, i in
+            switch sqlite3_column_type(statement, i) {
+            case SQLITE_INTEGER: set(model, NSNumber(value: sqlite3_column_int64(statement, i)))
+            case SQLITE_FLOAT: set(model, NSNumber(value: sqlite3_column_double(statement, i)))
+            default: break
+            }
+        }
+    }
+}
+
+extension RowDecoder where Model: ASModel {
+
+    // 字段表由模型的 ASBinding 生成，extra 补充查询里的别名列（如 Task 的统计列）
+    convenience init(_ make: @escaping () -> Model, bindings: [ASBinding], _ extra: [String: Setter] = [:]) {
+        var fields = [String: Setter]()
+        for binding in bindings {
+            fields[binding.column] = { binding.decodeStatement($0, $1, $2) }
+        }
+        self.init(make, fields.merging(extra) { $1 })
+    }
+}
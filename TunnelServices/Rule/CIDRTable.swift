@@ -0,0 +1,250 @@
+//
+//  CIDRTable.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/6/22.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import NIO
+
+// IP-CIDR 最长前缀匹配表（poptrie）
+// 每个节点 6 bit 步长，用两个 64 位位图 + popcount 定位子节点和叶子，叶子按连续相同值压缩
+// IPv4、IPv6 各一棵树，IPv4 最多 6 层，IPv6 最多 22 层
+final class CIDRTable {
+
+    struct Node {
+        var vector: UInt64 = 0      // 第 i 位为 1：槽位 i 是内部节点
+        var leafvec: UInt64 = 0     // 第 i 位为 1：槽位 i 开始一段新的叶子
+        var base0: UInt32 = 0       // 叶子起始下标
+        var base1: UInt32 = 0       // 子节点起始下标
+    }
+
+    // 编译后的一棵树
+    struct Trie {
+        var nodes = [Node(vector: 0, leafvec: 1, base0: 0, base1: 0)]
+        var leaves: [Int32] = [-1]  // 规则序号，-1 表示未命中
+
+        @inline(__always)
+        func lookup(_ hi: UInt64, _ lo: UInt64) -> Int32 {
+            var index = 0
+            var offset = 0
+            while true {
+                let node = nodes[index]
+                let bit: UInt64 = 1 << UInt64(CIDRTable.chunk(hi, lo, offset))
+                let mask = (bit << 1) &- 1
+                if node.vector & bit != 0 {
+                    index = Int(node.base1) + (node.vector & mask).nonzeroBitCount - 1
+                    offset += 6
+                } else {
+                    return leaves[Int(node.base0) + (node.leafvec & mask).nonzeroBitCount - 1]
+                }
+            }
+        }
+    }
+
+    private(set) var v4 = Trie()
+    private(set) var v6 = Trie()
+    private(set) var count = 0
+
+    var isEmpty: Bool {
+        return count == 0
+    }
+
+    // 前缀：hi/lo 为 128 位地址的高低 64 位（IPv4 放在 hi 的高 32 位），value 为规则序号
+    struct Prefix {
+        var hi: UInt64
+        var lo: UInt64
+        var length: Int
+        var value: Int32
+    }
+
+    init(items: [RuleItem]) {
+        var prefixes4 = [Prefix]()
+        var prefixes6 = [Prefix]()
+        for item in items where item.matchRule == .IPCIDR {
+            guard let parsed = CIDRTable.parse(item.value) else {
+                print("Invalid IP-CIDR:\(item.value)")
+                continue
+            }
+            let prefix = Prefix(hi: parsed.hi, lo: parsed.lo, length: parsed.length, value: Int32(item.index))
+            if parsed.isV6 { prefixes6.append(prefix) } else { prefixes4.append(prefix) }
+        }
+        count = prefixes4.count + prefixes6.count
+        v4 = CIDRTable.build(prefixes4)
+        v6 = CIDRTable.build(prefixes6)
+    }
+
+    init(v4 prefixes4: [Prefix], v6 prefixes6: [Prefix]) {
+        count = prefixes4.count + prefixes6.count
+        v4 = CIDRTable.build(prefixes4)
+        v6 = CIDRTable.build(prefixes6)
+    }
+
+    // MARK: - lookup
+
+    // 返回命中的最长前缀对应的规则序号
+    func lookup(_ address: SocketAddress?) -> Int? {
+        guard let address = address else { return nil }
+        let value: Int32
+        switch address {
+        case .v4(let addr):
+            let ip = UInt64(UInt32(bigEndian: addr.address.sin_addr.s_addr))
+            value = v4.lookup(ip << 32, 0)
+        case .v6(let addr):
+            var in6 = addr.address.sin6_addr
+            let words = withUnsafeBytes(of: &in6) { CIDRTable.words($0) }
+            value = lookup(words.hi, words.lo, isV6: true)
+        case .unixDomainSocket:
+            return nil
+        }
+        return value < 0 ? nil : Int(value)
+    }
+
+    // 字符串地址，如 Session.getRemoteIPAddress() 的结果
+    func lookup(_ ip: String) -> Int? {
+        guard let parsed = CIDRTable.parse(ip) else { return nil }
+        let value = lookup(parsed.hi, parsed.lo, isV6: parsed.isV6)
+        return value < 0 ? nil : Int(value)
+    }
+
+    // ::ffff:a.b.c.d（双栈 socket 上的 IPv4 连接）按 IPv4 查
+    private func lookup(_ hi: UInt64, _ lo: UInt64, isV6: Bool) -> Int32 {
+        guard isV6 else { return v4.lookup(hi, lo) }
+        if hi == 0, lo >> 32 == 0xffff {
+            return v4.lookup(lo << 32, 0)
+        }
+        return v6.lookup(hi, lo)
+    }
+
+    // MARK: - parse
+
+    // "10.0.0.0/8"、"2001:db8::/32"，不带长度时视为单个地址
+    static func parse(_ value: String) -> (hi: UInt64, lo: UInt64, length: Int, isV6: Bool)? {
+        let parts = value.trimmingCharacters(in: .whitespaces).split(separator: "/", maxSplits: 1)
+        guard let ipPart = parts.first else { return nil }
+        let ip = ipPart.hasPrefix("[") && ipPart.hasSuffix("]") ? String(ipPart.dropFirst().dropLast()) : String(ipPart)
+        let isV6 = ip.contains(":")
+        var length = isV6 ? 128 : 32
+        if parts.count == 2 {
+            guard let l = Int(parts[1]), l >= 0, l <= length else { return nil }
+            length = l
+        }
+        if isV6 {
+            var in6 = in6_addr()
+            guard inet_pton(AF_INET6, ip, &in6) == 1 else { return nil }
+            let w = withUnsafeBytes(of: &in6) { words($0) }
+            return (w.hi, w.lo, length, true)
+        } else {
+            var in4 = in_addr()
+            guard inet_pton(AF_INET, ip, &in4) == 1 else { return nil }
+            let hi = UInt64(UInt32(bigEndian: in4.s_addr)) << 32
+            return (hi, 0, length, false)
+        }
+    }
+
+    private static func words(_ bytes: UnsafeRawBufferPointer) -> (hi: UInt64, lo: UInt64) {
+        var hi: UInt64 = 0
+        var lo: UInt64 = 0
+        for i in 0..<8 { hi = hi << 8 | UInt64(bytes[i]) }
+        for i in 8..<16 { lo = lo << 8 | UInt64(bytes[i]) }
+        return (hi, lo)
+    }
+
+    // 取 128 位地址中从 offset 开始的 6 bit，超出 128 位的部分补 0
+    @inline(__always)
+    static func chunk(_ hi: UInt64, _ lo: UInt64, _ offset: Int) -> Int {
+        if offset <= 58 {
+            return Int((hi >> UInt64(58 - offset)) & 0x3f)
+        }
+        if offset < 64 {
+            let loBits = UInt64(offset - 58)
+            return Int(((hi << loBits) | (lo >> (64 - loBits))) & 0x3f)
+        }
+        let o = offset - 64
+        if o <= 58 {
+            return Int((lo >> UInt64(58 - o)) & 0x3f)
+        }
+        return Int((lo << UInt64(o - 58)) & 0x3f)
+    }
+
+    // MARK: - build
+
+    // 构建用的未压缩节点，叶子已下推
+    private final class BuildNode {
+        var children = [BuildNode?](repeating: nil, count: 64)
+        var leaves: [Int32]
+        init(leaf: Int32) {
+            leaves = [Int32](repeating: leaf, count: 64)
+        }
+    }
+
+    private static func build(_ prefixes: [Prefix]) -> Trie {
+        if prefixes.isEmpty { return Trie() }
+        // 按前缀长度升序插入，长前缀覆盖短前缀；同长度时后面的规则不覆盖前面的
+        let sorted = prefixes.enumerated().sorted {
+            $0.element.length != $1.element.length ? $0.element.length < $1.element.length : $0.offset > $1.offset
+        }.map { $0.element }
+        let root = BuildNode(leaf: -1)
+        for prefix in sorted {
+            insert(root, prefix)
+        }
+        return compile(root)
+    }
+
+    private static func insert(_ root: BuildNode, _ prefix: Prefix) {
+        var node = root
+        var offset = 0
+        while prefix.length - offset > 6 {
+            let index = chunk(prefix.hi, prefix.lo, offset)
+            if let child = node.children[index] {
+                node = child
+            } else {
+                let child = BuildNode(leaf: node.leaves[index])
+                node.children[index] = child
+                node = child
+            }
+            offset += 6
+        }
+        // 当前节点内覆盖 2^(6-剩余长度) 个槽位；升序插入保证这些槽位下还没有子节点
+        let rest = prefix.length - offset
+        let span = 1 << (6 - rest)
+        let start = chunk(prefix.hi, prefix.lo, offset) & ~(span - 1)
+        for i in start..<(start + span) {
+            node.leaves[i] = prefix.value
+        }
+    }
+
+    // 广度优先展开，保证同一节点的子节点在数组中连续
+    private static func compile(_ root: BuildNode) -> Trie {
+        var trie = Trie()
+        trie.nodes = [Node()]
+        trie.leaves = []
+        var queue = [(root, 0)]
+        var head = 0
+        while head < queue.count {
+            let (buildNode, index) = queue[head]
+            head += 1
+            var node = Node()
+            node.base0 = UInt32(trie.leaves.count)
+            node.base1 = UInt32(trie.nodes.count)
+            var last: Int32? = nil
+            for i in 0..<64 {
+                let bit: UInt64 = 1 << UInt64(i)
+                if let child = buildNode.children[i] {
+                    node.vector |= bit
+                    queue.append((child, trie.nodes.count))
+                    trie.nodes.append(Node())
+                } else if last == nil || last! != buildNode.leaves[i] {
+                    node.leafvec |= bit
+                    trie.leaves.append(buildNode.leaves[i])
+                    last = buildNode.leaves[i]
+                }
+            }
+            trie.nodes[index] = node
+        }
+        return trie
+    }
+
+}
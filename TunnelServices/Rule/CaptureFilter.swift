@@ -0,0 +1,340 @@
+//
+//  CaptureFilter.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/6/27.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import NIOHTTP1
+
+// 收到响应头后决定会话的保存方式
+public enum CaptureMode: String {
+    case full = "full"          // 保存请求、响应头和响应体
+    case headers = "headers"    // 只保存头部，已保存的请求体回收，不写响应体
+    case none = "none"          // 不保存，已保存的记录删除
+}
+
+// 响应头阶段可用的字段，字符串都是已经存在于 Session 上的值，只增加引用计数，不复制内容
+struct CaptureInput {
+    var status: Int
+    var size: Int               // Content-Length，未知（chunked、没有或无法解析）为 -1
+    var rspType: String
+    var rspEncoding: String
+    var host: String
+    var method: String
+
+    private static let contentLengthName = Array("content-length".utf8)
+
+    // 遍历头部找 Content-Length，不经过 headers[name] 构造数组，也不转换成 Int(String)
+    static func contentLength(_ headers: HTTPHeaders) -> Int {
+        for (name, value) in headers where CaptureFilter.equals(name, contentLengthName) {
+            var number = 0
+            for byte in value.utf8 {
+                guard byte >= 48, byte <= 57, number <= (Int.max - 9) / 10 else { return -1 }
+                number = number * 10 + Int(byte - 48)
+            }
+            return value.isEmpty ? -1 : number
+        }
+        return -1
+    }
+}
+
+// 抓包过滤表达式，例如：status >= 400 && rspType ~ json && size < 1MB
+// 字段：status、size、rspType(type)、rspEncoding(encoding)、host、method
+// 运算：数字 == != < <= > >=（size 支持 KB/MB/GB）；字符串 == != ~(包含) !~(不包含)，不区分大小写
+// 长度未知时 size 的大小比较跳过（视为成立），chunked 响应不会因为 size < 1MB 被排除；用 size == unknown / size != unknown 判断长度是否已知
+// 组合：&& || ! ()
+// 编译成平铺的节点数组，求值只按下标递归，不分配内存
+final class CaptureFilter {
+
+    enum Field {
+        case status, size, rspType, rspEncoding, host, method
+
+        var isNumber: Bool {
+            return self == .status || self == .size
+        }
+    }
+
+    enum Op {
+        case eq, ne, lt, le, gt, ge, contains, notContains
+    }
+
+    enum Kind {
+        case and, or, not, compare
+    }
+
+    struct Node {
+        var kind: Kind
+        var left: Int = -1
+        var right: Int = -1
+        var field: Field = .status
+        var op: Op = .eq
+        var number: Int = 0
+        var needle: [UInt8] = []    // 已转小写
+
+        init(kind: Kind, left: Int = -1, right: Int = -1) {
+            self.kind = kind
+            self.left = left
+            self.right = right
+        }
+    }
+
+    let expression: String
+    private var nodes = [Node]()
+    private var root = -1
+
+    init?(_ expression: String) {
+        self.expression = expression
+        var parser = Parser(Array(expression.utf8))
+        guard let root = parser.parseOr(&nodes), parser.atEnd else {
+            print("Invalid capture filter:\(expression) at \(parser.position)")
+            return nil
+        }
+        self.root = root
+    }
+
+    func evaluate(_ input: CaptureInput) -> Bool {
+        return evaluate(root, input)
+    }
+
+    private func evaluate(_ index: Int, _ input: CaptureInput) -> Bool {
+        let node = nodes[index]
+        switch node.kind {
+        case .and:
+            return evaluate(node.left, input) && evaluate(node.right, input)
+        case .or:
+            return evaluate(node.left, input) || evaluate(node.right, input)
+        case .not:
+            return !evaluate(node.left, input)
+        case .compare:
+            switch node.field {
+            case .status:
+                return CaptureFilter.compare(input.status, node.op, node.number)
+            case .size:
+                // size == unknown、size != unknown
+                if node.number < 0 {
+                    return (input.size < 0) == (node.op == .eq)
+                }
+                // 长度未知时跳过大小比较
+                return input.size < 0 || CaptureFilter.compare(input.size, node.op, node.number)
+            case .rspType:
+                return CaptureFilter.compare(input.rspType, node.op, node.needle)
+            case .rspEncoding:
+                return CaptureFilter.compare(input.rspEncoding, node.op, node.needle)
+            case .host:
+                return CaptureFilter.compare(input.host, node.op, node.needle)
+            case .method:
+                return CaptureFilter.compare(input.method, node.op, node.needle)
+            }
+        }
+    }
+
+    @inline(__always)
+    private static func compare(_ value: Int, _ op: Op, _ number: Int) -> Bool {
+        switch op {
+        case .eq: return value == number
+        case .ne: return value != number
+        case .lt: return value < number
+        case .le: return value <= number
+        case .gt: return value > number
+        case .ge: return value >= number
+        case .contains, .notContains: return false
+        }
+    }
+
+    private static func compare(_ value: String, _ op: Op, _ needle: [UInt8]) -> Bool {
+        switch op {
+        case .eq: return equals(value, needle)
+        case .ne: return !equals(value, needle)
+        case .contains: return contains(value, needle)
+        case .notContains: return !contains(value, needle)
+        case .lt, .le, .gt, .ge: return false
+        }
+    }
+
+    @inline(__always)
+    private static func lower(_ byte: UInt8) -> UInt8 {
+        return byte >= 65 && byte <= 90 ? byte | 0x20 : byte
+    }
+
+    static func equals(_ value: String, _ needle: [UInt8]) -> Bool {
+        let utf8 = value.utf8
+        if utf8.count != needle.count { return false }
+        var i = 0
+        for byte in utf8 {
+            if lower(byte) != needle[i] { return false }
+            i += 1
+        }
+        return true
+    }
+
+    private static func contains(_ value: String, _ needle: [UInt8]) -> Bool {
+        if needle.isEmpty { return true }
+        let utf8 = value.utf8
+        var start = utf8.startIndex
+        while start != utf8.endIndex {
+            var current = start
+            var i = 0
+            while i < needle.count, current != utf8.endIndex, lower(utf8[current]) == needle[i] {
+                utf8.formIndex(after: &current)
+                i += 1
+            }
+            if i == needle.count { return true }
+            if current == utf8.endIndex { return false }
+            utf8.formIndex(after: &start)
+        }
+        return false
+    }
+
+    // MARK: - parse
+
+    private struct Parser {
+        let bytes: [UInt8]
+        var position = 0
+
+        init(_ bytes: [UInt8]) {
+            self.bytes = bytes
+        }
+
+        var atEnd: Bool {
+            mutating get {
+                skipSpaces()
+                return position >= bytes.count
+            }
+        }
+
+        mutating func skipSpaces() {
+            while position < bytes.count, bytes[position] == 32 || bytes[position] == 9 {
+                position += 1
+            }
+        }
+
+        mutating func consume(_ token: String) -> Bool {
+            skipSpaces()
+            let tokenBytes = Array(token.utf8)
+            guard position + tokenBytes.count <= bytes.count,
+                Array(bytes[position..<(position + tokenBytes.count)]) == tokenBytes else {
+                return false
+            }
+            position += tokenBytes.count
+            return true
+        }
+
+        mutating func parseOr(_ nodes: inout [Node]) -> Int? {
+            guard var left = parseAnd(&nodes) else { return nil }
+            while consume("||") {
+                guard let right = parseAnd(&nodes) else { return nil }
+                nodes.append(Node(kind: .or, left: left, right: right))
+                left = nodes.count - 1
+            }
+            return left
+        }
+
+        mutating func parseAnd(_ nodes: inout [Node]) -> Int? {
+            guard var left = parseUnary(&nodes) else { return nil }
+            while consume("&&") {
+                guard let right = parseUnary(&nodes) else { return nil }
+                nodes.append(Node(kind: .and, left: left, right: right))
+                left = nodes.count - 1
+            }
+            return left
+        }
+
+        mutating func parseUnary(_ nodes: inout [Node]) -> Int? {
+            if consume("!") {
+                guard let operand = parseUnary(&nodes) else { return nil }
+                nodes.append(Node(kind: .not, left: operand))
+                return nodes.count - 1
+            }
+            if consume("(") {
+                guard let inner = parseOr(&nodes), consume(")") else { return nil }
+                return inner
+            }
+            return parseCompare(&nodes)
+        }
+
+        mutating func parseCompare(_ nodes: inout [Node]) -> Int? {
+            guard let name = word() else { return nil }
+            var node = Node(kind: .compare)
+            switch name.lowercased() {
+            case "status": node.field = .status
+            case "size": node.field = .size
+            case "rsptype", "type": node.field = .rspType
+            case "rspencoding", "encoding": node.field = .rspEncoding
+            case "host": node.field = .host
+            case "method": node.field = .method
+            default: return nil
+            }
+            // 先匹配两个字符的运算符
+            if consume("==") { node.op = .eq }
+            else if consume("!=") { node.op = .ne }
+            else if consume("!~") { node.op = .notContains }
+            else if consume("<=") { node.op = .le }
+            else if consume(">=") { node.op = .ge }
+            else if consume("<") { node.op = .lt }
+            else if consume(">") { node.op = .gt }
+            else if consume("~") { node.op = .contains }
+            else { return nil }
+            guard let value = quoted() ?? word() else { return nil }
+            if node.field == .size, value.lowercased() == "unknown" {
+                guard node.op == .eq || node.op == .ne else { return nil }
+                node.number = -1
+            } else if node.field.isNumber {
+                guard node.op != .contains, node.op != .notContains, let number = CaptureFilter.number(value) else {
+                    return nil
+                }
+                node.number = number
+            } else {
+                guard node.op == .eq || node.op == .ne || node.op == .contains || node.op == .notContains else {
+                    return nil
+                }
+                node.needle = Array(value.lowercased().utf8)
+            }
+            nodes.append(node)
+            return nodes.count - 1
+        }
+
+        mutating func word() -> String? {
+            skipSpaces()
+            let start = position
+            while position < bytes.count {
+                let c = bytes[position]
+                let isWord = (c >= 48 && c <= 57) || (c >= 65 && c <= 90) || (c >= 97 && c <= 122)
+                    || c == 45 || c == 46 || c == 47 || c == 95 || c == 43 || c >= 128
+                if !isWord { break }
+                position += 1
+            }
+            return position > start ? String(decoding: bytes[start..<position], as: UTF8.self) : nil
+        }
+
+        mutating func quoted() -> String? {
+            skipSpaces()
+            guard position < bytes.count, bytes[position] == 34 || bytes[position] == 39 else { return nil }
+            let quote = bytes[position]
+            let start = position + 1
+            var end = start
+            while end < bytes.count, bytes[end] != quote { end += 1 }
+            guard end < bytes.count else { return nil }
+            position = end + 1
+            return String(decoding: bytes[start..<end], as: UTF8.self)
+        }
+    }
+
+    // "512"、"10KB"、"1MB"、"1.5GB"
+    static func number(_ text: String) -> Int? {
+        let upper = text.uppercased()
+        var scale = 1.0
+        var digits = Substring(upper)
+        for (unit, value) in [("KB", 1024.0), ("MB", 1024.0 * 1024), ("GB", 1024.0 * 1024 * 1024), ("K", 1024.0), ("M", 1024.0 * 1024), ("G", 1024.0 * 1024 * 1024), ("B", 1.0)] {
+            if upper.hasSuffix(unit) {
+                scale = value
+                digits = upper.dropLast(unit.count)
+                break
+            }
+        }
+        guard let value = Double(digits) else { return nil }
+        return Int(value * scale)
+    }
+}
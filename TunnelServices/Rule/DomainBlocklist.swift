@@ -0,0 +1,272 @@
+//
+//  DomainBlocklist.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/6/26.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import NIOConcurrencyHelpers
+
+// 大规模域名黑名单的二进制格式，导入时编译，运行时 mmap 只读映射，不解析成对象
+// 文件布局（小端）：
+//   头部 32 字节：magic "KNBL" | version | count | bloomWords | hashCount | stringsSize | 保留 8 字节
+//   Bloom 位图：UInt64 × bloomWords（2 的幂）
+//   偏移表：UInt32 × (count + 1)，指向字符串区
+//   标志：UInt8 × count，1 表示后缀匹配（含子域名），0 表示完全匹配
+//   字符串区：小写、按 label 反转（com.example.ad）后按字节排序的域名
+// 每条记录常驻开销约 5 字节 + 1.25 字节 Bloom，字符串在映射页中按需换入
+public final class DomainBlocklist {
+
+    static let magic: UInt32 = 0x4C424E4B     // "KNBL"
+    static let version: UInt32 = 1
+    static let headerSize = 32
+    static let hashCount = 7                   // 每条约 10 bit，误判率约 1%
+    public static let fileName = "BlackListDomains.knbl"
+
+    private let base: UnsafeRawPointer
+    private let size: Int
+    let count: Int
+    private let bloom: UnsafePointer<UInt64>
+    private let bloomMask: UInt64
+    private let hashes: Int
+    private let offsets: UnsafePointer<UInt32>
+    private let flags: UnsafePointer<UInt8>
+    private let strings: UnsafePointer<UInt8>
+
+    // MARK: - load
+
+    init?(url: URL) {
+        let fd = open(url.path, O_RDONLY)
+        guard fd >= 0 else { return nil }
+        defer { close(fd) }
+        var st = stat()
+        guard fstat(fd, &st) == 0, Int(st.st_size) >= DomainBlocklist.headerSize else { return nil }
+        let size = Int(st.st_size)
+        guard let mapped = mmap(nil, size, PROT_READ, MAP_PRIVATE, fd, 0), mapped != UnsafeMutableRawPointer(bitPattern: -1) else {
+            return nil
+        }
+        let base = UnsafeRawPointer(mapped)
+        func header(_ i: Int) -> Int {
+            return Int(UInt32(littleEndian: base.load(fromByteOffset: i * 4, as: UInt32.self)))
+        }
+        let count = header(2), bloomWords = header(3), stringsSize = header(5)
+        let bloomOffset = DomainBlocklist.headerSize
+        let offsetsOffset = bloomOffset + bloomWords * 8
+        let flagsOffset = offsetsOffset + (count + 1) * 4
+        let stringsOffset = flagsOffset + count
+        guard UInt32(header(0)) == DomainBlocklist.magic, UInt32(header(1)) == DomainBlocklist.version,
+            bloomWords > 0, bloomWords & (bloomWords - 1) == 0,
+            header(4) > 0, header(4) <= 32, stringsOffset + stringsSize == size,
+            DomainBlocklist.validOffsets(base + offsetsOffset, count: count, stringsSize: stringsSize) else {
+            print("Invalid blocklist file:\(url.lastPathComponent)")
+            munmap(mapped, size)
+            return nil
+        }
+        madvise(mapped, size, MADV_RANDOM)
+        self.base = base
+        self.size = size
+        self.count = count
+        bloom = (base + bloomOffset).assumingMemoryBound(to: UInt64.self)
+        bloomMask = UInt64(bloomWords * 64 - 1)
+        hashes = header(4)
+        offsets = (base + offsetsOffset).assumingMemoryBound(to: UInt32.self)
+        flags = (base + flagsOffset).assumingMemoryBound(to: UInt8.self)
+        strings = (base + stringsOffset).assumingMemoryBound(to: UInt8.self)
+    }
+
+    // 偏移表从 0 开始、单调不减且不超过字符串区，find 才不会越界读取
+    private static func validOffsets(_ pointer: UnsafeRawPointer, count: Int, stringsSize: Int) -> Bool {
+        var previous = 0
+        for i in 0...count {
+            let offset = Int(UInt32(littleEndian: pointer.load(fromByteOffset: i * 4, as: UInt32.self)))
+            if i == 0 ? offset != 0 : offset < previous { return false }
+            previous = offset
+        }
+        return previous <= stringsSize
+    }
+
+    deinit {
+        munmap(UnsafeMutableRawPointer(mutating: base), size)
+    }
+
+    // 当前共享容器中的黑名单，文件更新后重新映射
+    private static let sharedLock = Lock()
+    private static var sharedList: DomainBlocklist?
+    private static var sharedModifyDate: Date?
+
+    public static var shared: DomainBlocklist? {
+        guard let url = MitmService.getCertPath()?.appendingPathComponent(fileName, isDirectory: false) else {
+            return nil
+        }
+        let modifyDate = (try? FileManager.default.attributesOfItem(atPath: url.path))?[.modificationDate] as? Date
+        return sharedLock.withLock {
+            if modifyDate != sharedModifyDate {
+                sharedList = modifyDate == nil ? nil : DomainBlocklist(url: url)
+                sharedModifyDate = modifyDate
+            }
+            return sharedList
+        }
+    }
+
+    // MARK: - lookup
+
+    // host 需已转小写；依次检查 host 本身及每一级父域名，每级先查 Bloom，通过后再二分查找
+    func contains(host: String) -> Bool {
+        var reversed = DomainBlocklist.reverseLabels(host)
+        if reversed.isEmpty { return false }
+        return reversed.withUnsafeMutableBufferPointer { buffer -> Bool in
+            var hash = DomainBlocklist.fnvOffset
+            for i in 0..<buffer.count {
+                if buffer[i] == UInt8(ascii: ".") {
+                    // buffer[0..<i] 是一个父域名
+                    if probe(buffer, i, hash, exact: false) { return true }
+                }
+                hash = (hash ^ UInt64(buffer[i])) &* DomainBlocklist.fnvPrime
+            }
+            return probe(buffer, buffer.count, hash, exact: true)
+        }
+    }
+
+    private func probe(_ buffer: UnsafeMutableBufferPointer<UInt8>, _ length: Int, _ hash: UInt64, exact: Bool) -> Bool {
+        let h2 = (hash >> 33 | hash << 31) | 1
+        var h = hash
+        for _ in 0..<hashes {
+            let bit = h & bloomMask
+            if UInt64(littleEndian: bloom[Int(bit >> 6)]) & (1 << (bit & 63)) == 0 { return false }
+            h = h &+ h2
+        }
+        guard let index = find(UnsafeRawPointer(buffer.baseAddress!), length) else { return false }
+        return exact || flags[index] != 0
+    }
+
+    private func find(_ key: UnsafeRawPointer, _ length: Int) -> Int? {
+        var low = 0
+        var high = count - 1
+        while low <= high {
+            let mid = (low + high) >> 1
+            let start = Int(UInt32(littleEndian: offsets[mid]))
+            let entryLength = Int(UInt32(littleEndian: offsets[mid + 1])) - start
+            var result = memcmp(strings + start, key, min(entryLength, length))
+            if result == 0 { result = Int32(entryLength - length) }
+            if result == 0 { return mid }
+            if result < 0 { low = mid + 1 } else { high = mid - 1 }
+        }
+        return nil
+    }
+
+    // MARK: - build
+
+    static let fnvOffset: UInt64 = 0xcbf29ce484222325
+    static let fnvPrime: UInt64 = 0x100000001b3
+
+    // "ad.example.com" -> "com.example.ad"
+    static func reverseLabels(_ domain: String) -> [UInt8] {
+        let labels = domain.utf8.split(separator: UInt8(ascii: "."), omittingEmptySubsequences: true)
+        var result = [UInt8]()
+        result.reserveCapacity(domain.utf8.count)
+        for label in labels.reversed() {
+            if !result.isEmpty { result.append(UInt8(ascii: ".")) }
+            result.append(contentsOf: label)
+        }
+        return result
+    }
+
+    // 解析一行：DOMAIN / DOMAIN-SUFFIX 规则、hosts 格式、纯域名（含 "*." "." 前缀）
+    // 返回 (小写域名, 是否后缀匹配)
+    static func parseLine(_ line: String) -> (domain: String, suffix: Bool)? {
+        var text = line
+        for mark in ["#", "//"] {
+            if let range = text.range(of: mark) { text = String(text[..<range.lowerBound]) }
+        }
+        text = text.trimmingCharacters(in: .whitespaces).lowercased()
+        if text.isEmpty || text.hasPrefix("!") || text.hasPrefix("[") { return nil }
+        var suffix = true
+        let fields = text.components(separatedBy: ",").map { $0.trimmingCharacters(in: .whitespaces) }
+        if fields.count > 1 {
+            switch fields[0] {
+            case "domain": suffix = false
+            case "domain-suffix": break
+            default: return nil
+            }
+            text = fields[1]
+        } else {
+            let parts = text.split(whereSeparator: { $0 == " " || $0 == "\t" })
+            if parts.count >= 2 {
+                // hosts 格式：0.0.0.0 ad.example.com
+                text = String(parts[1])
+                suffix = false
+            }
+        }
+        if text.hasPrefix("*.") {
+            text.removeFirst(2)
+        } else if text.hasPrefix(".") {
+            text.removeFirst()
+        }
+        if text.isEmpty || text == "localhost" || text.contains("/") { return nil }
+        return (text, suffix)
+    }
+
+    // 把域名列表编译成二进制文件，先写临时文件再替换，正在使用旧映射的进程不受影响；返回域名条数
+    @discardableResult
+    public static func compile(_ text: String, to url: URL) throws -> Int {
+        var entries = [[UInt8]: Bool]()
+        text.enumerateLines { (line, _) in
+            if let parsed = parseLine(line) {
+                let key = reverseLabels(parsed.domain)
+                entries[key] = (entries[key] ?? false) || parsed.suffix
+            }
+        }
+        let sorted = entries.keys.sorted { $0.lexicographicallyPrecedes($1) }
+
+        var bloomWords = 1
+        while bloomWords * 64 < sorted.count * 10 { bloomWords <<= 1 }
+        var bloom = [UInt64](repeating: 0, count: bloomWords)
+        let bloomMask = UInt64(bloomWords * 64 - 1)
+        var offsets = [UInt32]()
+        offsets.reserveCapacity(sorted.count + 1)
+        var flags = [UInt8]()
+        flags.reserveCapacity(sorted.count)
+        var strings = [UInt8]()
+        for key in sorted {
+            offsets.append(UInt32(strings.count))
+            flags.append(entries[key]! ? 1 : 0)
+            strings.append(contentsOf: key)
+            var hash = fnvOffset
+            for byte in key { hash = (hash ^ UInt64(byte)) &* fnvPrime }
+            let h2 = (hash >> 33 | hash << 31) | 1
+            var h = hash
+            for _ in 0..<hashCount {
+                let bit = h & bloomMask
+                bloom[Int(bit >> 6)] |= 1 << (bit & 63)
+                h = h &+ h2
+            }
+        }
+        offsets.append(UInt32(strings.count))
+
+        var data = Data()
+        data.reserveCapacity(headerSize + bloomWords * 8 + offsets.count * 4 + flags.count + strings.count)
+        func append<T: FixedWidthInteger>(_ value: T) {
+            withUnsafeBytes(of: value.littleEndian) { data.append(contentsOf: $0) }
+        }
+        let header: [UInt32] = [magic, version, UInt32(sorted.count), UInt32(bloomWords), UInt32(hashCount), UInt32(strings.count), 0, 0]
+        header.forEach { append($0) }
+        bloom.forEach { append($0) }
+        offsets.forEach { append($0) }
+        data.append(contentsOf: flags)
+        data.append(contentsOf: strings)
+        try data.write(to: url, options: .atomic)
+        print("Blocklist compiled: \(sorted.count) domains, \(data.count) bytes")
+        return sorted.count
+    }
+
+    // 导入域名列表，编译到共享容器，Tunnel 下次发布规则快照时生效；返回域名条数
+    @discardableResult
+    public static func importList(_ text: String) throws -> Int {
+        guard let url = MitmService.getCertPath()?.appendingPathComponent(fileName, isDirectory: false) else {
+            return 0
+        }
+        return try compile(text, to: url)
+    }
+}
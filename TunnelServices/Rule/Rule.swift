@@ -7,6 +7,9 @@
 //
 
 import UIKit
+import NIO
+import NIOConcurrencyHelpers
+import MMWormhole
 
 public let CurrentRuleDidChange: NSNotification.Name = NSNotification.Name(rawValue: "CurrentRuleDidChange")
 
@@ -93,9 +96,23 @@ public class Rule: ASModel {
         }
         return blackItems
     }()
+    lazy var defaultBlacklist: RuleMatchSet = {
+        return RuleMatchSet(items: defaulBlacklistRuleItems)
+    }()
     
-    var _validRuleItems:[RuleItem]?
+    // 当前生效的规则快照，EventLoop 上只读这里
+    let snapshotBox = RuleSnapshotBox(RuleSnapshot.empty)
+    let publishLock = Lock()
+    // 规则修改后只做标记，第一次匹配时才编译，App 内编辑规则不再每次都重建快照
+    let snapshotStale = Atomic<Bool>(value: true)
+    var snapshotVersion: UInt = 0
+    let decisionCache = RuleDecisionCache()
+    // 有效规则列表，行变化后才重新生成
+    var _validRuleItems: [RuleItem]?
     public var validRuleItems: [RuleItem] {
+        if let items = _validRuleItems {
+            return items
+        }
         var items = [RuleItem]()
         for i in 0..<lines.count {
             if let item = lines[i] as? RuleItem {
@@ -103,6 +120,7 @@ public class Rule: ASModel {
                 items.append(item)
             }
         }
+        _validRuleItems = items
         return items
     }
     public var numberOfRule: Int {
@@ -132,6 +150,24 @@ public class Rule: ASModel {
             addGeneral("default-direct-enable", _defaultBlacklistEnable ? "true" : "false")
         }
     }
+    // 抓包过滤：命中 capture-filter 的会话完整保存，其余按 capture-otherwise 处理
+    // 用非字符串类型保存，不会成为数据库列
+    var _captureFilter: CaptureFilter?
+    public var captureFilter: String {
+        get { return _captureFilter?.expression ?? "" }
+        set {
+            _captureFilter = newValue == "" ? nil : CaptureFilter(newValue)
+            addGeneral("capture-filter", newValue)
+        }
+    }
+    var _captureOtherwise: CaptureMode = .headers
+    public var captureOtherwise: CaptureMode {
+        get { return _captureOtherwise }
+        set {
+            _captureOtherwise = newValue
+            addGeneral("capture-otherwise", _captureOtherwise.rawValue)
+        }
+    }
     var _createTime: String = Date().fullSting
     public var createTime: String {
         get { return _createTime }
@@ -157,7 +193,14 @@ public class Rule: ASModel {
         }
     }
     
-    public var lines = [RuleLine]()
+    public internal(set) var lines = [RuleLine]()
+    // 各分区标题行（[General]、[Rule]、[Host]）在 lines 中的位置，增删行时同步更新
+    var sectionStarts = [RuleType: Int]()
+    // lines 修改后 config 需要重新生成
+    var configDirty = false
+    // beginUpdates/endUpdates 嵌套层数，批量修改期间只在结束时发布一次
+    var updateDepth = 0
+    var pendingChange: String?
     /*
      [General]
      name = 副本  // 名称
@@ -188,11 +231,15 @@ public class Rule: ASModel {
     var _config:String = ""
     public var config: String {
         get {
-            // 生成规则配置
-            _config = ""
-            for line in lines {
-                _config.append(line.line)
-                _config.append("\n")
+            // 生成规则配置，未修改时直接返回上次结果
+            if configDirty {
+                var text = ""
+                for line in lines {
+                    text.append(line.line)
+                    text.append("\n")
+                }
+                _config = text
+                configDirty = false
             }
             return _config
         }
@@ -207,11 +254,13 @@ public class Rule: ASModel {
     
     public static func defaultRule() -> Rule {
         let rule = Rule()
+        rule.beginUpdates()
         rule.name = "Knot(Default)"
         rule.defaultStrategy = .DIRECT
         rule.defaultBlacklistEnable = true
         rule.author = "Knot"
         rule.createTime = Date().fullSting
+        rule.endUpdates()
         _ = rule.config
         return rule
     }
@@ -229,64 +278,115 @@ public class Rule: ASModel {
         add(.General, item)
     }
     
+    // 批量修改：期间的 add/move/delete/replace 只在最外层 endUpdates 时发布一次快照和通知
+    public func beginUpdates() {
+        updateDepth += 1
+    }
+    
+    public func endUpdates() {
+        updateDepth -= 1
+        if updateDepth == 0, let reason = pendingChange {
+            pendingChange = nil
+            linesDidChange(reason)
+        }
+    }
+    
+    func linesDidChange(_ reason: String) {
+        _validRuleItems = nil
+        configDirty = true
+        if updateDepth > 0 {
+            pendingChange = reason
+            return
+        }
+        ruleDidChange()
+        NotificationCenter.default.post(name: CurrentRuleDidChange, object: reason)
+    }
+    
+    // MARK: - 行存储
+    
+    func insertLine(_ line: RuleLine, at position: Int) {
+        lines.insert(line, at: position)
+        for (type, start) in sectionStarts where start >= position {
+            sectionStarts[type] = start + 1
+        }
+        if let typeItem = line as? TypeItem, typeItem.itemType != .Other {
+            if let start = sectionStarts[typeItem.itemType], start < position { return }
+            sectionStarts[typeItem.itemType] = position
+        }
+    }
+    
     @discardableResult
-    public func add(_ type:RuleType, _ item: RuleLine) -> Bool{
-        
-        var insertPosition = -1
+    func removeLine(at position: Int) -> RuleLine {
+        let line = lines.remove(at: position)
+        if line is TypeItem {
+            rebuildSectionStarts()
+        } else {
+            for (type, start) in sectionStarts where start > position {
+                sectionStarts[type] = start - 1
+            }
+        }
+        return line
+    }
+    
+    func rebuildSectionStarts() {
+        sectionStarts.removeAll()
         for i in 0..<lines.count {
-            let line = lines[i]
-            if let typeLine = line as? TypeItem {
-                if typeLine.itemType == type {
-                    insertPosition = i
-                    break
-                }
+            if let typeItem = lines[i] as? TypeItem, typeItem.itemType != .Other, sectionStarts[typeItem.itemType] == nil {
+                sectionStarts[typeItem.itemType] = i
             }
         }
-        if insertPosition < 0 {
-            let typeStr = "[\(type)]"
-            lines.append(TypeItem(typeStr))
+    }
+    
+    // 分区的结束位置（下一个分区标题或末尾）
+    func sectionEnd(after start: Int) -> Int {
+        var end = lines.count
+        for (_, other) in sectionStarts where other > start && other < end {
+            end = other
+        }
+        return end
+    }
+    
+    @discardableResult
+    public func add(_ type:RuleType, _ item: RuleLine) -> Bool{
+        if type == .Other || type == .Type {
+            print("Inset shound not be \(type) !")
+            return false
+        }
+        var insertPosition: Int
+        if let start = sectionStarts[type] {
+            insertPosition = start
+        } else {
+            insertLine(TypeItem("[\(type)]"), at: lines.count)
             insertPosition = lines.count - 1
         }
         
-        switch type {
-        case .General:
+        if type == .General, let generalItem = item as? GeneralItem {
             var find = false
-            if let generalItem = item as? GeneralItem {
-                for index in insertPosition..<lines.count {
-                    if let rule = lines[index] as? GeneralItem {
-                        if rule.key == generalItem.key {
-                            (lines[index] as? GeneralItem)?.value = generalItem.value
-                            find = true
-                        }
-                    }
+            for index in (insertPosition + 1)..<sectionEnd(after: insertPosition) {
+                if let rule = lines[index] as? GeneralItem, rule.key == generalItem.key {
+                    rule.value = generalItem.value
+                    find = true
                 }
             }
             if !find {
-                lines.insert(item, at: insertPosition+1)
+                insertLine(item, at: insertPosition+1)
             }
-            break
-        case .Other,.Type:
-            print("Inset shound not be \(type) !")
-            return false
-        default:
-            lines.insert(item, at: insertPosition+1)
-            break
+        } else {
+            insertLine(item, at: insertPosition+1)
         }
-        NotificationCenter.default.post(name: CurrentRuleDidChange, object: "add")
+        linesDidChange("add")
         return true
     }
     
     @discardableResult
     public func move(from: Int, to:Int) -> Bool {
-        let line = lines[from]
-        if from > to {
-            lines.remove(at: from)
-            lines.insert(line, at: to)
-        }else{
-            lines.insert(line, at: to+1)
-            lines.remove(at: from)
+        guard from >= 0, from < lines.count, to >= 0, to < lines.count else {
+            print("Move error : \(from) -> \(to) out of range !")
+            return false
         }
-        NotificationCenter.default.post(name: CurrentRuleDidChange, object: "add")
+        let line = removeLine(at: from)
+        insertLine(line, at: to)
+        linesDidChange("add")
         return true
     }
     
@@ -295,7 +395,7 @@ public class Rule: ASModel {
         if lines.count > index , index > 0 {
             let item = lines[index]
             if item.lineType == type {
-                lines.remove(at: index)
+                removeLine(at: index)
             }else{
                 print("Delete error: \(item.lineType) != \(type)")
                 NotificationCenter.default.post(name: CurrentRuleDidChange, object: "delete")
@@ -306,7 +406,7 @@ public class Rule: ASModel {
             NotificationCenter.default.post(name: CurrentRuleDidChange, object: "delete")
             return false
         }
-        NotificationCenter.default.post(name: CurrentRuleDidChange, object: "delete")
+        linesDidChange("delete")
         return true
     }
     
@@ -315,8 +415,10 @@ public class Rule: ASModel {
         if lines.count > index , index > 0 {
             let line = lines[index]
             if line.lineType == type {
-                lines.remove(at: index)
-                lines.insert(item, at: index)
+                lines[index] = item
+                if line is TypeItem || item is TypeItem {
+                    rebuildSectionStarts()
+                }
             }else{
                 print("Replace error: \(item.lineType) != \(type)")
                 NotificationCenter.default.post(name: CurrentRuleDidChange, object: "replace")
@@ -327,30 +429,50 @@ public class Rule: ASModel {
             NotificationCenter.default.post(name: CurrentRuleDidChange, object: "replace")
             return false
         }
-        NotificationCenter.default.post(name: CurrentRuleDidChange, object: "replace")
+        linesDidChange("replace")
         return true
     }
     
+    // 逐行流式解析，不先把整个配置拆成数组
     public func configParse(){
+        // 热加载时同一个对象会重复解析，先把 [General] 字段恢复为默认值，新配置中没有的项不保留旧值
+        _name = ""
+        _defaultStrategy = .COPY
+        _defaultBlacklistEnable = true
+        _captureFilter = nil
+        _captureOtherwise = .headers
+        _createTime = Date().fullSting
+        _author = nil
+        _note = nil
         lines.removeAll()
-        let allLines = _config.components(separatedBy: "\n")
+        lines.reserveCapacity(_config.utf8.count / 24)
+        let text = _config
+        let utf8 = text.utf8
+        var start = utf8.startIndex
         var type:RuleType = .Other
-        for index in 0..<allLines.count {
-            let line = allLines[index]
-            if line.lowercased().starts(with: "[general]"){
-                lines.append(TypeItem(line))
-                type = .General
-                continue
-            }
-            if line.lowercased().starts(with: "[rule]") {
-                lines.append(TypeItem(line))
-                type = .Rule
-                continue
-            }
-            if line.lowercased().starts(with: "[host]") {
-                lines.append(TypeItem(line))
-                type = .Host
-                continue
+        var index = 0
+        while start < utf8.endIndex {
+            let end = utf8[start...].firstIndex(of: UInt8(ascii: "\n")) ?? utf8.endIndex
+            let line = String(decoding: utf8[start..<end], as: UTF8.self)
+            start = end < utf8.endIndex ? utf8.index(after: end) : end
+            defer { index += 1 }
+            if line.hasPrefix("[") {
+                let lower = line.lowercased()
+                if lower.starts(with: "[general]"){
+                    lines.append(TypeItem(line))
+                    type = .General
+                    continue
+                }
+                if lower.starts(with: "[rule]") {
+                    lines.append(TypeItem(line))
+                    type = .Rule
+                    continue
+                }
+                if lower.starts(with: "[host]") {
+                    lines.append(TypeItem(line))
+                    type = .Host
+                    continue
+                }
             }
             
             switch type {
@@ -370,6 +492,10 @@ public class Rule: ASModel {
                 continue
             }
         }
+        rebuildSectionStarts()
+        _validRuleItems = nil
+        configDirty = true
+        ruleDidChange()
     }
     
     func generalParse(_ line:String, _ index:Int){
@@ -393,6 +519,15 @@ public class Rule: ASModel {
                 _author = generalLine.value
             case "note":
                 _note = generalLine.value
+            case "capture-filter":
+                _captureFilter = generalLine.value == "" ? nil : CaptureFilter(generalLine.value)
+            case "capture-otherwise":
+                if let mode = CaptureMode(rawValue: generalLine.value.lowercased()) {
+                    _captureOtherwise = mode
+                }else{
+                    _captureOtherwise = .headers
+                    print("Warning(\(index)): unknow capture mode : \(generalLine.value) !")
+                }
             default:
                 otherParse(line, index)
                 print("Warning(\(index)): unknow general key \(generalLine.key) !")
@@ -432,112 +567,115 @@ public class Rule: ASModel {
         try save()
     }
     
+    // 批量修改期间的临时状态，不存数据库
+    override public func transientTypes() -> [String] {
+        return ["pendingChange"]
+    }
+    
+    // 通知正在运行的服务重新加载此规则
+    public func postConfigDidChange() {
+        guard let ruleId = id else { return }
+        let wormhole = MMWormhole(applicationGroupIdentifier: GROUPNAME, optionalDirectory: "wormhole")
+        wormhole.passMessageObject(["ruleId":"\(ruleId)"].toJson() as NSCoding, identifier: RuleConfigDidChanged)
+    }
+    
     public static func findRules() -> [Rule] {
         return Rule.findAll()
     }
     
-    func matchingDefaultBlacklist(host: String,uri: String, target: String) -> Bool {
-        var fullUri = uri
-        if uri.hasPrefix("/") {
-            fullUri = host + uri
-        }
-        for item in defaulBlacklistRuleItems {
-            switch item.matchRule {
-            case .DOMAIN:
-                if host.lowercased() == item.value.lowercased() { return true }
-            case .DOMAINKEYWORD:
-                if host.lowercased().contains(item.value) || fullUri.lowercased().contains(item.value) { return true }
-            case .DOMAINSUFFIX:
-                if host.lowercased().hasSuffix(item.value.lowercased()) { return true }
-            case .URLREGEX:
-                guard (try? NSRegularExpression(pattern: item.value, options: .caseInsensitive)) != nil else {
-                    print("Invalid Regex")
-                    return false
-                }
-                let pred = NSPredicate(format: "SELF MATCHES %@", item.value)
-                if pred.evaluate(with: host) || pred.evaluate(with: fullUri) || pred.evaluate(with: fullUri.urlEncoded()) {
-                    return true
-                }
-            case .USERAGENT:
-                if target.lowercased().contains(item.value.lowercased()) || target.lowercased().contains(item.value.urlEncoded()){
-                    return true
-                }
-            case .NONE:
-                break
-            case .IPCIDR:
-                break
-            }
+    public func matching(host: String,uri: String, target: String) -> Bool {
+        let snapshot = currentSnapshot()
+        return snapshot.matchingHost(host: host, target: target) || snapshot.matchingPath(host: host, uri: uri)
+    }
+    
+    // 带缓存的匹配：返回最终策略，DIRECT 不记录，COPY 记录
+    // 只依赖 host、User-Agent 的规则结果按 (host, target) 缓存，依赖 uri 的规则仍逐次匹配
+    public func strategy(host: String,uri: String, target: String) -> Strategy {
+        let snapshot = currentSnapshot()
+        var hit = false
+        if let cached = decisionCache.lookup(host: host, uaClass: target, version: snapshot.version) {
+            if cached != .NONE { return cached }
+        } else {
+            hit = snapshot.matchingHost(host: host, target: target)
+            // 未命中时存 NONE，表示还需要匹配 uri 相关规则
+            decisionCache.store(host: host, uaClass: target, version: snapshot.version, strategy: hit ? snapshot.decision(true) : .NONE)
+        }
+        if !hit {
+            hit = snapshot.matchingPath(host: host, uri: uri)
         }
-        return false
+        return snapshot.decision(hit)
     }
     
-    public func matching(host: String,uri: String, target: String) -> Bool {
-        if defaultBlacklistEnable, defaultStrategy == .DIRECT {
-            // 匹配默认黑名单
-            if matchingDefaultBlacklist(host: host, uri: uri, target: target) {
-                print("命中默认黑名单:\n**********\n\(host)\n\(target)\n\(uri)\n**********")
-                return true
-            }
+    // IP-CIDR 匹配，需要连接成功后的远程地址；命中时返回最终策略，未命中返回 nil
+    public func strategy(address: SocketAddress?) -> Strategy? {
+        let snapshot = currentSnapshot()
+        return snapshot.matching(address: address) ? snapshot.decision(true) : nil
+    }
+    
+    // CONNECT 目标为字面 IP 时在决定是否解密前匹配 IP-CIDR；目标为域名时要连接后才知道地址，只能在 strategy(address:) 中匹配
+    public func strategy(ip: String) -> Strategy? {
+        let snapshot = currentSnapshot()
+        return snapshot.matching(ip: ip) ? snapshot.decision(true) : nil
+    }
+    
+    public func matching(address: SocketAddress?) -> Bool {
+        return currentSnapshot().matching(address: address)
+    }
+    
+    // 收到响应头后决定会话的保存方式
+    func captureMode(_ input: CaptureInput) -> CaptureMode {
+        return currentSnapshot().captureMode(input)
+    }
+    
+    public var decisionCacheMetrics: RuleCacheMetrics {
+        return decisionCache.metrics
+    }
+    
+    // 规则修改后标记快照过期，正在进行的匹配继续使用旧快照
+    func ruleDidChange() {
+        snapshotStale.store(true)
+    }
+    
+    func currentSnapshot() -> RuleSnapshot {
+        if snapshotStale.load() {
+            publishSnapshot()
         }
-        if _validRuleItems == nil {
-            _validRuleItems = validRuleItems
-        }
-        var fullUri = uri
-        if uri.hasPrefix("/") {
-            fullUri = host + uri
-        }
-        for item in _validRuleItems! {
-            switch item.matchRule {
-            case .DOMAIN:
-                if host.lowercased() == item.value.lowercased() {
-//                    print("命中DOMAIN(\(item.value)):\n*************************\n\(host)\n\(target)\n\(uri)\n*************************")
-                    return true }
-            case .DOMAINKEYWORD:
-                if host.lowercased().contains(item.value) || fullUri.lowercased().contains(item.value) {
-//                    print("命中DOMAINKEYWORD(\(item.value)):\n*************************\n\(host)\n\(target)\n\(uri)\n*************************")
-                    return true }
-            case .DOMAINSUFFIX:
-                if host.lowercased().hasSuffix(item.value.lowercased()) {
-//                    print("命中DOMAINSUFFIX(\(item.value)):\n*************************\n\(host)\n\(target)\n\(uri)\n*************************")
-                    return true }
-            case .URLREGEX:
-                guard (try? NSRegularExpression(pattern: item.value, options: .caseInsensitive)) != nil else {
-                    print("Invalid Regex")
-                    return false
-                }
-                let pred = NSPredicate(format: "SELF MATCHES %@", item.value)
-                if pred.evaluate(with: host) || pred.evaluate(with: fullUri) || pred.evaluate(with: fullUri.urlEncoded()) {
-//                    print("命中URLREGEX(\(item.value)):\n*************************\n\(host)\n\(target)\n\(uri)\n*************************")
-                    return true
-                }
-            case .USERAGENT:
-                if target.lowercased().contains(item.value.lowercased()) || target.lowercased().contains(item.value.urlEncoded()){
-//                    print("命中USERAGENT(\(item.value)):\n*************************\n\(host)\n\(target)\n\(uri)\n*************************")
-                    return true
+        return snapshotBox.load()
+    }
+    
+    // 重新编译并发布快照；Tunnel 在启动和热加载后主动调用，避免在 EventLoop 上编译
+    public func publishSnapshot() {
+        publishLock.withLockVoid {
+            guard snapshotStale.exchange(with: false) else { return }
+            let blacklistActive = _defaultBlacklistEnable && _defaultStrategy == .DIRECT
+            let rules = RuleMatchSet(items: validRuleItems)
+            snapshotVersion += 1
+            decisionCache.willPublish(version: snapshotVersion)
+            var blacklist: RuleMatchSet? = nil
+            if blacklistActive {
+                // 导入的域名黑名单文件有更新时重新映射
+                let domains = DomainBlocklist.shared
+                if defaultBlacklist.domains !== domains {
+                    defaultBlacklist = RuleMatchSet(items: defaulBlacklistRuleItems, domains: domains)
                 }
-            case .NONE:
-                break
-            case .IPCIDR:
-                break
+                blacklist = defaultBlacklist
             }
+            snapshotBox.publish(RuleSnapshot(version: snapshotVersion, defaultStrategy: _defaultStrategy, rules: rules, blacklist: blacklist,
+                                             captureFilter: _captureFilter, captureOtherwise: _captureOtherwise))
         }
-//        print("未命中:\n*************************\n\(host)\n\(target)\n\(uri)\n*************************")
-        return false
     }
     
 }
 
-private extension String {
-    func urlEncoded() -> String {
-        guard let result = self.addingPercentEncoding(withAllowedCharacters: _allowedCharacters) else {
-            return "jfaongkxhaugksnxhghrkdghxgiajgnfkhnknxnkjiwoietoi"
-        }
-        return result
-    }
+// 持久化列表，pendingChange 不入库
+extension Rule: ASBindingProtocol {
+    public static let bindings: [ASBinding] = [
+        .number("id", \Rule.id),
+        .string("subName", \Rule.subName),
+        .string("_name", \Rule._name),
+        .string("_createTime", \Rule._createTime),
+        .string("_author", \Rule._author),
+        .string("_note", \Rule._note),
+        .string("_config", \Rule._config),
+    ]
 }
-
-private var _allowedCharacters: CharacterSet = {
-    var allowed = CharacterSet.urlQueryAllowed
-    allowed.remove("+")
-    return allowed
-}()
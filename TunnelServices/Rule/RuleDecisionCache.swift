@@ -0,0 +1,137 @@
+//
+//  RuleDecisionCache.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/6/24.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import NIO
+import NIOConcurrencyHelpers
+
+// 规则匹配缓存统计
+// 耗时只对抽样的查询计时
+public struct RuleCacheMetrics {
+    public var hits: UInt64
+    public var misses: UInt64
+    public var lookupNanos: UInt64
+    public var sampledLookups: UInt64
+
+    public var hitRate: Double {
+        let total = hits + misses
+        return total == 0 ? 0 : Double(hits) / Double(total)
+    }
+
+    public var averageLookupNanos: Double {
+        return sampledLookups == 0 ? 0 : Double(lookupNanos) / Double(sampledLookups)
+    }
+}
+
+// 按 (host, User-Agent 类别) 缓存规则匹配结果
+// 固定大小、直接映射，每个槽位是一个 64 位原子值：指纹(40) | 规则版本(16) | 策略(8)
+// 读写都只有一次原子操作，各个 EventLoop 并发读取不需要加锁；规则版本变化后旧槽位自然失效
+// 版本只存低 16 位，回绕时清空整张表，避免 65536 次发布之前的槽位被误认为有效
+// 统计计数按线程分开，只由所属 EventLoop 写入；每 samplingInterval 次查询计时一次
+final class RuleDecisionCache {
+
+    static let defaultCapacity = 4096
+    static let samplingInterval: UInt64 = 1024
+    private static let strategies: [Strategy] = [.NONE, .DIRECT, .REJECT, .COPY, .DEFAULT]
+
+    private let slots: [UnsafeEmbeddedAtomic<UInt64>]
+    private let mask: Int
+
+    final class Counters {
+        var hits: UInt64 = 0
+        var misses: UInt64 = 0
+        var lookupNanos: UInt64 = 0
+        var sampledLookups: UInt64 = 0
+    }
+
+    private let lock = Lock()
+    private let localCounters = ThreadSpecificVariable<Counters>()
+    private var allCounters = [Counters]()
+
+    init(capacity: Int = RuleDecisionCache.defaultCapacity) {
+        var size = 1
+        while size < capacity { size <<= 1 }
+        slots = (0..<size).map { _ in UnsafeEmbeddedAtomic<UInt64>(value: 0) }
+        mask = size - 1
+    }
+
+    deinit {
+        for slot in slots {
+            slot.destroy()
+        }
+    }
+
+    // 各线程计数的合计，只用于日志，不要求精确
+    var metrics: RuleCacheMetrics {
+        return lock.withLock {
+            var metrics = RuleCacheMetrics(hits: 0, misses: 0, lookupNanos: 0, sampledLookups: 0)
+            for counters in allCounters {
+                metrics.hits += counters.hits
+                metrics.misses += counters.misses
+                metrics.lookupNanos += counters.lookupNanos
+                metrics.sampledLookups += counters.sampledLookups
+            }
+            return metrics
+        }
+    }
+
+    func lookup(host: String, uaClass: String, version: UInt) -> Strategy? {
+        let counters = currentCounters()
+        let sampled = (counters.hits &+ counters.misses) % RuleDecisionCache.samplingInterval == 0
+        let start = sampled ? DispatchTime.now().uptimeNanoseconds : 0
+        let key = RuleDecisionCache.hash(host, uaClass)
+        let word = slots[Int(truncatingIfNeeded: key) & mask].load()
+        var result: Strategy? = nil
+        if word != 0, word >> 24 == key >> 24, (word >> 8) & 0xffff == UInt64(version & 0xffff) {
+            let raw = Int(word & 0xff)
+            if raw < RuleDecisionCache.strategies.count {
+                result = RuleDecisionCache.strategies[raw]
+            }
+        }
+        if result == nil {
+            counters.misses &+= 1
+        } else {
+            counters.hits &+= 1
+        }
+        if sampled {
+            counters.lookupNanos &+= DispatchTime.now().uptimeNanoseconds &- start
+            counters.sampledLookups &+= 1
+        }
+        return result
+    }
+
+    func store(host: String, uaClass: String, version: UInt, strategy: Strategy) {
+        guard let raw = RuleDecisionCache.strategies.firstIndex(of: strategy) else { return }
+        let key = RuleDecisionCache.hash(host, uaClass)
+        let word = (key >> 24) << 24 | UInt64(version & 0xffff) << 8 | UInt64(raw)
+        slots[Int(truncatingIfNeeded: key) & mask].store(word)
+    }
+
+    // 发布新版本前调用；版本低 16 位回绕到 0 时清空所有槽位
+    func willPublish(version: UInt) {
+        guard version & 0xffff == 0 else { return }
+        for slot in slots {
+            slot.store(0)
+        }
+    }
+
+    private func currentCounters() -> Counters {
+        if let counters = localCounters.currentValue { return counters }
+        let counters = Counters()
+        lock.withLockVoid { allCounters.append(counters) }
+        localCounters.currentValue = counters
+        return counters
+    }
+
+    private static func hash(_ host: String, _ uaClass: String) -> UInt64 {
+        var hasher = Hasher()
+        hasher.combine(host)
+        hasher.combine(uaClass)
+        return UInt64(bitPattern: Int64(hasher.finalize()))
+    }
+}
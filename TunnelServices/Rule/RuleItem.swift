@@ -39,6 +39,17 @@ public class RuleItem: RuleLine {
         }
     }
     
+    // URL-REGEX 编译结果，value 不变时复用
+    var compiledRegex: (pattern: String, regex: NSRegularExpression)?
+    var regex: NSRegularExpression? {
+        if let compiled = compiledRegex, compiled.pattern == value {
+            return compiled.regex
+        }
+        guard let regex = URLRegexMatcher.compile(value) else { return nil }
+        compiledRegex = (value, regex)
+        return regex
+    }
+    
     public static func fromLine(_ line:String,_ index:Int = -1, success:((RuleItem) -> Void), failure:((String?) -> Void) ) -> Void {
         if line == "" {
             failure(nil)
@@ -48,60 +59,57 @@ public class RuleItem: RuleLine {
         let item = RuleItem()
         item.lineType = .Rule
         item.index = index
-        var parts = line.components(separatedBy: "//")
-        // 有效部分
-        let payload = parts[0]
+        // 有效部分与注释，第一个 "//" 之后都是注释
+        var payload = Substring(line)
+        var annotation = ""
+        if let range = line.range(of: "//") {
+            payload = line[..<range.lowerBound]
+            annotation = String(line[range.upperBound...])
+        }
         if payload.trimmingCharacters(in: .whitespaces) == "" {
             failure(nil)
             return
         }
-        // 注释
-        parts.removeFirst()
-        let annotation = parts.joined(separator: "//")
         item.annotation = annotation
         // 解析有效部分  //type, value, strategy //note    类型， 匹配值， 策略 //备注
-        var ruleParts = payload.components(separatedBy: ",")
-        if ruleParts.count == 0 {
-            failure("no rule params in \(payload)")
-            return
-        }
+        // 最多切成 4 段，第 4 段是剩余的 others
+        let ruleParts = payload.split(separator: ",", maxSplits: 3, omittingEmptySubsequences: false)
         // type
-        if let matchStr = ruleParts.first?.trimmingCharacters(in: .whitespaces).uppercased() {
-            if let mr = MatchRule(rawValue: matchStr) {
-                item.matchRule = mr
-            }else{
-                failure("error MatchRule :\(ruleParts.first ?? "")")
-                return
-            }
-            ruleParts.removeFirst()
-        }else{
-            failure("no MatchRule in \(payload)")
+        guard let mr = MatchRule(rawValue: ruleParts[0].trimmingCharacters(in: .whitespaces).uppercased()) else {
+            failure("error MatchRule :\(ruleParts[0])")
             return
         }
+        item.matchRule = mr
         // value
-        if let valueStr = ruleParts.first?.trimmingCharacters(in: .whitespaces) {
-            item.value = valueStr
-            ruleParts.removeFirst()
-        }else{
+        guard ruleParts.count > 1 else {
             failure("no value in \(payload)")
             return
         }
+        let valueStr = ruleParts[1].trimmingCharacters(in: .whitespaces)
+        item.value = valueStr
+        // 无效正则在解析时就拒绝，避免匹配时再校验
+        if item.matchRule == .URLREGEX, item.regex == nil {
+            failure("invalid regex :\(valueStr)")
+            return
+        }
+        if item.matchRule == .IPCIDR, CIDRTable.parse(valueStr) == nil {
+            failure("invalid ip-cidr :\(valueStr)")
+            return
+        }
         // strategy
-        if let strategyStr = ruleParts.first?.trimmingCharacters(in: .whitespaces).uppercased() {
-            if let strategy = Strategy(rawValue: strategyStr) {
-                item.strategy = strategy
-            }else{
-                failure("error Strategy :\(strategyStr)")
-                return
-            }
-            ruleParts.removeFirst()
-        }else{
+        guard ruleParts.count > 2 else {
             failure("no strategy in \(payload)")
             return
         }
+        let strategyStr = ruleParts[2].trimmingCharacters(in: .whitespaces).uppercased()
+        guard let strategy = Strategy(rawValue: strategyStr) else {
+            failure("error Strategy :\(strategyStr)")
+            return
+        }
+        item.strategy = strategy
         // others
-        if ruleParts.count > 0 {
-            item.other = ruleParts.joined(separator: ",").trimmingCharacters(in: .whitespaces)
+        if ruleParts.count > 3 {
+            item.other = ruleParts[3].trimmingCharacters(in: .whitespaces)
         }
         success(item)
     }
@@ -0,0 +1,213 @@
+//
+//  RuleSnapshot.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/6/25.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import NIO
+import NIOConcurrencyHelpers
+
+// 一组编译好的匹配规则（用户规则或默认黑名单），创建后只读
+final class RuleMatchSet {
+
+    struct HostEntry {
+        let matchRule: MatchRule
+        let value: String       // DOMAIN、DOMAIN-SUFFIX、USER-AGENT 已转小写；DOMAIN-KEYWORD 保持原样
+        let encoded: String     // USER-AGENT 的 urlEncoded 值
+    }
+
+    let hostEntries: [HostEntry]
+    let keywords: [String]
+    let regexMatcher: URLRegexMatcher
+    let cidrTable: CIDRTable
+    let domains: DomainBlocklist?   // 导入的大规模域名黑名单
+
+    static let empty = RuleMatchSet(items: [])
+
+    init(items: [RuleItem], domains: DomainBlocklist? = nil) {
+        self.domains = domains
+        var hostEntries = [HostEntry]()
+        var keywords = [String]()
+        for item in items {
+            switch item.matchRule {
+            case .DOMAIN, .DOMAINSUFFIX:
+                hostEntries.append(HostEntry(matchRule: item.matchRule, value: item.value.lowercased(), encoded: ""))
+            case .DOMAINKEYWORD:
+                hostEntries.append(HostEntry(matchRule: item.matchRule, value: item.value, encoded: ""))
+                keywords.append(item.value)
+            case .USERAGENT:
+                hostEntries.append(HostEntry(matchRule: item.matchRule, value: item.value.lowercased(), encoded: item.value.urlEncoded()))
+            case .URLREGEX, .IPCIDR, .NONE:
+                break
+            }
+        }
+        self.hostEntries = hostEntries
+        self.keywords = keywords
+        regexMatcher = URLRegexMatcher(items: items)
+        cidrTable = CIDRTable(items: items)
+    }
+
+    // 只依赖 host 和 User-Agent 的规则：DOMAIN、DOMAIN-SUFFIX、USER-AGENT，以及 DOMAIN-KEYWORD 的 host 部分
+    func matchingHost(lowerHost: String, lowerTarget: String) -> Bool {
+        if let domains = domains, domains.contains(host: lowerHost) {
+            return true
+        }
+        for entry in hostEntries {
+            switch entry.matchRule {
+            case .DOMAIN:
+                if lowerHost == entry.value { return true }
+            case .DOMAINKEYWORD:
+                if lowerHost.contains(entry.value) { return true }
+            case .DOMAINSUFFIX:
+                if lowerHost.hasSuffix(entry.value) { return true }
+            case .USERAGENT:
+                if lowerTarget.contains(entry.value) || lowerTarget.contains(entry.encoded) {
+                    return true
+                }
+            case .URLREGEX, .IPCIDR, .NONE:
+                break
+            }
+        }
+        return false
+    }
+
+    // 依赖 uri 的规则：DOMAIN-KEYWORD 的完整 uri 部分、URL-REGEX
+    func matchingPath(host: String, fullUri: String, lowerUri: String) -> Bool {
+        for keyword in keywords {
+            if lowerUri.contains(keyword) { return true }
+        }
+        if !regexMatcher.isEmpty, regexMatcher.firstMatch([host, fullUri, fullUri.urlEncoded()]) != nil {
+            return true
+        }
+        return false
+    }
+
+    // IP-CIDR 匹配
+    func matching(address: SocketAddress?) -> Bool {
+        return !cidrTable.isEmpty && cidrTable.lookup(address) != nil
+    }
+
+    // 字面 IP，不是 IP 的返回 false，不做 DNS 解析
+    func matching(ip: String) -> Bool {
+        return !cidrTable.isEmpty && cidrTable.lookup(ip) != nil
+    }
+}
+
+// 某一时刻规则的只读快照
+// EventLoop 上的匹配只读快照，不访问 Rule.lines，编辑规则与匹配互不影响
+final class RuleSnapshot {
+
+    let version: UInt
+    let defaultStrategy: Strategy
+    let rules: RuleMatchSet
+    let blacklist: RuleMatchSet?    // 默认黑名单未启用时为 nil
+    let captureFilter: CaptureFilter?
+    let captureOtherwise: CaptureMode
+
+    static let empty = RuleSnapshot(version: 0, defaultStrategy: .COPY, rules: .empty, blacklist: nil)
+
+    init(version: UInt, defaultStrategy: Strategy, rules: RuleMatchSet, blacklist: RuleMatchSet?,
+         captureFilter: CaptureFilter? = nil, captureOtherwise: CaptureMode = .headers) {
+        self.version = version
+        self.defaultStrategy = defaultStrategy
+        self.rules = rules
+        self.blacklist = blacklist
+        self.captureFilter = captureFilter
+        self.captureOtherwise = captureOtherwise
+    }
+
+    func matchingHost(host: String, target: String) -> Bool {
+        let lowerHost = host.lowercased()
+        let lowerTarget = target.lowercased()
+        if let blacklist = blacklist, blacklist.matchingHost(lowerHost: lowerHost, lowerTarget: lowerTarget) {
+            return true
+        }
+        return rules.matchingHost(lowerHost: lowerHost, lowerTarget: lowerTarget)
+    }
+
+    func matchingPath(host: String, uri: String) -> Bool {
+        var fullUri = uri
+        if uri.hasPrefix("/") {
+            fullUri = host + uri
+        }
+        let lowerUri = fullUri.lowercased()
+        if let blacklist = blacklist, blacklist.matchingPath(host: host, fullUri: fullUri, lowerUri: lowerUri) {
+            return true
+        }
+        return rules.matchingPath(host: host, fullUri: fullUri, lowerUri: lowerUri)
+    }
+
+    func matching(address: SocketAddress?) -> Bool {
+        if let blacklist = blacklist, blacklist.matching(address: address) {
+            return true
+        }
+        return rules.matching(address: address)
+    }
+
+    func matching(ip: String) -> Bool {
+        if let blacklist = blacklist, blacklist.matching(ip: ip) {
+            return true
+        }
+        return rules.matching(ip: ip)
+    }
+
+    // 没有过滤表达式时全部完整保存
+    func captureMode(_ input: CaptureInput) -> CaptureMode {
+        guard let filter = captureFilter else { return .full }
+        return filter.evaluate(input) ? .full : captureOtherwise
+    }
+
+    // 命中规则且默认策略为 DIRECT，或未命中且默认策略为 COPY 时，不记录
+    func decision(_ hit: Bool) -> Strategy {
+        let ignore = hit != (defaultStrategy == .COPY)
+        return ignore ? .DIRECT : .COPY
+    }
+}
+
+// 当前快照的原子指针
+// 读：一次原子 load，无锁；写：原子 exchange 发布新快照，旧快照延迟释放，保证正在匹配的读者不会读到已释放的对象
+final class RuleSnapshotBox {
+
+    // 旧快照的保留时间，远大于一次匹配的耗时
+    static let gracePeriod: DispatchTimeInterval = .seconds(5)
+
+    private let pointer: Atomic<UInt>
+
+    init(_ snapshot: RuleSnapshot) {
+        pointer = Atomic<UInt>(value: UInt(bitPattern: Unmanaged.passRetained(snapshot).toOpaque()))
+    }
+
+    deinit {
+        Unmanaged<RuleSnapshot>.fromOpaque(UnsafeRawPointer(bitPattern: pointer.load())!).release()
+    }
+
+    func load() -> RuleSnapshot {
+        return Unmanaged<RuleSnapshot>.fromOpaque(UnsafeRawPointer(bitPattern: pointer.load())!).takeUnretainedValue()
+    }
+
+    func publish(_ snapshot: RuleSnapshot) {
+        let new = UInt(bitPattern: Unmanaged.passRetained(snapshot).toOpaque())
+        let old = pointer.exchange(with: new)
+        DispatchQueue.global().asyncAfter(deadline: .now() + RuleSnapshotBox.gracePeriod) {
+            Unmanaged<RuleSnapshot>.fromOpaque(UnsafeRawPointer(bitPattern: old)!).release()
+        }
+    }
+}
+
+private extension String {
+    func urlEncoded() -> String {
+        guard let result = self.addingPercentEncoding(withAllowedCharacters: _allowedCharacters) else {
+            return "jfaongkxhaugksnxhghrkdghxgiajgnfkhnknxnkjiwoietoi"
+        }
+        return result
+    }
+}
+
+private var _allowedCharacters: CharacterSet = {
+    var allowed = CharacterSet.urlQueryAllowed
+    allowed.remove("+")
+    return allowed
+}()
@@ -0,0 +1,165 @@
+//
+//  URLRegexMatcher.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/6/20.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+
+// URL-REGEX 规则预编译匹配器
+// 解析配置时一次性编译所有 URL-REGEX 规则；匹配时先用字面量前缀、必含子串过滤，通过过滤的规则才执行正则
+final class URLRegexMatcher {
+
+    struct Entry {
+        let index: Int                      // 规则所在行号
+        let regex: NSRegularExpression
+        let prefix: String                  // 整串匹配时必须以此开头，"" 表示无
+        let literal: String                 // 必须包含的最长字面量，"" 表示无
+    }
+
+    private(set) var entries = [Entry]()
+
+    var isEmpty: Bool {
+        return entries.isEmpty
+    }
+
+    init(items: [RuleItem]) {
+        for item in items where item.matchRule == .URLREGEX {
+            guard let regex = item.regex else {
+                // 正常情况下 RuleItem.fromLine 已经拒绝了无效正则
+                print("Invalid Regex:\(item.value)")
+                continue
+            }
+            let literals = URLRegexMatcher.literals(of: item.value)
+            entries.append(Entry(index: item.index, regex: regex, prefix: literals.prefix, literal: literals.literal))
+        }
+    }
+
+    // 与原来 NSPredicate(format: "SELF MATCHES %@") 语义一致：整串匹配、区分大小写
+    static func compile(_ pattern: String) -> NSRegularExpression? {
+        return try? NSRegularExpression(pattern: "^(?:\(pattern))$", options: [])
+    }
+
+    // 返回第一个命中的规则行号，未命中返回 nil
+    func firstMatch(_ subjects: [String]) -> Int? {
+        for entry in entries {
+            for subject in subjects {
+                if entry.prefix != "", !subject.hasPrefix(entry.prefix) { continue }
+                if entry.literal != "", !subject.contains(entry.literal) { continue }
+                let range = NSRange(subject.startIndex..<subject.endIndex, in: subject)
+                if entry.regex.firstMatch(in: subject, options: [], range: range) != nil {
+                    return entry.index
+                }
+            }
+        }
+        return nil
+    }
+
+    // 提取正则的字面量前缀与最长必含字面量
+    // 只分析顶层序列：含顶层 "|" 或内联选项 "(?" 时不做过滤
+    static func literals(of pattern: String) -> (prefix: String, literal: String) {
+        let chars = Array(pattern)
+        var runs = [String]()
+        var current = ""
+        var currentAtStart = true   // 当前字面量是否从串首开始
+        var prefix = ""
+        var prefixClosed = false
+        var i = 0
+
+        func closeRun() {
+            if currentAtStart, !prefixClosed {
+                prefix = current
+                prefixClosed = true
+            }
+            if current != "" { runs.append(current) }
+            current = ""
+            currentAtStart = false
+        }
+
+        // 带参数的转义（\x41 \u0041 \0101 \cA \p{L} \k<name> \12），参数也不是字面量，整体跳过
+        func escapeEnd(_ escape: Character, _ start: Int) -> Int {
+            func skip(_ limit: Int, _ allowed: (Character) -> Bool) -> Int {
+                var j = start
+                while j < chars.count, j - start < limit, allowed(chars[j]) { j += 1 }
+                return j
+            }
+            func braced(_ open: Character, _ close: Character) -> Int? {
+                guard start < chars.count, chars[start] == open else { return nil }
+                var j = start
+                while j < chars.count, chars[j] != close { j += 1 }
+                return min(j + 1, chars.count)
+            }
+            switch escape {
+            case "x": return braced("{", "}") ?? skip(2, { $0.isHexDigit })
+            case "u": return skip(4, { $0.isHexDigit })
+            case "U": return skip(8, { $0.isHexDigit })
+            case "0": return skip(3, { ("0"..."7").contains($0) })
+            case "1"..."9": return skip(Int.max, { $0.isNumber })
+            case "c": return min(start + 1, chars.count)
+            case "N": return braced("{", "}") ?? start
+            case "p", "P": return braced("{", "}") ?? min(start + 1, chars.count)
+            case "k": return braced("<", ">") ?? start
+            default: return start
+            }
+        }
+
+        if chars.first == "^" { i = 1 }
+        while i < chars.count {
+            let c = chars[i]
+            switch c {
+            case "|":
+                return ("", "")
+            case "\\":
+                guard i + 1 < chars.count else { return ("", "") }
+                let next = chars[i + 1]
+                i += 2
+                if next == "Q" { return ("", "") }     // \Q...\E 不解析
+                if next.isLetter || next.isNumber {
+                    closeRun()      // \d \w \s \b 等
+                    i = escapeEnd(next, i)
+                } else {
+                    current.append(next)
+                }
+                continue
+            case "?", "*", "{":
+                // 前一个字符可以不出现
+                if current != "" { current.removeLast() }
+                closeRun()
+                if c == "{" {
+                    while i < chars.count, chars[i] != "}" { i += 1 }
+                }
+            case "+":
+                closeRun()
+            case ".", "$", ")":
+                closeRun()
+            case "[":
+                closeRun()
+                i += 1
+                if i < chars.count, chars[i] == "]" { i += 1 }
+                while i < chars.count, chars[i] != "]" {
+                    if chars[i] == "\\" { i += 1 }
+                    i += 1
+                }
+            case "(":
+                if i + 1 < chars.count, chars[i + 1] == "?" { return ("", "") }
+                closeRun()
+                // 跳过整个分组，分组内的 "|" 不影响顶层
+                var depth = 0
+                while i < chars.count {
+                    if chars[i] == "\\" { i += 2; continue }
+                    if chars[i] == "(" { depth += 1 }
+                    if chars[i] == ")" { depth -= 1; if depth == 0 { break } }
+                    i += 1
+                }
+            default:
+                current.append(c)
+            }
+            i += 1
+        }
+        closeRun()
+        let literal = runs.max(by: { $0.count < $1.count }) ?? ""
+        return (prefix, literal)
+    }
+}
@@ -23,6 +23,22 @@ public let JSTypes = ["javascript","x-javascript"]
 public let CSSTypes = ["css"]
 public let urlEncodedTypes = ["x-www-form-urlencoded"]
 
+// 会话列表的分页游标：上一页最后一条的 startTime 和 id
+public struct SessionCursor {
+    public let startTime: Double
+    public let id: Int
+    
+    public init(startTime: Double, id: Int) {
+        self.startTime = startTime
+        self.id = id
+    }
+    
+    public init?(_ session: Session?) {
+        guard let time = session?.startTime?.doubleValue, let id = session?.id?.intValue else { return nil }
+        self.init(startTime: time, id: id)
+    }
+}
+
 public class Session: ASModel {
                                         // https http
     public var taskID:NSNumber?         // *
@@ -39,7 +55,8 @@ public class Session: ASModel {
     public var reqHttpVersion:String?   // Http/1.1
     public var reqType:String = ""      // .gif\.js\.css * Content-Type
     public var reqEncoding:String = ""  // gzip x-gzip compress deflate identity br ...  Content-Encoding
-    public var reqHeads:String?         // [{"key":"value"},{"key2":"value2"},...]
+    public var reqHeads:String?         // [{"key":"value"},{"key2":"value2"},...] 旧版本记录，新记录写入 reqHeadBlock
+    public var reqHeadBlock:Data?       // HPACK 编码的请求头，保留顺序和重复项，见 HeaderBlock
     public var reqBody:String = ""
     public var reqDisposition:String = ""
     public var target:String?           // Safari\qq
@@ -50,7 +67,8 @@ public class Session: ASModel {
     public var rspType:String = ""      // .gif\.js\.css * Content-Type
     public var rspEncoding:String = ""  // gzip br ...  Content-Encoding
     public var rspDisposition:String = ""       // Content-Disposition
-    public var rspHeads:String?         // [{"key":"value"},{"key2":"value2"},...] *
+    public var rspHeads:String?         // [{"key":"value"},{"key2":"value2"},...] * 旧版本记录，新记录写入 rspHeadBlock
+    public var rspHeadBlock:Data?       // HPACK 编码的响应头
     public var rspBody:String = ""
     // session time
     public var startTime:NSNumber?      // 开始时间 *
@@ -75,6 +93,9 @@ public class Session: ASModel {
     public var outState:String?  // open -> close
     // 忽略即不保存
     public var ignore:Bool = false
+    public var captureBody:Bool = true  // 抓包过滤为 headers 时不写响应体，已保存的请求体回收
+    var reqBodyOpen = false             // 已提交分片、还没有结束标记的 body，连接关闭时补上
+    var rspBodyOpen = false
     
 //    public var master:NIOTSEventLoopGroup?
 //    public var worker:NIOTSEventLoopGroup?
@@ -123,19 +144,54 @@ public class Session: ASModel {
         return "\(MitmService.getStoreFolder())\(fileFolder ?? "error")/\(rspBody)"
     }
     
-    public func getBodyFullPath(_ isReq:Bool = false) -> String{
+    // 旧版本每个 body 一个文件，只读；新的 body 在 Task 的 BodyStore 中，不再写到这个路径
+    func legacyBodyPath(_ isReq:Bool = false) -> String{
         return "\(MitmService.getStoreFolder())\(fileFolder ?? "error")/\(isReq ? reqBody :rspBody)"
     }
     
+    // 需要文件路径（分享、导出）时：接收完毕的 body 导出到临时目录，按 (folder, 长度, 文件名) 命名，内容变了就是另一个文件
+    // 还在接收中的返回 nil，界面读取直接用 getBodyData
+    public func exportBodyFile(_ isReq:Bool = false) -> URL? {
+        let name = isReq ? reqBody : rspBody
+        if name == "" { return nil }
+        let filePath = legacyBodyPath(isReq)
+        if FileManager.default.fileExists(atPath: filePath) { return URL(fileURLWithPath: filePath) }
+        guard (isReq ? reqEndTime : rspEndTime) != nil || endTime != nil,
+            let sessionID = id?.intValue, let folder = fileFolder else { return nil }
+        let reader = BodyStore.Reader.reader(for: folder)
+        let size = reader.size(sessionID: sessionID, isReq: isReq)
+        guard size > 0 else { return nil }
+        let dir = NSTemporaryDirectory() + "BodyExport/"
+        let exportPath = "\(dir)\(folder)-\(size)-\(name)"
+        if FileManager.default.fileExists(atPath: exportPath) { return URL(fileURLWithPath: exportPath) }
+        try? FileManager.default.createDirectory(atPath: dir, withIntermediateDirectories: true, attributes: nil)
+        // 先写临时文件再改名，导出一半的文件不会被当成完整的
+        let tempPath = exportPath + ".part"
+        guard reader.export(sessionID: sessionID, isReq: isReq, to: tempPath) else { return nil }
+        guard rename(tempPath, exportPath) == 0 else {
+            unlink(tempPath)
+            return nil
+        }
+        return URL(fileURLWithPath: exportPath)
+    }
+    
+    func storedBody(_ isReq:Bool) -> Data? {
+        guard let sessionID = id?.intValue, let folder = fileFolder else { return nil }
+        return BodyStore.Reader.reader(for: folder).read(sessionID: sessionID, isReq: isReq)
+    }
+    
     public func hasBodyFile(_ isReq:Bool = false) -> Bool{
-        let filePath = getBodyFullPath(isReq)
-        let fn = FileManager.default
-        return fn.fileExists(atPath: filePath)
+        if FileManager.default.fileExists(atPath: legacyBodyPath(isReq)) { return true }
+        guard let sessionID = id?.intValue, let folder = fileFolder else { return false }
+        return BodyStore.Reader.reader(for: folder).contains(sessionID: sessionID, isReq: isReq)
     }
     
     public func getBodyData(_ isReq:Bool = false) -> Data?{
-        if !hasBodyFile(isReq) { return nil }
-        return try? Data(contentsOf: URL(fileURLWithPath: getBodyFullPath(isReq)))
+        let filePath = legacyBodyPath(isReq)
+        if FileManager.default.fileExists(atPath: filePath) {
+            return try? Data(contentsOf: URL(fileURLWithPath: filePath))
+        }
+        return storedBody(isReq)
     }
     
     public func getDecodedBody(_ isReq:Bool = false) -> Data?{
@@ -151,9 +207,19 @@ public class Session: ASModel {
         return originalData
     }
     
+    // 抓包队列满时丢弃了部分分片，保存的 body 不完整
+    public func isBodyTruncated(_ isReq:Bool = false) -> Bool {
+        guard let sessionID = id?.intValue, let folder = fileFolder else { return false }
+        return BodyStore.Reader.reader(for: folder).isTruncated(sessionID: sessionID, isReq: isReq)
+    }
+    
     public func getBodySize(_ isReq:Bool = false) -> UInt64 {
-        if !hasBodyFile(isReq) { return 0 }
-        return Session.getSize(url: URL(fileURLWithPath: getBodyFullPath(isReq)))
+        let filePath = legacyBodyPath(isReq)
+        if FileManager.default.fileExists(atPath: filePath) {
+            return Session.getSize(url: URL(fileURLWithPath: filePath))
+        }
+        guard let sessionID = id?.intValue, let folder = fileFolder else { return 0 }
+        return BodyStore.Reader.reader(for: folder).size(sessionID: sessionID, isReq: isReq)
     }
     
     public static func getSize(url: URL)->UInt64{
@@ -179,6 +245,8 @@ public class Session: ASModel {
     // func
     public static func newSession(_ task:Task) -> Session {
         let  session = Session()
+        // id 在内存中分配，写文件、关联记录不需要等数据库插入
+        session.id = SessionWriter.shared.allocateID()
         session.taskID = task.id
         session.startTime = NSNumber(value: Date().timeIntervalSince1970)
         session.fileFolder = task.fileFolder
@@ -186,7 +254,7 @@ public class Session: ASModel {
     }
     
     func writeBody(type:FileType,buffer:ByteBuffer?, realName:String = ""){
-        if id == nil || fileFolder == nil { return }
+        if id == nil || fileFolder == nil { return }   // id 在 newSession 时已分配
         
 //        if type == .RSP { return }
         
@@ -197,33 +265,54 @@ public class Session: ASModel {
             rspBody = "rsp_\(id!.stringValue)\(realName)"
         }
         guard let body = buffer else {
+            // body 结束，抓包线程算完摘要后去重
+            CaptureStage.shared.finish(folder: fileFolder!, sessionID: id!.intValue, isReq: type == .REQ)
+            if type == .REQ { reqBodyOpen = false } else { rspBodyOpen = false }
             return
         }
-        
-        var filePath = type == .REQ ? reqBody : rspBody
-        filePath = "\(MitmService.getStoreFolder())\(fileFolder ?? "error")/\(filePath)"
-        let fileManager = FileManager.default
-        let exist = fileManager.fileExists(atPath: filePath)
-        if !exist {
-            fileManager.createFile(atPath: filePath, contents: nil, attributes: nil)
+        if type == .REQ { reqBodyOpen = true } else { rspBodyOpen = true }
+        // 交给抓包线程写入 BodyStore，EventLoop 上不做磁盘 IO
+        let deltaKey = BodyStore.deltaEncoding && type == .RSP ? "\(methods ?? "") \(getFullUrl())" : nil
+        CaptureStage.shared.submit(folder: fileFolder!, sessionID: id!.intValue, isReq: type == .REQ, buffer: body, deltaKey: deltaKey)
+    }
+    
+    // 连接关闭时调用：没有收到结尾的 body 补上结束标记（以关闭结束的响应体也在这里结束），
+    // 否则 BodyStore 中的摘要状态、差分缓存和环上的截断记录一直留在内存中
+    // 两个 Channel 关闭时都会调用，补过之后不再重复
+    func finishBodies() {
+        guard reqBodyOpen || rspBodyOpen, let sessionID = id?.intValue, let folder = fileFolder else { return }
+        if ignore {
+            // discard 已回收；这里只清理环上的截断记录
+            CaptureStage.shared.discard(folder: folder, sessionID: sessionID)
+        } else {
+            if reqBodyOpen { CaptureStage.shared.finish(folder: folder, sessionID: sessionID, isReq: true) }
+            if rspBodyOpen { CaptureStage.shared.finish(folder: folder, sessionID: sessionID, isReq: false) }
         }
-        
-        guard let data = body.getData(at: body.readerIndex, length: body.readableBytes) else {
-            print("no data !")
-            return
+        reqBodyOpen = false
+        rspBodyOpen = false
+    }
+    
+    // 抓包过滤决定不保存：删除已保存的记录，BodyStore 中已写入的请求体由抓包线程打洞回收
+    func discard() {
+        ignore = true
+        SessionWriter.shared.delete(self)
+        if reqBody != "" || reqBodyOpen || rspBodyOpen, let sessionID = id?.intValue, let folder = fileFolder {
+            CaptureStage.shared.discard(folder: folder, sessionID: sessionID)
         }
-//        do {
-//            try data.append(fileURL: URL(fileURLWithPath: filePath))
-//        } catch  {
-//            print("文件:\(filePath)写入出错：\(error)")
-//        }
-        
-        let fileHandle = FileHandle(forWritingAtPath: filePath)
-        if exist {
-            fileHandle?.seekToEndOfFile()
+        reqBody = ""
+        reqBodyOpen = false
+        rspBodyOpen = false
+    }
+    
+    // 抓包过滤为 headers：只保留头部，已提交的请求体由抓包线程打洞回收
+    func dropRequestBody() {
+        captureBody = false
+        if reqBody != "" || reqBodyOpen || rspBodyOpen, let sessionID = id?.intValue, let folder = fileFolder {
+            CaptureStage.shared.discard(folder: folder, sessionID: sessionID)
         }
-        fileHandle?.write(data)
-        fileHandle?.closeFile()
+        reqBody = ""
+        reqBodyOpen = false
+        rspBodyOpen = false
     }
     
     func createBodyFiles() -> Bool{
@@ -258,26 +347,52 @@ public class Session: ASModel {
         return ""
     }
     
-    static func getHeadsJson(headers: HTTPHeaders) -> String {
-        var reqHeads = [String:String]()
-        for kv in headers {
-            reqHeads[kv.name] = kv.value
+    // 按原始顺序返回头部，用到时才解码；旧记录从 JSON 字典读取
+    public func headers(_ isReq:Bool) -> [(name:String, value:String)] {
+        if let block = isReq ? reqHeadBlock : rspHeadBlock {
+            return HeaderBlock.decode(block)
         }
-        return reqHeads.toJson()
+        guard let json = isReq ? reqHeads : rspHeads else { return [] }
+        return Dictionary<String, String>.fromJson(json).map { (name: $0.key, value: $0.value) }
+    }
+    
+    // 兼容以 JSON 字典展示头部的页面
+    public func headsJson(_ isReq:Bool) -> String? {
+        if let block = isReq ? reqHeadBlock : rspHeadBlock {
+            return HeaderBlock.json(block)
+        }
+        return isReq ? reqHeads : rspHeads
     }
     
     public func saveToDB() throws{
         if ignore { return }
         saveCount = NSNumber(value: saveCount.intValue + 1)
-        try save()
+        // 交给写入线程合并、批量提交，EventLoop 不访问数据库
+        SessionWriter.shared.save(self)
     }
     
-    public static func groupBy(taskID:NSNumber?,type:String) -> [[String:String]]{
-        let db = try! ASConfigration.getDefaultDB()
+    // 筛选面板的分类计数；没有其他筛选条件时读 SessionFacet，有条件时在筛选结果上 group by
+    // Task 分库中的 SessionFacet 随分库一起建好；已存档的 Task 在存档的列上计数
+    public static func groupBy(taskID:NSNumber?,type:String,keyWord:String? = nil,params:[String:[String]]? = nil) -> [[String:String]]{
+        if let reader = SessionArchive.reader(taskID: taskID?.intValue) {
+            let filtered = (keyWord ?? "") != "" || !(params ?? [:]).isEmpty
+            let rows = filtered ? reader.select(keyWord: keyWord, params: params, before: Date().timeIntervalSince1970) : nil
+            return reader.groupBy(type, rows: rows)
+        }
+        let db = try! ASConfigration.getReadDB()
+        let schema = SessionStore.schema(db, taskID: taskID?.intValue)
+        defer { SessionStore.release(db, schema) }
         var group = [[String:String]]()
         do {
 //            let startTime = CFAbsoluteTimeGetCurrent()
-            let sql = "SELECT \(type), count(\(type)) as count FROM Session WHERE \(taskID == nil ? "1 = 1" : "taskID = \(taskID!)") GROUP BY \(type)"
+            var sql = "SELECT \(type), count(\(type)) as count FROM \(schema).Session WHERE \(taskID == nil ? "1 = 1" : "taskID = \(taskID!)") GROUP BY \(type)"
+            let filtered = (keyWord ?? "") != "" || !(params ?? [:]).isEmpty
+            if filtered {
+                let (fromStr, whereStr, _) = getFilter(taskID: taskID.map { "\($0)" }, keyWord: keyWord, params: params, timeInterval: Date().timeIntervalSince1970, db: db, schema: schema)
+                sql = "SELECT \(type), count(\(type)) as count FROM \(fromStr) WHERE \(whereStr) GROUP BY \(type)"
+            } else if SessionFacets.isFacet(type), schema != SessionStore.catalog || SessionFacets.prepare(try ASConfigration.getDefaultDB()) {
+                sql = "SELECT value, sum(count) as count FROM \(schema).\(SessionFacets.tableName) WHERE facet = '\(type)' \(taskID == nil ? "" : "and taskID = \(taskID!)") GROUP BY value"
+            }
 //            let result = try db.run(sql)
             let result = try db.prepare(sql)
             for r in result {
@@ -296,18 +411,39 @@ public class Session: ASModel {
         return group
     }
     
-    public static func getSQL(taskID:String?,keyWord:String?,params:[String:[String]]?,pageSize:Int = 999999,pageIndex:Int = 0,orderBy:String?, timeInterval:Double = Date().timeIntervalSince1970, isCount:Bool = false) -> String {
-        var sql = "select \(isCount ? "id" : "*") from Session where"
-        // 精确匹配项
-        let equals = ["taskID", "host", "schemes", "methods", "suffix", "reqHttpVersion", "target", "state", "rspType"]
+    // 精确匹配项，其余按子串匹配；SessionArchive 的过滤与这里一致
+    static let equalColumns = ["taskID", "host", "schemes", "methods", "suffix", "reqHttpVersion", "target", "state", "rspType"]
+    // 头部新记录存在二进制列中
+    static let headBlockColumns = ["reqHeads":"reqHeadBlock", "rspHeads":"rspHeadBlock"]
+    
+    // 拼接 from 和 where，返回 (from, where, 是否使用了搜索索引)
+    // schema 为 Task 分库时表中只有这个 Task 的会话，不再按 taskID 过滤
+    static func getFilter(taskID:String?,keyWord:String?,params:[String:[String]]?, timeInterval:Double, db:Connection? = nil, schema:String = SessionStore.catalog) -> (String, String, Bool) {
+        let partitioned = schema != SessionStore.catalog
+        var fromStr = partitioned ? "\(schema).Session as Session" : "Session"
+        var searchRanked = false
+        let equals = equalColumns
         // 模糊匹配项
         //        let likes = ["remoteAddress", "localAddress", "uri", "reqHeads", "rspMessage", "rspEncoding", "rspHeads"]
         // 关键词搜索项
         let searchKeys = ["remoteAddress","localAddress","host","schemes","reqLine",
                           "reqHeads","target","state","rspMessage","rspHeads"]
+        // 头部块是 HPACK 编码，不能直接按字节匹配：有搜索索引时在索引的头部列（解码后的文本，旧记录为 JSON）中匹配，
+        // 否则用 headertext() 解码后 like
+        let headBlocks = headBlockColumns
+        let db = db ?? (try? getDB())
+        let indexed = db.map { SessionSearchIndex.checkAvailable($0, schema: schema) } ?? false
+        if let db = db { HeaderBlock.register(db) }
+        func like(_ column:String, _ v:String) -> String {
+            guard let block = headBlocks[column] else { return "lower(\(column)) like '%\(v)%'" }
+            if indexed, let phrase = SessionSearchIndex.matchPhrase(v) {
+                return "Session.id in (select rowid from \(schema).\(SessionSearchIndex.tableName) where \(SessionSearchIndex.tableName) match '\(column) : \(phrase)')"
+            }
+            return "(lower(\(column)) like '%\(v)%' or lower(\(HeaderBlock.functionName)(\(block))) like '%\(v)%')"
+        }
         // "startTime", "uploadTraffic", "downloadFlow"
         var whereStr = ""
-        if let tID = taskID, tID != ""{
+        if let tID = taskID, tID != "", !partitioned {
             whereStr = "taskID = \(tID)"
         }
         // params
@@ -320,7 +456,7 @@ public class Session: ASModel {
                 if isEqual {
                     orStr = "\(orStr) lower(\(kv.key)) = '\(v.lowercased())' \(i == kv.value.count - 1 ? "" : "or")"
                 }else{
-                    orStr = "\(orStr) lower(\(kv.key)) like '%\(v.lowercased())%' \(i == kv.value.count - 1 ? "" : "or")"
+                    orStr = "\(orStr) \(like(kv.key, v.lowercased())) \(i == kv.value.count - 1 ? "" : "or")"
                 }
             }
             orStr = "(\(orStr))"
@@ -331,12 +467,16 @@ public class Session: ASModel {
                 whereStr = "\(whereStr) \(orStr) \(count == params?.count ? "" : "and")"
             }
         }
-        // keyWord
-        if let key = keyWord, key != "" {
+        // keyWord：有搜索索引时用 FTS5 子串匹配，否则 like 全表扫描
+        if let key = keyWord, key != "", indexed,
+            let phrase = SessionSearchIndex.matchPhrase(key.lowercased()) {
+            fromStr = "\(fromStr) join (select rowid as searchID, rank as searchRank from \(schema).\(SessionSearchIndex.tableName) where \(SessionSearchIndex.tableName) match '\(phrase)') on searchID = Session.id"
+            searchRanked = true
+        } else if let key = keyWord, key != "" {
             var orStr = ""
             for i in 0..<searchKeys.count {
                 let item = searchKeys[i]
-                orStr = "\(orStr) lower(\(item)) like '%\(key.lowercased())%' \(i == searchKeys.count - 1 ? "" : "or")"
+                orStr = "\(orStr) \(like(item, key.lowercased())) \(i == searchKeys.count - 1 ? "" : "or")"
             }
             orStr = "(\(orStr))"
             if whereStr != ""{
@@ -347,23 +487,62 @@ public class Session: ASModel {
         }
         if whereStr == "" { whereStr = "1 = 1" }
         whereStr = whereStr + " and startTime < \(timeInterval)"
+        return (fromStr, whereStr, searchRanked)
+    }
+    
+    // cursor 不为空且按默认的 startTime 排序时使用游标分页（从上一页最后一条之后开始），不再 offset 跳过前面的行
+    public static func getSQL(taskID:String?,keyWord:String?,params:[String:[String]]?,pageSize:Int = 999999,pageIndex:Int = 0,orderBy:String?, timeInterval:Double = Date().timeIntervalSince1970, isCount:Bool = false, cursor:SessionCursor? = nil, db:Connection? = nil, schema:String = SessionStore.catalog) -> String {
+        let (fromStr, filterStr, searchRanked) = getFilter(taskID: taskID, keyWord: keyWord, params: params, timeInterval: timeInterval, db: db, schema: schema)
+        var whereStr = filterStr
         // order by
         var orderByStr = ""
-        if let oby = orderBy, oby != ""{
+        var limitStr = "limit \(pageSize) offset \(pageIndex*pageSize)"
+        if orderBy == "rank" {
+            // 按搜索相关度排序，没有关键词时按时间
+            orderByStr = searchRanked ? "order by searchRank" : "order by startTime desc"
+        }else if let oby = orderBy, oby != ""{
             orderByStr = "order by \(oby) desc"
         }else{
-            orderByStr = "order by startTime desc"
+            // 与索引 (taskID, startTime, id) 和分库的 (startTime, id) 顺序一致
+            orderByStr = "order by startTime desc, Session.id desc"
+            if let c = cursor {
+                whereStr = whereStr + " and (startTime < \(c.startTime) or (startTime = \(c.startTime) and Session.id < \(c.id)))"
+                limitStr = "limit \(pageSize)"
+            }
         }
-        // limit offset
-        let limitStr = "limit \(pageSize) offset \(pageIndex*pageSize)"
-        sql = "\(sql) \(whereStr) \(orderByStr) \(limitStr)"
+        let sql = "select \(isCount ? "Session.id" : "Session.*") from \(fromStr) where \(whereStr) \(orderByStr) \(limitStr)"
         return sql
     }
     
+    // 只返回数量，不取出 id
+    public static func count(taskID:String?,keyWord:String?,params:[String:[String]]?, timeInterval:Double = Date().timeIntervalSince1970) -> Int {
+        if let reader = SessionArchive.reader(taskID: taskID.flatMap { Int($0) }) {
+            return reader.select(keyWord: keyWord, params: params, before: timeInterval).count
+        }
+        do {
+            let db = try ASConfigration.getReadDB()
+            let schema = SessionStore.schema(db, taskID: taskID.flatMap { Int($0) })
+            defer { SessionStore.release(db, schema) }
+            let (fromStr, whereStr, _) = getFilter(taskID: taskID, keyWord: keyWord, params: params, timeInterval: timeInterval, db: db, schema: schema)
+            let count = try db.scalar("select count(*) from \(fromStr) where \(whereStr)") as? Int64
+            return Int(count ?? 0)
+        } catch {
+            print("count error:\(error)")
+            return 0
+        }
+    }
+    
     public static func countWith(taskID:String?,keyWord:String?,params:[String:[String]]?,pageSize:Int = 999999,pageIndex:Int = 0,orderBy:String?, timeInterval:Double = Date().timeIntervalSince1970) -> [Int] {
-        let sql = getSQL(taskID: taskID, keyWord: keyWord, params: params, pageSize: pageSize, pageIndex: pageIndex, orderBy: "id", timeInterval: timeInterval, isCount: true)
+        if let reader = SessionArchive.reader(taskID: taskID.flatMap { Int($0) }) {
+            let ids = reader.numbers("id")
+            let rows = reader.select(keyWord: keyWord, params: params, before: timeInterval)
+            return page(rows.compactMap { ids[$0] }.map { Int($0) }.sorted(by: >), pageSize, pageIndex)
+        }
+        let db = try! ASConfigration.getReadDB()
+        let schema = SessionStore.schema(db, taskID: taskID.flatMap { Int($0) })
+        defer { SessionStore.release(db, schema) }
+        let sql = getSQL(taskID: taskID, keyWord: keyWord, params: params, pageSize: pageSize, pageIndex: pageIndex, orderBy: "id", timeInterval: timeInterval, isCount: true, db: db, schema: schema)
         //        print("sql:\(sql)")
-        let db = try! ASConfigration.getDefaultDB()
         var results = [Int]()
         do {
             let result = try db.prepare(sql)
@@ -378,21 +557,24 @@ public class Session: ASModel {
         return results
     }
     
-    public static func findAll(taskID:String?,keyWord:String?,params:[String:[String]]?,pageSize:Int = 999999,pageIndex:Int = 0,orderBy:String?, timeInterval:Double = Date().timeIntervalSince1970) -> [Session] {
-        let sql = getSQL(taskID: taskID, keyWord: keyWord, params: params, pageSize: pageSize, pageIndex: pageIndex, orderBy: orderBy, timeInterval: timeInterval, isCount: false)
+    public static func findAll(taskID:String?,keyWord:String?,params:[String:[String]]?,pageSize:Int = 999999,pageIndex:Int = 0,orderBy:String?, timeInterval:Double = Date().timeIntervalSince1970, cursor:SessionCursor? = nil) -> [Session] {
+        if let reader = SessionArchive.reader(taskID: taskID.flatMap { Int($0) }) {
+            // 与 getSQL 相同：默认排序时用游标分页，rank 在存档中按时间
+            let byTime = orderBy == nil || orderBy == "" || orderBy == "rank"
+            let useCursor = cursor != nil && (orderBy ?? "") == ""
+            var rows = reader.select(keyWord: keyWord, params: params, before: timeInterval, cursor: useCursor ? cursor : nil)
+            if !byTime { rows = reader.sorted(rows, by: orderBy!) }
+            return reader.sessions(useCursor ? Array(rows.prefix(pageSize)) : page(rows, pageSize, pageIndex))
+        }
+        let db = try! ASConfigration.getReadDB()
+        let schema = SessionStore.schema(db, taskID: taskID.flatMap { Int($0) })
+        defer { SessionStore.release(db, schema) }
+        let sql = getSQL(taskID: taskID, keyWord: keyWord, params: params, pageSize: pageSize, pageIndex: pageIndex, orderBy: orderBy, timeInterval: timeInterval, isCount: false, cursor: cursor, db: db, schema: schema)
 //        print("sql:\(sql)")
-        let db = try! ASConfigration.getDefaultDB()
         var sessions = [Session]()
         do {
 //            let startTime = CFAbsoluteTimeGetCurrent()
-            let result = try db.prepare(sql)
-            let columnNames:[String] = result.columnNames
-            for row in result {
-                let session = getWith(columnNames: columnNames, row: row)
-                if session != nil {
-                    sessions.append(session!)
-                }
-            }
+            sessions = try rowDecoder.decode(db, sql)
 //            let endTime = CFAbsoluteTimeGetCurrent()
 //            print("查询时长：\((endTime - startTime)*1000) 毫秒" )
         } catch  {
@@ -401,23 +583,22 @@ public class Session: ASModel {
         return sessions
     }
     
-    public static func findAll(ids:[Int]) -> [Session] {
+    // id 只在 Task 内唯一
+    public static func findAll(taskID:Int?, ids:[Int]) -> [Session] {
         if ids.count <= 0 { return [] }
+        if let reader = SessionArchive.reader(taskID: taskID) {
+            return reader.sessions(reader.rows(ids: ids))
+        }
         let s = ids.map { (id) -> String in return "\(id)" }
-        let sql = "select * from session where id in ( \(s.joined(separator: ",")) )"
+        let db = try! ASConfigration.getReadDB()
+        let schema = SessionStore.schema(db, taskID: taskID)
+        defer { SessionStore.release(db, schema) }
+        let sql = "select * from \(schema).session where id in ( \(s.joined(separator: ",")) )"
         print("sql:\(sql)")
-        let db = try! ASConfigration.getDefaultDB()
         var sessions = [Session]()
         do {
             let startTime = CFAbsoluteTimeGetCurrent()
-            let result = try db.prepare(sql)
-            let columnNames:[String] = result.columnNames
-            for row in result {
-                let session = getWith(columnNames: columnNames, row: row)
-                if session != nil {
-                    sessions.append(session!)
-                }
-            }
+            sessions = try rowDecoder.decode(db, sql)
             let endTime = CFAbsoluteTimeGetCurrent()
             print("查询时长：\((endTime - startTime)*1000) 毫秒" )
         } catch  {
@@ -426,60 +607,62 @@ public class Session: ASModel {
         return sessions
     }
     
-    static func getWith(columnNames:[String],row:Statement.Element) -> Session? {
-        let session = Session()
-        for i in 0..<columnNames.count {
-            let columnName = columnNames[i]
-            guard let value = row[i] else {
-                continue
-            }
-            switch columnName {
-            case "id":session.id =  value as? NSNumber
-            case "taskID":session.taskID =  value as? NSNumber
-            case "remoteAddress":session.remoteAddress =  value as? String
-            case "localAddress":session.localAddress =  value as? String
-            case "host":session.host =  value as? String
-            case "schemes":session.schemes =  value as? String
-            case "reqLine":session.reqLine =  value as? String
-            case "methods":session.methods =  value as? String
-            case "uri":session.uri =  value as? String
-            case "suffix":session.suffix =  value as? String ?? ""
-            case "reqHttpVersion":session.reqHttpVersion =  value as? String
-            case "reqType":session.reqType =  value as? String ?? ""
-            case "reqEncoding":session.reqEncoding =  value as? String ?? ""
-            case "reqHeads":session.reqHeads =  value as? String
-            case "reqBody":session.reqBody =  value as? String ?? ""
-            case "reqDisposition":session.reqDisposition =  value as? String ?? ""
-            case "target":session.target =  value as? String
-            case "rspHttpVersion":session.rspHttpVersion =  value as? String
-            case "state":session.state =  value as? String
-            case "rspMessage":session.rspMessage =  value as? String
-            case "rspType":session.rspType =  value as? String ?? ""
-            case "rspEncoding":session.rspEncoding =  value as? String ?? ""
-            case "rspDisposition":session.rspDisposition =  value as? String ?? ""
-            case "rspHeads":session.rspHeads =  value as? String
-            case "rspBody":session.rspBody =  value as? String ?? ""
-            case "startTime":session.startTime =  value as? NSNumber
-            case "connectTime":session.connectTime =  value as? NSNumber
-            case "connectedTime":session.connectedTime =  value as? NSNumber
-            case "handshakeEndTime":session.handshakeEndTime =  value as? NSNumber
-            case "reqEndTime":session.reqEndTime =  value as? NSNumber
-            case "rspStartTime":session.rspStartTime =  value as? NSNumber
-            case "rspEndTime":session.rspEndTime =  value as? NSNumber
-            case "endTime":session.endTime =  value as? NSNumber
-            case "uploadTraffic":session.uploadTraffic =  value as? NSNumber ?? 0
-            case "downloadFlow":session.downloadFlow =  value as? NSNumber ?? 0
-            case "sstate":session.sstate =  value as? String
-            case "note":session.note =  value as? String
-            case "saveCount":session.saveCount =  value as? NSNumber ?? 0
-            case "inState":session.inState =  value as? String
-            case "outState":session.outState =  value as? String
-            case "fileName":session.fileName =  value as? String ?? ""
-            case "fileFolder":session.fileFolder =  value as? String
-            default:
-                break
-            }
-        }
-        return session
+    private static func page<T>(_ list:[T], _ pageSize:Int, _ pageIndex:Int) -> [T] {
+        let start = min(list.count, max(0, pageIndex) * pageSize)
+        return Array(list[start..<min(list.count, start + pageSize)])
     }
+    
+    // 按列下标解码查询结果，列名只在每条语句准备时解析一次
+    typealias Decoder = RowDecoder<Session>
+    static let rowDecoder = Decoder({ Session() }, bindings: Session.bindings)
+}
+
+// 持久化列表，与反射得到的列一致（doubleTypes 中的列用 double），读写不再经过 Mirror 和 KVC
+extension Session: ASBindingProtocol {
+    public static let bindings: [ASBinding] = [
+        .number("id", \Session.id),
+        .number("taskID", \Session.taskID),
+        .string("remoteAddress", \Session.remoteAddress),
+        .string("localAddress", \Session.localAddress),
+        .string("host", \Session.host),
+        .string("schemes", \Session.schemes),
+        .string("reqLine", \Session.reqLine),
+        .string("methods", \Session.methods),
+        .string("uri", \Session.uri),
+        .string("suffix", \Session.suffix),
+        .string("reqHttpVersion", \Session.reqHttpVersion),
+        .string("reqType", \Session.reqType),
+        .string("reqEncoding", \Session.reqEncoding),
+        .string("reqHeads", \Session.reqHeads),
+        .data("reqHeadBlock", \Session.reqHeadBlock),
+        .string("reqBody", \Session.reqBody),
+        .string("reqDisposition", \Session.reqDisposition),
+        .string("target", \Session.target),
+        .string("rspHttpVersion", \Session.rspHttpVersion),
+        .string("state", \Session.state),
+        .string("rspMessage", \Session.rspMessage),
+        .string("rspType", \Session.rspType),
+        .string("rspEncoding", \Session.rspEncoding),
+        .string("rspDisposition", \Session.rspDisposition),
+        .string("rspHeads", \Session.rspHeads),
+        .data("rspHeadBlock", \Session.rspHeadBlock),
+        .string("rspBody", \Session.rspBody),
+        .double("startTime", \Session.startTime),
+        .double("connectTime", \Session.connectTime),
+        .double("connectedTime", \Session.connectedTime),
+        .double("handshakeEndTime", \Session.handshakeEndTime),
+        .double("reqEndTime", \Session.reqEndTime),
+        .double("rspStartTime", \Session.rspStartTime),
+        .double("rspEndTime", \Session.rspEndTime),
+        .double("endTime", \Session.endTime),
+        .double("uploadTraffic", \Session.uploadTraffic),
+        .double("downloadFlow", \Session.downloadFlow),
+        .string("sstate", \Session.sstate),
+        .string("note", \Session.note),
+        .number("saveCount", \Session.saveCount),
+        .string("inState", \Session.inState),
+        .string("outState", \Session.outState),
+        .string("fileName", \Session.fileName),
+        .string("fileFolder", \Session.fileFolder),
+    ]
 }
@@ -0,0 +1,756 @@
+//
+//  SessionArchive.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/7/8.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import SQLite
+import AxLogger
+import NIOConcurrencyHelpers
+
+// 已结束 Task 的列式冷存档：Task 目录下的 sessions.col，写完后删除分库 sessions.db
+// 文件：magic | 列块 ... | footer(JSON) | footer 长度(4) | magic
+// 每列按 groupSize 行分块，每块单独 LZFSE 压缩；footer 记录每块的编码、位置和长度，读一列不需要解析其他列
+// 块编码：数值列为 null 位图 + zigzag varint 差分（时间列按微秒取整）；字符串列不同值较少时字典编码，否则逐行长度 + 内容；二进制列同后者
+// body 仍在 Task 目录的 BodyStore 数据段中，存档只包含 Session 的列
+// 查询时整列解码后按列过滤（字典列先在字典上求值，再扫描编码），只为取出的一页构造 Session
+// 删除会话只把 id 追加到旁边的 sessions.col.del（每个 8 字节），Reader 读取时屏蔽；删除的行超过 compactRatio 时才重写存档
+final class SessionArchive {
+
+    static let fileName = "sessions.col"
+    static let tombstoneSuffix = ".del"
+    static let version = 1
+    static let groupSize = 8192
+    static let maxReaders = 2               // 缓存的已解码存档数
+    static let compactRatio = 0.25          // 删除的行占比达到时重写存档
+    private static let magic = Array("KNOTCOL1".utf8)
+
+    enum ValueType: String {
+        case int, double, string, data
+    }
+
+    enum Encoding: Int {
+        case delta = 0, dictionary = 1, plain = 2
+    }
+
+    enum Column {
+        case numbers([Int64?])
+        case dictionary(codes: [UInt32], values: [String])     // code 0 为 NULL，其余为 values 下标 + 1
+        case strings([String?])
+        case blobs([Data?])
+    }
+
+    enum ArchiveError: Error {
+        case io(String)
+    }
+
+    typealias RemovedRow = (id: Int, folder: String, req: String, rsp: String)
+
+    private static let lock = Lock()
+    private static var readers = [(path: String, inode: UInt64, tombstones: Int64, reader: Reader)]()     // 最近使用的在后
+
+    static func path(_ folder: String) -> String {
+        return "\(MitmService.getStoreFolder())\(folder)/\(fileName)"
+    }
+
+    static func exists(folder: String) -> Bool {
+        return !folder.isEmpty && access(path(folder), F_OK) == 0
+    }
+
+    // 文件被重写（rename）后 inode 变化，重新打开；.del 文件大小变化时只重新加载删除记录
+    static func reader(taskID: Int?) -> Reader? {
+        guard let id = taskID, let folder = SessionStore.folder(taskID: id) else { return nil }
+        return reader(folder: folder)
+    }
+
+    static func reader(folder: String) -> Reader? {
+        let file = path(folder)
+        var st = stat()
+        guard !folder.isEmpty, stat(file, &st) == 0 else { return nil }
+        let inode = UInt64(st.st_ino)
+        let tombstones = stat(file + tombstoneSuffix, &st) == 0 ? Int64(st.st_size) : 0
+        return lock.withLock {
+            if let index = readers.firstIndex(where: { $0.path == file && $0.inode == inode }) {
+                var entry = readers.remove(at: index)
+                if entry.tombstones != tombstones {
+                    entry.reader.loadTombstones()
+                    entry.tombstones = tombstones
+                }
+                readers.append(entry)
+                return entry.reader
+            }
+            guard let reader = Reader(path: file) else { return nil }
+            readers.removeAll { $0.path == file }
+            readers.append((file, inode, tombstones, reader))
+            if readers.count > maxReaders { readers.removeFirst() }
+            return reader
+        }
+    }
+
+    // MARK: - 写入
+
+    // 在 StoragePurger 的队列上执行。用单独的连接在一个读事务中读取分库，不占用写连接；
+    // 读完后分库的会话数有变化（主 App 删除了会话）时放弃，下一轮再试
+    @discardableResult
+    static func archive(taskID: Int, folder: String) -> Bool {
+        let source = SessionStore.path(folder)
+        let target = path(folder)
+        if access(target, F_OK) != 0 {
+            unlink(target + tombstoneSuffix)
+            let table = "\"\(Session.nameOfTable)\""
+            do {
+                let db = try Connection(source)
+                db.busyTimeout = 5
+                try db.run("PRAGMA query_only = 1")
+                var ids = [Int64]()
+                try db.transaction(.deferred) {
+                    for row in try db.prepare("SELECT id FROM \(table) ORDER BY startTime, id") {
+                        if let id = row[0] as? Int64 { ids.append(id) }
+                    }
+                    try write(target, rows: ids.count) { binding, range in
+                        let list = ids[range].map { "\($0)" }.joined(separator: ",")
+                        return try db.prepare("SELECT \"\(binding.column)\" FROM \(table) WHERE id IN (\(list)) ORDER BY startTime, id").map { $0[0] }
+                    }
+                }
+                if try db.scalar("SELECT count(*) FROM \(table)") as? Int64 != Int64(ids.count) {
+                    unlink(target)
+                    return false
+                }
+                AxLogger.log("SessionArchive task \(taskID): \(ids.count) sessions", level: .Info)
+            } catch {
+                unlink(target)
+                AxLogger.log("SessionArchive task \(taskID) failure:\(error)", level: .Error)
+                return false
+            }
+        }
+        // 存档已完整，删除分库（上次在这一步中断时也从这里继续）
+        SessionStore.remove(taskID: taskID, folder: folder)
+        for suffix in ["", "-wal", "-shm"] {
+            unlink(source + suffix)
+        }
+        return true
+    }
+
+    // 删除存档中 predicate 为 true 的行（已删除的行不再返回），返回删除的行，由调用方清理 body
+    // 通常只追加删除记录；删除的行达到 compactRatio 时把其余行重写到新文件，rename 之后再删掉 .del
+    // （中断时新存档中已没有 .del 里的 id，屏蔽不到任何行）
+    // Tunnel 和主 App 都可能删除，用文件锁串行
+    static func remove(_ db: Connection, taskID: Int, folder: String, where predicate: (Reader) -> [Bool]) -> [RemovedRow] {
+        let target = path(folder)
+        let lockFD = open(target + ".lock", O_RDWR | O_CREAT, 0o644)
+        guard lockFD >= 0 else { return [] }
+        flock(lockFD, LOCK_EX)
+        defer {
+            flock(lockFD, LOCK_UN)
+            close(lockFD)
+        }
+        guard let reader = Reader(path: target) else { return [] }
+        let removed = predicate(reader)
+        guard removed.count == reader.rows else { return [] }
+        let hit = (0..<reader.rows).filter { removed[$0] && !reader.isDeleted($0) }
+        if hit.isEmpty { return [] }
+        let ids = reader.numbers("id")
+        do {
+            if Double(reader.rows - reader.count + hit.count) >= Double(reader.rows) * compactRatio {
+                let keep = (0..<reader.rows).filter { !removed[$0] && !reader.isDeleted($0) }
+                try write(target, rows: keep.count) { binding, range in
+                    keep[range].map { reader.value(binding.column, $0) }
+                }
+                unlink(target + tombstoneSuffix)
+            } else {
+                try appendTombstones(target + tombstoneSuffix, hit.compactMap { ids[$0] })
+            }
+        } catch {
+            AxLogger.log("SessionArchive remove task \(taskID) failure:\(error)", level: .Error)
+            return []
+        }
+        if let updated = Reader(path: target) {
+            syncStats(db, taskID, updated)
+        }
+        let folders = reader.strings("fileFolder")
+        let reqs = reader.strings("reqBody"), rsps = reader.strings("rspBody")
+        return hit.map { row in
+            (Int(ids[row] ?? 0), folders[row] ?? "", reqs[row] ?? "", rsps[row] ?? "")
+        }
+    }
+
+    // 一次 write 追加；中断时末尾不足 8 字节的部分读取时忽略
+    private static func appendTombstones(_ file: String, _ ids: [Int64]) throws {
+        let fd = open(file, O_WRONLY | O_CREAT | O_APPEND, 0o644)
+        guard fd >= 0 else { throw ArchiveError.io("open \(file) errno:\(errno)") }
+        defer { close(fd) }
+        var bytes = [UInt8]()
+        bytes.reserveCapacity(ids.count * 8)
+        for id in ids {
+            var value = id.littleEndian
+            withUnsafeBytes(of: &value) { bytes.append(contentsOf: $0) }
+        }
+        let count = bytes.withUnsafeBytes { Darwin.write(fd, $0.baseAddress!, bytes.count) }
+        guard count == bytes.count else { throw ArchiveError.io("write \(file) errno:\(errno)") }
+        guard fsync(fd) == 0 else { throw ArchiveError.io("fsync \(file) errno:\(errno)") }
+    }
+
+    // 历史列表读 main.TaskStat，重写后按存档重新汇总
+    private static func syncStats(_ db: Connection, _ taskID: Int, _ reader: Reader) {
+        let stats = reader.stats()
+        do {
+            try db.run("INSERT OR REPLACE INTO \(SessionStore.catalog).\(TaskStats.tableName)(taskID, sessionCount, uploadTraffic, downloadFlow, errorCount) VALUES (?, ?, ?, ?, ?)",
+                       Int64(taskID), Int64(stats.count), stats.upload, stats.download, Int64(stats.errors))
+        } catch {
+            AxLogger.log("SessionArchive sync stats failure:\(error)", level: .Error)
+        }
+    }
+
+    private typealias Source = (ASBinding, Range<Int>) throws -> [Binding?]
+
+    // 先写临时文件，完成后 rename，读取端看到的总是完整的存档
+    private static func write(_ target: String, rows: Int, _ source: Source) throws {
+        let tmp = target + ".tmp"
+        let fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0o644)
+        guard fd >= 0 else { throw ArchiveError.io("open \(tmp) errno:\(errno)") }
+        var closed = false
+        defer {
+            if !closed {
+                close(fd)
+                unlink(tmp)
+            }
+        }
+        var offset = 0
+        func append(_ bytes: [UInt8]) throws {
+            var written = 0
+            while written < bytes.count {
+                let count = bytes.withUnsafeBytes { Darwin.write(fd, $0.baseAddress! + written, bytes.count - written) }
+                if count < 0 {
+                    if errno == EINTR { continue }
+                    throw ArchiveError.io("write \(tmp) errno:\(errno)")
+                }
+                written += count
+            }
+            offset += bytes.count
+        }
+        try append(magic)
+        var columns = [[String: Any]]()
+        for binding in Session.bindings {
+            let (type, scale) = valueType(binding)
+            var chunks = [[String: Any]]()
+            var start = 0
+            while start < rows {
+                let range = start..<min(rows, start + groupSize)
+                let values = try source(binding, range)
+                guard values.count == range.count else { throw ArchiveError.io("\(binding.column) rows mismatch") }
+                let (encoding, raw) = encode(values, type, scale)
+                let packed = Data(raw).compress(withAlgorithm: .lzfse).map { [UInt8]($0) }
+                let compressed = packed != nil && packed!.count < raw.count
+                let bytes = compressed ? packed! : raw
+                chunks.append(["encoding": encoding.rawValue, "offset": offset, "length": bytes.count,
+                               "raw": raw.count, "rows": range.count, "compressed": compressed])
+                try append(bytes)
+                start = range.upperBound
+            }
+            columns.append(["name": binding.column, "type": type.rawValue, "scale": scale, "chunks": chunks])
+        }
+        let footer = try JSONSerialization.data(withJSONObject: ["version": version, "rows": rows, "columns": columns])
+        var length = UInt32(footer.count).littleEndian
+        try append([UInt8](footer))
+        try append(withUnsafeBytes(of: &length) { [UInt8]($0) })
+        try append(magic)
+        guard fsync(fd) == 0 else { throw ArchiveError.io("fsync \(tmp) errno:\(errno)") }
+        close(fd)
+        closed = true
+        guard rename(tmp, target) == 0 else {
+            unlink(tmp)
+            throw ArchiveError.io("rename \(tmp) errno:\(errno)")
+        }
+    }
+
+    private static func valueType(_ binding: ASBinding) -> (ValueType, Double) {
+        switch binding.kind {
+        case .string, .stringOptional: return (.string, 1)
+        case .data: return (.data, 1)
+        case .double, .doubleOptional: return (.double, binding.column.hasSuffix("Time") ? 1_000_000 : 1)
+        default: return (.int, 1)
+        }
+    }
+
+    private static func integer(_ value: Binding?, _ scale: Double) -> Int64? {
+        guard let value = value else { return nil }
+        var number: Double
+        switch value {
+        case let v as Int64:
+            if scale == 1 { return v }
+            number = Double(v)
+        case let v as Double: number = v
+        default: return nil
+        }
+        number = (number * scale).rounded()
+        guard number.isFinite, abs(number) < 9.0e18 else { return nil }
+        return Int64(number)
+    }
+
+    private static func encode(_ values: [Binding?], _ type: ValueType, _ scale: Double) -> (Encoding, [UInt8]) {
+        var writer = ByteWriter()
+        switch type {
+        case .int, .double:
+            let numbers = values.map { integer($0, scale) }
+            writer.bitmap(numbers.map { $0 != nil })
+            var previous: Int64 = 0
+            for case let v? in numbers {
+                writer.zigzag(v &- previous)
+                previous = v
+            }
+            return (.delta, writer.bytes)
+        case .string:
+            let strings = values.map { $0 as? String }
+            var index = [String: UInt64]()
+            var list = [String]()
+            for case let s? in strings where index[s] == nil {
+                list.append(s)
+                index[s] = UInt64(list.count)
+            }
+            // host、methods、state 等取值少的列
+            if list.count * 2 <= strings.count {
+                writer.varint(UInt64(list.count))
+                for s in list {
+                    writer.chunk(Array(s.utf8))
+                }
+                for s in strings {
+                    writer.varint(s.flatMap { index[$0] } ?? 0)
+                }
+                return (.dictionary, writer.bytes)
+            }
+            writer.bitmap(strings.map { $0 != nil })
+            for case let s? in strings {
+                writer.chunk(Array(s.utf8))
+            }
+            return (.plain, writer.bytes)
+        case .data:
+            let blobs = values.map { $0 as? Blob }
+            writer.bitmap(blobs.map { $0 != nil })
+            for case let b? in blobs {
+                writer.chunk(b.bytes)
+            }
+            return (.plain, writer.bytes)
+        }
+    }
+
+    private struct ByteWriter {
+        var bytes = [UInt8]()
+
+        mutating func varint(_ value: UInt64) {
+            var v = value
+            while v >= 0x80 {
+                bytes.append(UInt8(v & 0x7F) | 0x80)
+                v >>= 7
+            }
+            bytes.append(UInt8(v))
+        }
+
+        mutating func zigzag(_ value: Int64) {
+            varint(UInt64(bitPattern: (value << 1) ^ (value >> 63)))
+        }
+
+        mutating func chunk(_ data: [UInt8]) {
+            varint(UInt64(data.count))
+            bytes.append(contentsOf: data)
+        }
+
+        mutating func bitmap(_ present: [Bool]) {
+            var byte: UInt8 = 0
+            for (i, p) in present.enumerated() {
+                if p { byte |= 1 << UInt8(i & 7) }
+                if i & 7 == 7 {
+                    bytes.append(byte)
+                    byte = 0
+                }
+            }
+            if present.count & 7 != 0 { bytes.append(byte) }
+        }
+    }
+
+    fileprivate struct ByteReader {
+        let bytes: [UInt8]
+        var index = 0
+        var failed = false
+
+        init(_ bytes: [UInt8]) {
+            self.bytes = bytes
+        }
+
+        mutating func varint() -> UInt64 {
+            var result: UInt64 = 0
+            var shift: UInt64 = 0
+            while index < bytes.count, shift < 64 {
+                let byte = bytes[index]
+                index += 1
+                result |= UInt64(byte & 0x7F) << shift
+                if byte & 0x80 == 0 { return result }
+                shift += 7
+            }
+            failed = true
+            return 0
+        }
+
+        mutating func zigzag() -> Int64 {
+            let v = varint()
+            return Int64(bitPattern: v >> 1) ^ -Int64(bitPattern: v & 1)
+        }
+
+        mutating func chunk() -> ArraySlice<UInt8> {
+            let count = Int(clamping: varint())
+            guard !failed, count <= bytes.count - index else {
+                failed = true
+                return []
+            }
+            index += count
+            return bytes[index - count..<index]
+        }
+
+        mutating func bitmap(_ rows: Int) -> [Bool] {
+            let count = (rows + 7) / 8
+            guard count <= bytes.count - index else {
+                failed = true
+                return []
+            }
+            let start = index
+            index += count
+            return (0..<rows).map { bytes[start + $0 / 8] & (1 << UInt8($0 & 7)) != 0 }
+        }
+    }
+
+    // MARK: - 读取
+
+    final class Reader {
+
+        private struct Chunk {
+            let encoding: Encoding
+            let offset: Int
+            let length: Int
+            let raw: Int
+            let rows: Int
+            let compressed: Bool
+        }
+
+        private struct ColumnInfo {
+            let type: ValueType
+            let scale: Double
+            let chunks: [Chunk]
+        }
+
+        let rows: Int                       // 存档中的行数，包括已删除的行
+        private let path: String
+        private let data: Data
+        private let columns: [String: ColumnInfo]
+        private let lock = Lock()
+        private var cache = [String: Column]()
+        private var deleted = [Bool]()      // 没有删除记录时为空
+        private var deletedCount = 0
+
+        // 文件整个 mmap，只解析 footer，列在第一次用到时解码
+        init?(path: String) {
+            let m = SessionArchive.magic.count
+            guard let data = try? Data(contentsOf: URL(fileURLWithPath: path), options: .alwaysMapped), data.count >= m * 2 + 4,
+                [UInt8](data.prefix(m)) == SessionArchive.magic, [UInt8](data.suffix(m)) == SessionArchive.magic else { return nil }
+            let end = data.count - m - 4
+            let length = Int(data.subdata(in: end..<end + 4).withUnsafeBytes { UInt32(littleEndian: $0.load(as: UInt32.self)) })
+            guard length > 0, end - length >= m,
+                let footer = (try? JSONSerialization.jsonObject(with: data.subdata(in: end - length..<end))) as? [String: Any],
+                footer["version"] as? Int == SessionArchive.version, let rows = footer["rows"] as? Int,
+                let list = footer["columns"] as? [[String: Any]] else { return nil }
+            var columns = [String: ColumnInfo]()
+            for item in list {
+                guard let name = item["name"] as? String, let type = (item["type"] as? String).flatMap(ValueType.init(rawValue:)),
+                    let scale = item["scale"] as? Double, let chunks = item["chunks"] as? [[String: Any]] else { return nil }
+                var parsed = [Chunk]()
+                for c in chunks {
+                    guard let encoding = (c["encoding"] as? Int).flatMap(Encoding.init(rawValue:)), let offset = c["offset"] as? Int,
+                        let size = c["length"] as? Int, let raw = c["raw"] as? Int, let count = c["rows"] as? Int,
+                        let compressed = c["compressed"] as? Bool, offset >= m, size >= 0, offset + size <= end - length else { return nil }
+                    parsed.append(Chunk(encoding: encoding, offset: offset, length: size, raw: raw, rows: count, compressed: compressed))
+                }
+                guard parsed.reduce(0, { $0 + $1.rows }) == rows else { return nil }
+                columns[name] = ColumnInfo(type: type, scale: scale, chunks: parsed)
+            }
+            self.rows = rows
+            self.path = path
+            self.data = data
+            self.columns = columns
+            loadTombstones()
+        }
+
+        // 读取 .del 中的 id，标记对应的行
+        func loadTombstones() {
+            var mask = [Bool]()
+            var count = 0
+            if let data = try? Data(contentsOf: URL(fileURLWithPath: path + SessionArchive.tombstoneSuffix)), data.count >= 8 {
+                let bytes = [UInt8](data)
+                var ids = Set<Int64>()
+                for i in 0..<bytes.count / 8 {
+                    var id: UInt64 = 0
+                    for j in 0..<8 {
+                        id |= UInt64(bytes[i * 8 + j]) << UInt64(j * 8)
+                    }
+                    ids.insert(Int64(bitPattern: id))
+                }
+                mask = numbers("id").map { $0.map { ids.contains($0) } ?? false }
+                count = mask.filter { $0 }.count
+            }
+            lock.withLockVoid {
+                deleted = mask
+                deletedCount = count
+            }
+        }
+
+        // 未删除的会话数
+        var count: Int {
+            return rows - lock.withLock { deletedCount }
+        }
+
+        func isDeleted(_ row: Int) -> Bool {
+            return lock.withLock { !deleted.isEmpty && deleted[row] }
+        }
+
+        // 未删除的行，按存档顺序
+        func liveRows() -> [Int] {
+            let mask = lock.withLock { deleted }
+            return mask.isEmpty ? Array(0..<rows) : (0..<rows).filter { !mask[$0] }
+        }
+
+        func column(_ name: String) -> Column? {
+            if let cached = lock.withLock({ cache[name] }) { return cached }
+            guard let info = columns[name], let column = decode(info) else { return nil }
+            lock.withLockVoid { cache[name] = column }
+            return column
+        }
+
+        private func decode(_ info: ColumnInfo) -> Column? {
+            var numbers = [Int64?](), strings = [String?](), blobs = [Data?]()
+            var codes = [UInt32](), values = [String](), index = [String: UInt32]()
+            var dictionary = info.type == .string
+            for chunk in info.chunks {
+                let slice = data.subdata(in: chunk.offset..<chunk.offset + chunk.length)
+                guard let raw = chunk.compressed ? slice.decompress(withAlgorithm: .lzfse) : slice, raw.count == chunk.raw else { return nil }
+                var reader = ByteReader([UInt8](raw))
+                switch chunk.encoding {
+                case .delta:
+                    var previous: Int64 = 0
+                    for present in reader.bitmap(chunk.rows) {
+                        if present {
+                            previous = previous &+ reader.zigzag()
+                            numbers.append(previous)
+                        } else {
+                            numbers.append(nil)
+                        }
+                    }
+                case .dictionary:
+                    let count = Int(clamping: reader.varint())
+                    guard count <= raw.count else { return nil }
+                    var local = [String](), map = [UInt32]()     // 块内编码 -> 整列编码
+                    for _ in 0..<count {
+                        let s = String(decoding: reader.chunk(), as: UTF8.self)
+                        local.append(s)
+                        if let code = index[s] {
+                            map.append(code)
+                        } else {
+                            values.append(s)
+                            index[s] = UInt32(values.count)
+                            map.append(UInt32(values.count))
+                        }
+                    }
+                    for _ in 0..<chunk.rows {
+                        let code = Int(clamping: reader.varint())
+                        guard code <= local.count else { return nil }
+                        if dictionary {
+                            codes.append(code == 0 ? 0 : map[code - 1])
+                        } else {
+                            strings.append(code == 0 ? nil : local[code - 1])
+                        }
+                    }
+                case .plain:
+                    // 字典块和普通块混合时整列转为字符串
+                    if dictionary {
+                        strings = codes.map { $0 == 0 ? nil : values[Int($0) - 1] }
+                        dictionary = false
+                    }
+                    for present in reader.bitmap(chunk.rows) {
+                        let bytes: ArraySlice<UInt8>? = present ? reader.chunk() : nil
+                        if info.type == .data {
+                            blobs.append(bytes.map { Data($0) })
+                        } else {
+                            strings.append(bytes.map { String(decoding: $0, as: UTF8.self) })
+                        }
+                    }
+                }
+                guard !reader.failed else { return nil }
+            }
+            switch info.type {
+            case .int, .double: return numbers.count == rows ? .numbers(numbers) : nil
+            case .data: return blobs.count == rows ? .blobs(blobs) : nil
+            case .string:
+                if dictionary { return codes.count == rows ? .dictionary(codes: codes, values: values) : nil }
+                return strings.count == rows ? .strings(strings) : nil
+            }
+        }
+
+        // MARK: 列访问
+
+        // 与 SQLite 读出的类型一致：Int64、Double、String、Blob
+        func value(_ name: String, _ row: Int) -> Binding? {
+            guard let info = columns[name], let column = column(name) else { return nil }
+            switch column {
+            case .numbers(let list):
+                guard let v = list[row] else { return nil }
+                return info.type == .double ? Double(v) / info.scale : v
+            case .dictionary(let codes, let values):
+                let code = Int(codes[row])
+                return code == 0 ? nil : values[code - 1]
+            case .strings(let list):
+                return list[row]
+            case .blobs(let list):
+                return list[row]?.datatypeValue
+            }
+        }
+
+        func numbers(_ name: String) -> [Int64?] {
+            guard case .numbers(let list)? = column(name) else { return [Int64?](repeating: nil, count: rows) }
+            return list
+        }
+
+        func doubles(_ name: String) -> [Double?] {
+            let scale = columns[name]?.scale ?? 1
+            return numbers(name).map { $0.map { Double($0) / scale } }
+        }
+
+        func strings(_ name: String) -> [String?] {
+            switch column(name) {
+            case .dictionary(let codes, let values)?: return codes.map { $0 == 0 ? nil : values[Int($0) - 1] }
+            case .strings(let list)?: return list
+            default: return [String?](repeating: nil, count: rows)
+            }
+        }
+
+        func sessions<S: Sequence>(_ rows: S) -> [Session] where S.Element == Int {
+            return rows.map { row in
+                let session = Session()
+                for binding in Session.bindings {
+                    if let v = value(binding.column, row) { binding.assign(session, v) }
+                }
+                return session
+            }
+        }
+
+        // MARK: 过滤
+
+        // 条件与 Session.getFilter 相同，返回满足条件的行，按 (startTime, id) 倒序（存档按 startTime, id 顺序写入）
+        func select(keyWord: String?, params: [String: [String]]?, before timeInterval: Double, cursor: SessionCursor? = nil) -> [Int] {
+            let times = doubles("startTime")
+            let mask = lock.withLock { deleted }
+            var selected = times.enumerated().map { row, time in (mask.isEmpty || !mask[row]) && time.map { $0 < timeInterval } ?? false }
+            if let c = cursor {
+                let ids = numbers("id")
+                for row in 0..<rows where selected[row] {
+                    let time = times[row] ?? 0
+                    selected[row] = time < c.startTime || (time == c.startTime && (ids[row] ?? 0) < Int64(c.id))
+                }
+            }
+            for (key, list) in params ?? [:] {
+                let wanted = list.map { $0.lowercased() }
+                let equal = Session.equalColumns.contains(key)
+                let match = evaluate(key) { text in wanted.contains { equal ? text == $0 : text.contains($0) } }
+                for row in 0..<rows where selected[row] && !match[row] {
+                    selected[row] = false
+                }
+            }
+            if let key = keyWord?.lowercased(), !key.isEmpty {
+                var any = [Bool](repeating: false, count: rows)
+                for column in SessionSearchIndex.columns {
+                    let match = evaluate(column) { $0.contains(key) }
+                    for row in 0..<rows where match[row] {
+                        any[row] = true
+                    }
+                }
+                for row in 0..<rows where !any[row] {
+                    selected[row] = false
+                }
+            }
+            return (0..<rows).reversed().filter { selected[$0] }
+        }
+
+        // 对一列的小写文本求值；字典列只对字典求值一次，头部列同时检查 HPACK 列
+        private func evaluate(_ name: String, _ predicate: (String) -> Bool) -> [Bool] {
+            var result: [Bool]
+            switch column(name) {
+            case .dictionary(let codes, let values)?:
+                let match = [false] + values.map { predicate($0.lowercased()) }
+                result = codes.map { match[Int($0)] }
+            case .strings(let list)?:
+                result = list.map { $0.map { predicate($0.lowercased()) } ?? false }
+            case .numbers(let list)?:
+                let scale = columns[name]?.scale ?? 1
+                let isDouble = columns[name]?.type == .double
+                result = list.map { v in v.map { predicate(isDouble ? "\(Double($0) / scale)" : "\($0)") } ?? false }
+            case .blobs(let list)?:
+                result = list.map { $0.map { predicate(HeaderBlock.text($0).lowercased()) } ?? false }
+            case nil:
+                result = [Bool](repeating: false, count: rows)
+            }
+            if let block = Session.headBlockColumns[name] {
+                let match = evaluate(block, predicate)
+                for row in 0..<rows where match[row] {
+                    result[row] = true
+                }
+            }
+            return result
+        }
+
+        // 数值列倒序，相同时保持原顺序
+        func sorted(_ rows: [Int], by name: String) -> [Int] {
+            let list = numbers(name)
+            return rows.enumerated().sorted { a, b in
+                let x = list[a.element] ?? Int64.min, y = list[b.element] ?? Int64.min
+                return x != y ? x > y : a.offset < b.offset
+            }.map { $0.element }
+        }
+
+        // 筛选面板的分类计数，rows 为空时统计全部未删除的行
+        func groupBy(_ name: String, rows: [Int]? = nil) -> [[String: String]] {
+            var counts = [String: Int]()
+            let mask = lock.withLock { deleted }
+            switch column(name) {
+            case .dictionary(let codes, let values)?:
+                var byCode = [Int](repeating: 0, count: values.count + 1)
+                if let list = rows {
+                    for row in list { byCode[Int(codes[row])] += 1 }
+                } else {
+                    for (row, code) in codes.enumerated() where mask.isEmpty || !mask[row] { byCode[Int(code)] += 1 }
+                }
+                for (i, v) in values.enumerated() where byCode[i + 1] > 0 {
+                    counts[v, default: 0] += byCode[i + 1]
+                }
+            default:
+                let list = strings(name)
+                for row in rows ?? liveRows() {
+                    if let v = list[row] { counts[v, default: 0] += 1 }
+                }
+            }
+            return counts.filter { $0.key != "" }.sorted { $0.key < $1.key }.map { [$0.key: "\($0.value)"] }
+        }
+
+        func rows(ids: [Int]) -> [Int] {
+            let wanted = Set(ids.map { Int64($0) })
+            let list = numbers("id")
+            return liveRows().filter { list[$0].map { wanted.contains($0) } ?? false }
+        }
+
+        func stats() -> (count: Int, upload: Int64, download: Int64, errors: Int) {
+            let live = liveRows()
+            let uploads = numbers("uploadTraffic"), downloads = numbers("downloadFlow"), states = strings("sstate")
+            let upload = live.reduce(Int64(0)) { $0 &+ (uploads[$1] ?? 0) }
+            let download = live.reduce(Int64(0)) { $0 &+ (downloads[$1] ?? 0) }
+            let errors = live.filter { states[$0] == "failure" }.count
+            return (live.count, upload, download, errors)
+        }
+    }
+}
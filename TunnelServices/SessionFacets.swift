@@ -0,0 +1,89 @@
+//
+//  SessionFacets.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/7/4.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import SQLite
+import AxLogger
+import NIOConcurrencyHelpers
+
+// 筛选面板的分类计数：每个 Task 每个字段每个取值一行 (taskID, facet, value, count)
+// 与 TaskStats 一样由 Session 表上的触发器增量维护，打开筛选面板时不再对会话表 group by
+// 空值和空字符串不计入，与原来的 groupBy 结果一致
+final class SessionFacets {
+
+    static let tableName = "SessionFacet"
+    static let columns = ["host", "methods", "state", "suffix", "target", "rspType"]
+
+    private static let available = PreparedSchemas()
+
+    static func isFacet(_ column: String) -> Bool {
+        return columns.contains(column)
+    }
+
+    // Tunnel 启动和主 App 查询前调用；第一次建表时汇总已有的会话
+    // 每个 Task 分库中各有一张，schema 见 SessionStore
+    // 与 TaskStats 一样按 (连接, schema) 记录
+    @discardableResult
+    static func prepare(_ db: Connection, schema: String = SessionStore.catalog) -> Bool {
+        if available.contains(db, schema) { return true }
+        let session = Session.nameOfTable
+        let add = columns.map { column in
+            "INSERT OR IGNORE INTO \(tableName)(taskID, facet, value, count) SELECT new.taskID, '\(column)', new.\(column), 0 "
+                + "WHERE new.taskID IS NOT NULL AND ifnull(new.\(column), '') != ''; "
+                + "UPDATE \(tableName) SET count = count + 1 WHERE taskID = new.taskID AND facet = '\(column)' AND value = new.\(column);"
+        }.joined(separator: "\n")
+        let remove = columns.map { column in
+            "UPDATE \(tableName) SET count = count - 1 WHERE taskID = old.taskID AND facet = '\(column)' AND value = old.\(column);"
+        }.joined(separator: "\n") + "\nDELETE FROM \(tableName) WHERE taskID = old.taskID AND count <= 0;"
+        do {
+            // replace 删除旧行时触发删除触发器，见 TaskStats
+            try db.run("PRAGMA recursive_triggers = ON")
+            try db.transaction {
+                try db.run("""
+                    CREATE TABLE IF NOT EXISTS \(schema).\(tableName) (taskID INTEGER NOT NULL, facet TEXT NOT NULL, value TEXT NOT NULL,
+                    count INTEGER NOT NULL DEFAULT 0, PRIMARY KEY (taskID, facet, value)) WITHOUT ROWID
+                    """)
+                // 触发器不存在说明是第一次建表，先汇总再建触发器
+                let count = try db.scalar("SELECT count(*) FROM \(schema).sqlite_master WHERE type = 'trigger' AND name = '\(tableName)_insert'") as? Int64 ?? 0
+                if count == 0 {
+                    try db.run("DELETE FROM \(schema).\(tableName)")
+                    for column in columns {
+                        try db.run("""
+                            INSERT INTO \(schema).\(tableName)(taskID, facet, value, count) SELECT taskID, '\(column)', \(column), count(*)
+                            FROM \(schema).\(session) WHERE taskID IS NOT NULL AND ifnull(\(column), '') != '' GROUP BY taskID, \(column)
+                            """)
+                    }
+                }
+                try db.run("CREATE TRIGGER IF NOT EXISTS \(schema).\(tableName)_insert AFTER INSERT ON \(session) BEGIN\n\(add)\nEND")
+                try db.run("CREATE TRIGGER IF NOT EXISTS \(schema).\(tableName)_delete AFTER DELETE ON \(session) BEGIN\n\(remove)\nEND")
+                try db.run("""
+                    CREATE TRIGGER IF NOT EXISTS \(schema).\(tableName)_update AFTER UPDATE OF taskID, \(columns.joined(separator: ", ")) ON \(session)
+                    BEGIN
+                    \(remove)
+                    \(add)
+                    END
+                    """)
+                if schema == SessionStore.catalog {
+                    try db.run("""
+                        CREATE TRIGGER IF NOT EXISTS \(tableName)_task_delete AFTER DELETE ON \(Task.nameOfTable)
+                        BEGIN DELETE FROM \(tableName) WHERE taskID = old.id; END
+                        """)
+                }
+            }
+            available.insert(db, schema)
+            return true
+        } catch {
+            AxLogger.log("SessionFacets unavailable(\(schema)):\(error)", level: .Info)
+            return false
+        }
+    }
+
+    static func reset(_ schema: String) {
+        available.remove(schema)
+    }
+}
@@ -0,0 +1,111 @@
+//
+//  SessionSearchIndex.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/7/1.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import SQLite
+import AxLogger
+import NIOConcurrencyHelpers
+
+// 会话关键词搜索的 FTS5 影子索引，trigram 分词，支持任意位置的子串匹配，不区分大小写
+// rowid = Session.id；由 SessionWriter 在写入事务中同步更新，Session 记录被删除时由触发器删除
+// 系统 SQLite 不支持 trigram（3.34 以下）时建表失败，搜索退回 like 全表扫描
+final class SessionSearchIndex {
+
+    static let tableName = "SessionSearch"
+    // 与 Session.getSQL 原来 like 搜索的字段一致
+    static let columns = ["remoteAddress", "localAddress", "host", "schemes", "reqLine",
+                          "reqHeads", "target", "state", "rspMessage", "rspHeads"]
+    static let minKeywordLength = 3     // trigram 至少需要 3 个字符
+
+    private static let lock = Lock()
+    private static var available = Set<String>()
+
+    static func isAvailable(_ schema: String = SessionStore.catalog) -> Bool {
+        return lock.withLock { available.contains(schema) }
+    }
+
+    // Tunnel 启动时在写入队列上调用，Task 分库建好后也会调用；第一次建表时把已有的会话补进索引
+    static func prepare(_ db: Connection, schema: String = SessionStore.catalog) {
+        let columnList = columns.joined(separator: ", ")
+        do {
+            if try !tableExists(db, schema) {
+                try db.transaction {
+                    try db.run("CREATE VIRTUAL TABLE \(schema).\(tableName) USING fts5(\(columnList), tokenize = 'trigram')")
+                    // 头部块解码成文本，与 update 写入的内容一致
+                    HeaderBlock.register(db)
+                    let selectList = columns.map { column -> String in
+                        guard let block = Session.headBlockColumns[column] else { return column }
+                        return "coalesce(\(HeaderBlock.functionName)(\(block)), \(column))"
+                    }.joined(separator: ", ")
+                    try db.run("INSERT INTO \(schema).\(tableName)(rowid, \(columnList)) SELECT id, \(selectList) FROM \(schema).\(Session.nameOfTable)")
+                }
+            }
+            try db.run("""
+                CREATE TRIGGER IF NOT EXISTS \(schema).\(tableName)_delete AFTER DELETE ON \(Session.nameOfTable)
+                BEGIN DELETE FROM \(tableName) WHERE rowid = old.id; END
+                """)
+            lock.withLockVoid { available.insert(schema) }
+        } catch {
+            AxLogger.log("SessionSearchIndex unavailable(\(schema)):\(error)", level: .Info)
+        }
+    }
+
+    // 主 App 查询前调用，索引由 Tunnel 创建，存在后就不再检查
+    static func checkAvailable(_ db: Connection, schema: String = SessionStore.catalog) -> Bool {
+        if isAvailable(schema) { return true }
+        guard (try? tableExists(db, schema)) == true else { return false }
+        lock.withLockVoid { available.insert(schema) }
+        return true
+    }
+
+    static func reset(_ schema: String) {
+        lock.withLockVoid { available.remove(schema) }
+    }
+
+    private static func tableExists(_ db: Connection, _ schema: String) throws -> Bool {
+        let count = try db.scalar("SELECT count(*) FROM \(schema).sqlite_master WHERE type = 'table' AND name = '\(tableName)'") as? Int64
+        return (count ?? 0) > 0
+    }
+
+    // 拍下需要索引的字段，顺序与 columns 一致
+    // 头部块只保存引用，在写入线程解码成文本，EventLoop 上不做解码
+    static func values(_ session: Session) -> [Binding?] {
+        return [session.remoteAddress, session.localAddress, session.host, session.schemes, session.reqLine,
+                heads(session.reqHeads, session.reqHeadBlock), session.target, session.state, session.rspMessage,
+                heads(session.rspHeads, session.rspHeadBlock)]
+    }
+
+    private static func heads(_ json: String?, _ block: Data?) -> Binding? {
+        if let data = block { return data.datatypeValue }
+        return json
+    }
+
+    // 在 SessionWriter 的事务中调用，同一会话的多次保存只保留最后一次
+    static func update(_ db: Connection, schema: String = SessionStore.catalog, rows: [(Int, [Binding?])]) throws {
+        if rows.isEmpty { return }
+        let placeholders = Array(repeating: "?", count: columns.count + 1).joined(separator: ", ")
+        let delete = try db.prepare("DELETE FROM \(schema).\(tableName) WHERE rowid = ?")
+        let insert = try db.prepare("INSERT INTO \(schema).\(tableName)(rowid, \(columns.joined(separator: ", "))) VALUES (\(placeholders))")
+        for (id, values) in rows {
+            try delete.run(Int64(id))
+            let text = values.map { value -> Binding? in
+                guard let blob = value as? Blob else { return value }
+                return HeaderBlock.text(Data.fromDatatypeValue(blob))
+            }
+            try insert.run([Int64(id) as Binding?] + text)
+        }
+    }
+
+    // 关键词转成 FTS5 短语，太短时返回 nil，由调用方使用 like
+    // 返回值已按 SQL 字符串转义，可直接放在单引号中
+    static func matchPhrase(_ keyWord: String) -> String? {
+        guard keyWord.count >= minKeywordLength else { return nil }
+        let phrase = "\"" + keyWord.replacingOccurrences(of: "\"", with: "\"\"") + "\""
+        return phrase.replacingOccurrences(of: "'", with: "''")
+    }
+}
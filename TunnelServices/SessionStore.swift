@@ -0,0 +1,242 @@
+//
+//  SessionStore.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/7/7.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import SQLite
+import AxLogger
+import NIOConcurrencyHelpers
+
+// 会话按 Task 分库：每个 Task 目录下一个 sessions.db，用到时 ATTACH 为 t<taskID>
+// nio.db（main）只保留 Task、Rule 等目录数据和 TaskStat 汇总；旧版本写入 nio.db 的会话仍在 main.Session 中，查询时回退到 main
+// 分库有自己的 TaskStat、SessionFacet 和搜索索引（触发器只能访问同库的表），TaskStat 由写入方在同一事务中同步到 main
+// 删除 Task 时 DETACH 后直接删除整个目录
+// ATTACH/DETACH 不能在事务中执行，schema(_:taskID:) 要在事务外调用
+// schema(_:taskID:) 返回的分库在这个连接上被占用，查询结束后调用 release；占用中的分库不会被其他线程按 LRU DETACH
+final class SessionStore {
+
+    static let catalog = "main"
+    static let fileName = "sessions.db"
+    static let version: Int64 = 1           // 建库完成后写入 user_version，未完成的分库不使用
+    static let maxAttached = 6              // 每个连接同时 ATTACH 的分库数，SQLite 默认上限为 10
+
+    private struct Attachment {
+        let db: Connection
+        var schemas: [String]               // 最近使用的在后
+    }
+
+    private static let lock = Lock()
+    private static var attached = [ObjectIdentifier: Attachment]()
+    private static var folders = [Int: String]()    // taskID -> Task 目录
+    private static var pinned = Set<String>()       // 正在写入的分库，不按 LRU DETACH
+    private static var using = [ObjectIdentifier: [String: Int]]()  // 连接上正在查询的分库 -> 占用数
+    static let removeWait = 100                     // 删除 Task 时等待查询结束的次数，每次 10ms
+
+    static func name(_ taskID: Int) -> String {
+        return "t\(taskID)"
+    }
+
+    static func path(_ folder: String) -> String {
+        return "\(MitmService.getStoreFolder())\(folder)/\(fileName)"
+    }
+
+    // taskID 的会话所在的 schema；跨 Task 查询和没有分库的旧 Task 返回 catalog
+    // 返回分库时占用到 release 为止
+    static func schema(_ db: Connection, taskID: Int?) -> String {
+        guard let id = taskID else { return catalog }
+        let schema = name(id)
+        return lock.withLock {
+            if touch(db, schema) { return use(db, schema) }
+            guard let folder = folder(db, id) else { return catalog }
+            let file = path(folder)
+            guard access(file, F_OK) == 0, attach(db, file, schema) else { return catalog }
+            if (try? db.scalar("PRAGMA \(schema).user_version")) as? Int64 != version {
+                _ = detach(db, schema)
+                return catalog
+            }
+            return use(db, schema)
+        }
+    }
+
+    // 与 schema(_:taskID:) 成对调用
+    static func release(_ db: Connection, _ schema: String) {
+        guard schema != catalog else { return }
+        lock.withLockVoid {
+            let key = ObjectIdentifier(db)
+            guard let count = using[key]?[schema] else { return }
+            using[key]?[schema] = count > 1 ? count - 1 : nil
+            if using[key]?.isEmpty == true { using[key] = nil }
+        }
+    }
+
+    // Tunnel 启动时在写入队列上调用：建当前 Task 的分库（已存在时直接使用），返回新会话写入的 schema
+    static func create(_ db: Connection, taskID: Int, folder: String) -> String {
+        let schema = name(taskID)
+        let file = path(folder)
+        let ready: Bool = lock.withLock {
+            folders[taskID] = folder
+            pinned.insert(schema)
+            return touch(db, schema) || attach(db, file, schema)
+        }
+        guard ready else { return catalog }
+        do {
+            if try db.scalar("PRAGMA \(schema).user_version") as? Int64 != version {
+                try build(db, schema)
+            }
+            ASConfigration.watchCheckpoint(path: file)
+            return schema
+        } catch {
+            AxLogger.log("SessionStore create \(schema) failure:\(error)", level: .Error)
+            lock.withLockVoid {
+                pinned.remove(schema)
+                _ = detach(db, schema)
+            }
+            return catalog
+        }
+    }
+
+    // 查询 Task 目录（如列式存档），用只读连接
+    static func folder(taskID: Int) -> String? {
+        guard let db = try? ASConfigration.getReadDB() else { return nil }
+        return lock.withLock { folder(db, taskID) }
+    }
+
+    // 删除 Task 前调用：从所有连接 DETACH，之后目录可以直接删除
+    // 其他线程正在查询这个分库时等查询结束（release）再 DETACH；调用方自己不能占用
+    static func remove(taskID: Int, folder: String) {
+        let schema = name(taskID)
+        for attempt in 0...removeWait {
+            let busy: Bool = lock.withLock {
+                var busy = false
+                for (key, entry) in attached where entry.schemas.contains(schema) {
+                    if using[key]?[schema] != nil, attempt < removeWait {
+                        busy = true
+                        continue
+                    }
+                    if !detach(entry.db, schema) {
+                        AxLogger.log("SessionStore detach \(schema) failure", level: .Error)
+                    }
+                    if attached[key]?.schemas.isEmpty == true { attached[key] = nil }
+                }
+                if !busy {
+                    folders[taskID] = nil
+                    pinned.remove(schema)
+                }
+                return busy
+            }
+            if !busy { break }
+            usleep(10_000)
+        }
+        TaskStats.reset(schema)
+        SessionFacets.reset(schema)
+        SessionSearchIndex.reset(schema)
+        if !folder.isEmpty {
+            ASConfigration.unwatchCheckpoint(path: path(folder))
+        }
+    }
+
+    // 与 Session.cachedInsertSQL(or: .replace) 相同的列顺序
+    static func insertSQL(_ schema: String) -> String {
+        return ASCache.insertSQL("\(Session.nameOfTable)|\(schema)|REPLACE") {
+            let names = Session.bindings.map { "\"\($0.column)\"" }
+            let values = Array(repeating: "?", count: names.count)
+            return "INSERT OR REPLACE INTO \(schema).\"\(Session.nameOfTable)\" (\(names.joined(separator: ", "))) VALUES (\(values.joined(separator: ", ")))"
+        }
+    }
+
+    // 在写入事务中调用，把分库的 TaskStat 同步到 main，历史列表只读 main
+    static func syncStats(_ db: Connection, _ schema: String) {
+        guard schema != catalog else { return }
+        do {
+            try db.run("INSERT OR REPLACE INTO \(catalog).\(TaskStats.tableName) SELECT * FROM \(schema).\(TaskStats.tableName)")
+        } catch {
+            AxLogger.log("SessionStore sync stats \(schema) failure:\(error)", level: .Error)
+        }
+    }
+
+    private static func build(_ db: Connection, _ schema: String) throws {
+        // auto_vacuum 要在建表前设置
+        try db.run("PRAGMA \(schema).auto_vacuum = INCREMENTAL")
+        _ = try db.scalar("PRAGMA \(schema).journal_mode = WAL")
+        try db.run("PRAGMA \(schema).synchronous = NORMAL")
+        try db.transaction {
+            try db.run(createTableSQL(schema))
+            // 分库中只有一个 Task，列表按 (startTime, id) 倒序翻页
+            try db.run("CREATE INDEX IF NOT EXISTS \(schema).\(Session.nameOfTable)_startTime ON \(Session.nameOfTable)(startTime, id)")
+        }
+        SessionSearchIndex.prepare(db, schema: schema)
+        guard TaskStats.prepare(db, schema: schema), SessionFacets.prepare(db, schema: schema), SessionSearchIndex.isAvailable(schema) else {
+            throw SQLite.Result.error(message: "prepare \(schema) indexes failure", code: 1, statement: nil)
+        }
+        try db.run("PRAGMA \(schema).user_version = \(version)")
+    }
+
+    // 与 ASModel 建表一致：非可选列 NOT NULL 并有默认值
+    private static func createTableSQL(_ schema: String) -> String {
+        let columns = Session.bindings.map { binding -> String in
+            let column = "\"\(binding.column)\" \(binding.kind.declaredDatatype)"
+            if binding.column == Session.PRIMARY_KEY { return "\(column) PRIMARY KEY NOT NULL" }
+            switch binding.kind {
+            case .string: return "\(column) NOT NULL DEFAULT ''"
+            case .number, .double, .date: return "\(column) NOT NULL DEFAULT 0"
+            default: return column
+            }
+        }
+        return "CREATE TABLE IF NOT EXISTS \(schema).\"\(Session.nameOfTable)\" (\(columns.joined(separator: ", ")))"
+    }
+
+    // MARK: - 以下在 lock 中调用
+
+    private static func use(_ db: Connection, _ schema: String) -> String {
+        using[ObjectIdentifier(db), default: [:]][schema, default: 0] += 1
+        return schema
+    }
+
+    private static func touch(_ db: Connection, _ schema: String) -> Bool {
+        let key = ObjectIdentifier(db)
+        guard let index = attached[key]?.schemas.firstIndex(of: schema) else { return false }
+        attached[key]?.schemas.remove(at: index)
+        attached[key]?.schemas.append(schema)
+        return true
+    }
+
+    private static func folder(_ db: Connection, _ taskID: Int) -> String? {
+        if let folder = folders[taskID] { return folder }
+        guard let folder = (try? db.scalar("SELECT fileFolder FROM \(catalog).\(Task.nameOfTable) WHERE id = \(taskID)")) as? String,
+            !folder.isEmpty else { return nil }
+        folders[taskID] = folder
+        return folder
+    }
+
+    // 超出 maxAttached 时先 DETACH 最久没用的，跳过正在写入和正在查询的分库
+    private static func attach(_ db: Connection, _ file: String, _ schema: String) -> Bool {
+        let key = ObjectIdentifier(db)
+        for old in attached[key]?.schemas ?? [] where attached[key]!.schemas.count >= maxAttached && !pinned.contains(old) && using[key]?[old] == nil {
+            _ = detach(db, old)
+        }
+        do {
+            try db.run("ATTACH DATABASE ? AS \(schema)", file)
+        } catch {
+            AxLogger.log("SessionStore attach \(schema) failure:\(error)", level: .Error)
+            return false
+        }
+        attached[key, default: Attachment(db: db, schemas: [])].schemas.append(schema)
+        return true
+    }
+
+    private static func detach(_ db: Connection, _ schema: String) -> Bool {
+        // 缓存的语句引用了这个库，先释放
+        ASCache.setVerified(db, "\(schema).\(Session.nameOfTable)", false)
+        do {
+            try db.run("DETACH DATABASE \(schema)")
+        } catch {
+            return false
+        }
+        attached[ObjectIdentifier(db)]?.schemas.removeAll { $0 == schema }
+        return true
+    }
+}
@@ -0,0 +1,215 @@
+//
+//  SessionWriter.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/6/28.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import SQLite
+import AxLogger
+import NIOConcurrencyHelpers
+
+// Session 的后台批量写入
+// EventLoop 上只在内存中分配 id、拍下字段快照放入队列，不访问 SQLite
+// 写入线程按 id 合并同一会话的多次更新，每 flushInterval 或攒够 batchSize 条后在一个事务里提交
+// 会话写入所属 Task 的分库（见 SessionStore），id 在 Task 内唯一
+final class SessionWriter {
+
+    static let shared = SessionWriter()
+
+    static let flushInterval: DispatchTimeInterval = .milliseconds(200)
+    static let batchSize = 256
+    static let retryInterval = 200  // 毫秒；提交失败（SQLITE_BUSY 等）后按 retryInterval * 2^n 重试
+    static let maxRetries = 6       // 连续失败超过后丢弃这一批
+
+    private let queue = DispatchQueue(label: "Knot.SessionWriter", qos: .utility)
+    private let lock = Lock()
+    private var pending = [Int: PendingRow]()   // id -> 最新一次的字段快照
+    private var order = [Int]()                 // 首次入队顺序，保证插入顺序与 id 一致
+    private var deletes = [Int: Int?]()        // id -> taskID
+    private var flushScheduled = false
+    private var retries = 0                     // 连续提交失败的次数，重试期间不立即写入
+    private let nextID = Atomic<Int>(value: 0)
+
+    private struct PendingRow {
+        let taskID: Int?
+        let values: [Binding?]      // 按 Session.cachedColumns() 顺序
+        let search: [Binding?]      // 搜索索引的字段
+    }
+
+    // 服务启动时调用：建当前 Task 的分库，读一次其中最大的 id，之后的 id 都在内存中分配
+    func prepare(taskID: Int?, folder: String) {
+        queue.sync {
+            do {
+                try Session.createTable()
+                try addMissingColumns()
+                // 会话列表按 taskID 过滤、按 (startTime, id) 倒序翻页
+                try Session.createIndex([Expression<Int64?>("taskID"), Expression<Double?>("startTime"), Expression<Int64>("id")], ifNotExists: true)
+                let db = try Session.getDB()
+                // 统计表的触发器要在第一次写入前建好
+                TaskStats.prepare(db)
+                SessionFacets.prepare(db)
+                // 分库建不成时仍写入 nio.db
+                let schema = taskID.map { SessionStore.create(db, taskID: $0, folder: folder) } ?? SessionStore.catalog
+                let maxID = try db.scalar("SELECT max(id) FROM \(schema).\(Session.nameOfTable)") as? Int64 ?? 0
+                nextID.store(Int(maxID))
+            } catch {
+                AxLogger.log("SessionWriter prepare failure:\(error)", level: .Error)
+            }
+        }
+        // 第一次建搜索索引时要补全已有会话，放到写入队列上异步执行，不阻塞启动
+        queue.async {
+            if let db = try? Session.getDB() {
+                SessionSearchIndex.prepare(db)
+            }
+        }
+    }
+
+    // 旧版本建的表补上新增的列
+    private func addMissingColumns() throws {
+        let db = try Session.getDB()
+        var columns = Set<String>()
+        for row in try db.prepare("PRAGMA table_info(\(Session.nameOfTable))") {
+            if let name = row[1] as? String { columns.insert(name) }
+        }
+        let missing = ["reqHeadBlock", "rspHeadBlock"].filter { !columns.contains($0) }
+        if !missing.isEmpty {
+            try Session.addColumn(missing)
+        }
+    }
+
+    func allocateID() -> NSNumber {
+        return NSNumber(value: nextID.add(1) + 1)
+    }
+
+    func save(_ session: Session) {
+        guard let id = session.id?.intValue else { return }
+        let row = PendingRow(taskID: session.taskID?.intValue, values: session.cachedBindings(), search: SessionSearchIndex.values(session))
+        let count: Int = lock.withLock {
+            if pending.updateValue(row, forKey: id) == nil {
+                order.append(id)
+            }
+            return pending.count
+        }
+        scheduleFlush(immediately: count >= SessionWriter.batchSize)
+    }
+
+    func delete(_ session: Session) {
+        guard let id = session.id?.intValue else { return }
+        lock.withLockVoid {
+            if pending.removeValue(forKey: id) != nil {
+                order.removeAll { $0 == id }
+            }
+            deletes.updateValue(session.taskID?.intValue, forKey: id)
+        }
+        scheduleFlush(immediately: false)
+    }
+
+    private func scheduleFlush(immediately: Bool) {
+        let needSchedule: Bool = lock.withLock {
+            if flushScheduled, !immediately || retries > 0 { return false }
+            flushScheduled = true
+            return true
+        }
+        guard needSchedule else { return }
+        if immediately {
+            queue.async { self.flush() }
+        } else {
+            queue.asyncAfter(deadline: .now() + SessionWriter.flushInterval) { self.flush() }
+        }
+    }
+
+    // 在写入队列上执行
+    private func flush() {
+        let (rows, removed): ([(Int, PendingRow)], [Int: Int?]) = lock.withLock {
+            let rows = order.compactMap { id in pending[id].map { (id, $0) } }
+            let removed = deletes
+            pending.removeAll(keepingCapacity: true)
+            order.removeAll(keepingCapacity: true)
+            deletes.removeAll()
+            flushScheduled = false
+            return (rows, removed)
+        }
+        if rows.isEmpty, removed.isEmpty { return }
+        do {
+            let db = try Session.getDB()
+            // 按 schema 分组；ATTACH 不能在事务中执行，先解析好
+            var schemas = [Int?: String]()
+            defer { schemas.values.forEach { SessionStore.release(db, $0) } }
+            func schema(_ taskID: Int?) -> String {
+                if let name = schemas[taskID] { return name }
+                let name = SessionStore.schema(db, taskID: taskID)
+                schemas[taskID] = name
+                return name
+            }
+            var inserts = [String: [(Int, PendingRow)]]()
+            var removals = [String: [Int]]()
+            for (id, row) in rows {
+                inserts[schema(row.taskID), default: []].append((id, row))
+            }
+            for (id, taskID) in removed {
+                removals[schema(taskID), default: []].append(id)
+            }
+            try db.transaction {
+                for (name, list) in inserts {
+                    // 同一条预编译语句重复绑定执行
+                    let sql = name == SessionStore.catalog ? Session().cachedInsertSQL(or: .replace) : SessionStore.insertSQL(name)
+                    for (_, row) in list {
+                        _ = try ASCache.run(db, sql, row.values)
+                    }
+                    if SessionSearchIndex.isAvailable(name) {
+                        try SessionSearchIndex.update(db, schema: name, rows: list.map { ($0.0, $0.1.search) })
+                    }
+                }
+                // 搜索索引中的记录由删除触发器清理
+                for (name, ids) in removals {
+                    try db.run("DELETE FROM \(name).\(Session.nameOfTable) WHERE id IN (\(ids.map { "\($0)" }.joined(separator: ",")))")
+                }
+                for name in Set(schemas.values) {
+                    SessionStore.syncStats(db, name)
+                }
+            }
+            lock.withLockVoid { retries = 0 }
+        } catch {
+            AxLogger.log("SessionWriter flush failure(\(rows.count) rows):\(error)", level: .Error)
+            restore(rows, removed)
+        }
+    }
+
+    // 事务已回滚：放回队列，之后入队的新快照和删除优先
+    private func restore(_ rows: [(Int, PendingRow)], _ removed: [Int: Int?]) {
+        let delay: Int? = lock.withLock {
+            retries += 1
+            if retries > SessionWriter.maxRetries {
+                retries = 0
+                return nil
+            }
+            var restored = [Int]()
+            for (id, row) in rows where deletes[id] == nil {
+                if pending[id] == nil {
+                    pending[id] = row
+                    restored.append(id)
+                }
+            }
+            // 重试的行排在新入队的前面，插入顺序仍与 id 一致
+            order = restored + order
+            for (id, taskID) in removed where deletes[id] == nil && pending[id] == nil {
+                deletes[id] = taskID
+            }
+            flushScheduled = true
+            return SessionWriter.retryInterval << (retries - 1)
+        }
+        guard let milliseconds = delay else {
+            AxLogger.log("SessionWriter drop \(rows.count) rows, \(removed.count) deletes after \(SessionWriter.maxRetries) retries", level: .Error)
+            return
+        }
+        queue.asyncAfter(deadline: .now() + .milliseconds(milliseconds)) { self.flush() }
+    }
+
+    // 服务关闭时调用，把队列中的数据全部写入
+    func flushNow() {
+        queue.sync { self.flush() }
+    }
+}
@@ -0,0 +1,406 @@
+//
+//  StoragePurger.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/7/6.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import SQLite
+import AxLogger
+import NIOConcurrencyHelpers
+
+// 存储配额，0 表示不限制
+// 主 App 写入 App Group 的 UserDefaults，Tunnel 中的 StoragePurger 每一轮重新读取
+// 没有保存过配额时不清理任何数据，需要用户主动开启（可以保存 .default）
+public struct RetentionPolicy {
+    public var maxBytes: Int64              // 数据库 + Task 目录的磁盘占用
+    public var maxAge: TimeInterval         // 会话保留时长（秒）
+    public var maxSessionsPerTask: Int      // 每个 Task 保留的会话数，超出删除最早的
+    public var trimActiveTask: Bool         // 超出 maxBytes 且只剩正在抓包的 Task 时，是否删除它最早的会话
+    public var archiveFinished: Bool        // 已结束的 Task 是否转为列式存档（SessionArchive）
+
+    public init(maxBytes: Int64, maxAge: TimeInterval, maxSessionsPerTask: Int, trimActiveTask: Bool = false, archiveFinished: Bool = true) {
+        self.maxBytes = maxBytes
+        self.maxAge = maxAge
+        self.maxSessionsPerTask = maxSessionsPerTask
+        self.trimActiveTask = trimActiveTask
+        self.archiveFinished = archiveFinished
+    }
+
+    public static let unlimited = RetentionPolicy(maxBytes: 0, maxAge: 0, maxSessionsPerTask: 0)
+    public static let `default` = RetentionPolicy(maxBytes: 1024 * 1024 * 1024, maxAge: 30 * 24 * 3600, maxSessionsPerTask: 50000)
+
+    private static let key = "RetentionPolicy"
+
+    public static var current: RetentionPolicy {
+        get {
+            guard let dic = UserDefaults(suiteName: GROUPNAME)?.dictionary(forKey: key) else { return .unlimited }
+            return RetentionPolicy(maxBytes: (dic["maxBytes"] as? NSNumber)?.int64Value ?? 0,
+                                   maxAge: (dic["maxAge"] as? NSNumber)?.doubleValue ?? 0,
+                                   maxSessionsPerTask: (dic["maxSessionsPerTask"] as? NSNumber)?.intValue ?? 0,
+                                   trimActiveTask: (dic["trimActiveTask"] as? NSNumber)?.boolValue ?? false,
+                                   archiveFinished: (dic["archiveFinished"] as? NSNumber)?.boolValue ?? true)
+        }
+        set {
+            let dic: [String: Any] = ["maxBytes": NSNumber(value: newValue.maxBytes),
+                                      "maxAge": NSNumber(value: newValue.maxAge),
+                                      "maxSessionsPerTask": NSNumber(value: newValue.maxSessionsPerTask),
+                                      "trimActiveTask": NSNumber(value: newValue.trimActiveTask),
+                                      "archiveFinished": NSNumber(value: newValue.archiveFinished)]
+            UserDefaults(suiteName: GROUPNAME)?.set(dic, forKey: key)
+        }
+    }
+}
+
+// 后台按 RetentionPolicy 清理会话和 body
+// 会话按批在短事务中删除（统计表、筛选计数和搜索索引由触发器同步），事务之间写入线程可以继续提交；
+// 旧版本的 body 文件按批 unlink，BodyStore 中的数据段打洞回收；整个 Task 删除时 DETACH 分库后直接删目录；
+// 最后 incremental_vacuum 把空闲页还给文件系统
+// 会话在各 Task 的分库中（见 SessionStore），旧版本写入 nio.db 的会话按 catalog 处理
+// 已结束的 Task 每轮转为列式存档（见 SessionArchive，可在 RetentionPolicy 中关闭），删除存档中的会话记录在存档旁的删除文件中
+public final class StoragePurger {
+
+    static let shared = StoragePurger()
+
+    static let interval: DispatchTimeInterval = .seconds(60)
+    static let batchSize = 500
+    static let vacuumStep = 1024            // 每次 incremental_vacuum 回收的页数
+    static let convertLimit: Int64 = 8 * 1024 * 1024    // 旧库小于此大小时 VACUUM 一次切换到 incremental
+
+    private let queue = DispatchQueue(label: "Knot.StoragePurger", qos: .background)
+    private var timer: DispatchSourceTimer?
+    private var activeTaskID = -1           // 正在抓包的 Task，不整个删除
+    private let stopped = Atomic<Bool>(value: true)
+
+    // Tunnel 启动服务后调用
+    func start(activeTaskID: Int?) {
+        queue.async {
+            self.activeTaskID = activeTaskID ?? -1
+            self.stopped.store(false)
+            self.convertIfNeeded()
+            let timer = DispatchSource.makeTimerSource(queue: self.queue)
+            timer.schedule(deadline: .now() + .seconds(10), repeating: StoragePurger.interval)
+            timer.setEventHandler { [weak self] in self?.purge() }
+            timer.resume()
+            self.timer = timer
+        }
+    }
+
+    // 正在进行的一轮在当前批次结束后停止
+    func stop() {
+        stopped.store(true)
+        queue.sync {
+            timer?.cancel()
+            timer = nil
+        }
+    }
+
+    // MARK: - 主 App 批量删除
+
+    public static func deleteSessions(_ sessions: [Session]) {
+        guard let db = try? ASConfigration.getDefaultDB() else { return }
+        var byTask = [Int?: [Int]]()
+        for session in sessions {
+            guard let id = session.id?.intValue else { continue }
+            byTask[session.taskID?.intValue, default: []].append(id)
+        }
+        for (taskID, ids) in byTask {
+            let wanted = Set(ids.map { Int64($0) })
+            if deleteArchived(db, taskID: taskID, where: { $0.numbers("id").map { $0.map { wanted.contains($0) } ?? false } }) != nil {
+                continue
+            }
+            let schema = SessionStore.schema(db, taskID: taskID)
+            defer { SessionStore.release(db, schema) }
+            var index = 0
+            while index < ids.count {
+                let batch = ids[index..<min(ids.count, index + batchSize)]
+                deleteSessions(db, schema: schema, where: "id IN (\(batch.map { "\($0)" }.joined(separator: ",")))")
+                index += batchSize
+            }
+            vacuum(db, schema)
+        }
+    }
+
+    @discardableResult
+    public static func deleteTasks(ids: [Int]) -> Bool {
+        guard let db = try? ASConfigration.getDefaultDB() else { return false }
+        for id in ids {
+            deleteTask(db, id: id)
+        }
+        vacuum(db)
+        return true
+    }
+
+    // MARK: - 清理
+
+    // 在 queue 上执行
+    private func purge() {
+        guard !stopped.load(), let db = try? ASConfigration.getDefaultDB() else { return }
+        let policy = RetentionPolicy.current
+        var removed = 0
+        if policy.archiveFinished {
+            archiveFinished(db)
+        }
+        if policy.maxAge > 0 {
+            let cutoff = Date().timeIntervalSince1970 - policy.maxAge
+            removed += StoragePurger.deleteSessions(db, schema: SessionStore.catalog, where: "startTime < \(cutoff)", stopped: stopped)
+            // Task 开始时间早于其中的会话，只有早于 cutoff 开始的 Task 中可能有过期会话
+            for id in StoragePurger.ids(db, "SELECT id FROM \(Task.nameOfTable) WHERE startTime < \(cutoff)") where !stopped.load() {
+                if let count = StoragePurger.deleteArchived(db, taskID: id, where: { $0.doubles("startTime").map { ($0 ?? 0) < cutoff } }) {
+                    removed += count
+                    continue
+                }
+                let schema = SessionStore.schema(db, taskID: id)
+                defer { SessionStore.release(db, schema) }
+                if schema != SessionStore.catalog {
+                    removed += trim(db, schema, where: "startTime < \(cutoff)")
+                }
+            }
+            // 会话已全部过期的旧 Task 整个删除
+            for id in StoragePurger.ids(db, "SELECT id FROM \(Task.nameOfTable) WHERE id != \(activeTaskID) AND ifnull(stopTime, startTime) < \(cutoff)") where !stopped.load() {
+                if let reader = SessionArchive.reader(taskID: id) {
+                    if reader.count == 0 { StoragePurger.deleteTask(db, id: id) }
+                    continue
+                }
+                // deleteTask 要 DETACH 分库，先释放
+                let schema = SessionStore.schema(db, taskID: id)
+                let empty = StoragePurger.ids(db, "SELECT id FROM \(schema).\(Session.nameOfTable) WHERE taskID = \(id) LIMIT 1").isEmpty
+                SessionStore.release(db, schema)
+                if empty {
+                    StoragePurger.deleteTask(db, id: id)
+                }
+            }
+        }
+        if policy.maxSessionsPerTask > 0 {
+            removed += trimTasks(db, policy.maxSessionsPerTask)
+        }
+        if removed > 0 {
+            StoragePurger.vacuum(db)
+        }
+        if policy.maxBytes > 0 {
+            removed += trimBytes(db, policy.maxBytes, trimActiveTask: policy.trimActiveTask)
+        }
+        if removed > 0 {
+            AxLogger.log("StoragePurger removed \(removed) sessions, usage:\(StoragePurger.diskUsage())", level: .Info)
+        }
+    }
+
+    // 每个 Task 只保留最新的 max 条
+    private func trimTasks(_ db: Connection, _ max: Int) -> Int {
+        let sql = TaskStats.prepare(db)
+            ? "SELECT taskID FROM \(TaskStats.tableName) WHERE sessionCount > \(max)"
+            : "SELECT taskID FROM \(Session.nameOfTable) WHERE taskID IS NOT NULL GROUP BY taskID HAVING count(*) > \(max)"
+        var removed = 0
+        for taskID in StoragePurger.ids(db, sql) where !stopped.load() {
+            let archived = StoragePurger.deleteArchived(db, taskID: taskID) { reader in
+                let ids = reader.numbers("id")
+                let kept = Set(reader.liveRows().compactMap { ids[$0] }.sorted(by: >).prefix(max))
+                return ids.map { $0.map { !kept.contains($0) } ?? true }
+            }
+            if let count = archived {
+                removed += count
+                continue
+            }
+            let schema = SessionStore.schema(db, taskID: taskID)
+            defer { SessionStore.release(db, schema) }
+            let boundary = StoragePurger.ids(db, "SELECT id FROM \(schema).\(Session.nameOfTable) WHERE taskID = \(taskID) ORDER BY id DESC LIMIT 1 OFFSET \(max - 1)")
+            guard let first = boundary.first else { continue }
+            removed += trim(db, schema, where: "taskID = \(taskID) AND id < \(first)")
+        }
+        return removed
+    }
+
+    // 删除分库中的会话后立即回收分库的空闲页，nio.db 在 purge 最后统一回收
+    private func trim(_ db: Connection, _ schema: String, where condition: String) -> Int {
+        let count = StoragePurger.deleteSessions(db, schema: schema, where: condition, stopped: stopped)
+        if count > 0, schema != SessionStore.catalog {
+            StoragePurger.vacuum(db, schema)
+        }
+        return count
+    }
+
+    // 已结束、还有分库的 Task 转为列式存档；存档写完后分库 DETACH 并删除
+    private func archiveFinished(_ db: Connection) {
+        for id in StoragePurger.ids(db, "SELECT id FROM \(Task.nameOfTable) WHERE id != \(activeTaskID) ORDER BY id") where !stopped.load() {
+            guard let folder = SessionStore.folder(taskID: id), access(SessionStore.path(folder), F_OK) == 0 else { continue }
+            SessionArchive.archive(taskID: id, folder: folder)
+        }
+    }
+
+    // 超出总占用时先整个删除最早的 Task；只剩正在抓包的 Task 时，设置了 trimActiveTask 才删除它最早的会话
+    // 数据段不支持打洞时删会话不会减少占用，这时停止，不继续清空当前 Task
+    private func trimBytes(_ db: Connection, _ maxBytes: Int64, trimActiveTask: Bool) -> Int {
+        var removed = 0
+        var usage = StoragePurger.diskUsage()
+        while usage > maxBytes, !stopped.load() {
+            let oldest = StoragePurger.ids(db, "SELECT id FROM \(Task.nameOfTable) WHERE id != \(activeTaskID) AND numberOfUse > 0 ORDER BY id LIMIT 1").first
+            var schema = SessionStore.catalog
+            if let id = oldest {
+                removed += StoragePurger.deleteTask(db, id: id)
+            } else {
+                guard trimActiveTask, activeTaskID >= 0 else { break }
+                schema = SessionStore.schema(db, taskID: activeTaskID)
+                let count = StoragePurger.deleteSessions(db, schema: schema, where: "taskID = \(activeTaskID)", maxBatches: 1)
+                if count == 0 {
+                    SessionStore.release(db, schema)
+                    break
+                }
+                removed += count
+            }
+            StoragePurger.vacuum(db, schema)
+            SessionStore.release(db, schema)
+            let now = StoragePurger.diskUsage()
+            // WAL 要等 checkpoint 后才收缩，没有减少时留到下一轮
+            if oldest == nil, now >= usage { break }
+            usage = now
+        }
+        return removed
+    }
+
+    // MARK: - 删除
+
+    // 按 id 从小到大分批删除 schema 中满足条件的会话并清理它们的 body，返回删除的条数
+    @discardableResult
+    private static func deleteSessions(_ db: Connection, schema: String, where condition: String, maxBatches: Int = Int.max, stopped: Atomic<Bool>? = nil) -> Int {
+        var removed = 0
+        var batches = 0
+        while batches < maxBatches, stopped?.load() != true {
+            batches += 1
+            var rows = [(id: Int, folder: String, req: String, rsp: String)]()
+            do {
+                try db.transaction {
+                    for row in try db.prepare("SELECT id, fileFolder, reqBody, rspBody FROM \(schema).\(Session.nameOfTable) WHERE \(condition) ORDER BY id LIMIT \(batchSize)") {
+                        guard let id = row[0] as? Int64 else { continue }
+                        rows.append((Int(id), row[1] as? String ?? "", row[2] as? String ?? "", row[3] as? String ?? ""))
+                    }
+                    if rows.isEmpty { return }
+                    try db.run("DELETE FROM \(schema).\(Session.nameOfTable) WHERE id IN (\(rows.map { "\($0.id)" }.joined(separator: ",")))")
+                    SessionStore.syncStats(db, schema)
+                }
+            } catch {
+                AxLogger.log("StoragePurger delete failure:\(error)", level: .Error)
+                break
+            }
+            if rows.isEmpty { break }
+            removeBodies(rows)
+            removed += rows.count
+            if rows.count < batchSize { break }
+        }
+        return removed
+    }
+
+    // 已存档的 Task：从存档中删除（见 SessionArchive.remove）并清理删除的会话的 body，返回删除的条数；没有存档时返回 nil
+    private static func deleteArchived(_ db: Connection, taskID: Int?, where predicate: (SessionArchive.Reader) -> [Bool]) -> Int? {
+        guard let id = taskID, let folder = SessionStore.folder(taskID: id), SessionArchive.exists(folder: folder) else { return nil }
+        let rows = SessionArchive.remove(db, taskID: id, folder: folder, where: predicate)
+        removeBodies(rows)
+        return rows.count
+    }
+
+    // 旧版本的 body 文件和导出过的 body 文件直接 unlink，BodyStore 的数据段按目录一次打洞
+    private static func removeBodies(_ rows: [(id: Int, folder: String, req: String, rsp: String)]) {
+        let store = MitmService.getStoreFolder()
+        var byFolder = [String: Set<Int>]()
+        for row in rows where !row.folder.isEmpty {
+            for name in [row.req, row.rsp] where !name.isEmpty {
+                unlink("\(store)\(row.folder)/\(name)")
+            }
+            byFolder[row.folder, default: []].insert(row.id)
+        }
+        for (folder, ids) in byFolder {
+            BodyStore.punch(folder: folder, sessionIDs: ids)
+        }
+    }
+
+    // 删除 Task 的全部会话、记录和目录
+    @discardableResult
+    private static func deleteTask(_ db: Connection, id: Int) -> Int {
+        let folder = (try? db.scalar("SELECT fileFolder FROM \(Task.nameOfTable) WHERE id = \(id)")) as? String ?? ""
+        var removed = 0
+        // 分库 DETACH 后随目录一起删除（存档同样），不需要逐条删除会话；删除的条数取自统计表
+        if !folder.isEmpty {
+            if access(SessionStore.path(folder), F_OK) == 0 || SessionArchive.exists(folder: folder) {
+                removed = Int((try? db.scalar("SELECT sessionCount FROM \(TaskStats.tableName) WHERE taskID = \(id)")) as? Int64 ?? 0)
+            }
+            SessionStore.remove(taskID: id, folder: folder)
+        }
+        // 旧版本写在 nio.db 中的会话；目录整个删除，不需要逐个清理 body
+        while true {
+            var count = 0
+            do {
+                try db.transaction {
+                    try db.run("DELETE FROM \(Session.nameOfTable) WHERE id IN (SELECT id FROM \(Session.nameOfTable) WHERE taskID = \(id) LIMIT \(batchSize))")
+                    count = db.changes
+                }
+            } catch {
+                AxLogger.log("StoragePurger delete task failure:\(error)", level: .Error)
+                return removed
+            }
+            removed += count
+            if count < batchSize { break }
+        }
+        _ = try? db.run("DELETE FROM \(Task.nameOfTable) WHERE id = \(id)")
+        if !folder.isEmpty {
+            BodyStore.Reader.drop(folder: folder)
+            try? FileManager.default.removeItem(atPath: "\(MitmService.getStoreFolder())\(folder)")
+        }
+        return removed
+    }
+
+    private static func ids(_ db: Connection, _ sql: String) -> [Int] {
+        var list = [Int]()
+        do {
+            for row in try db.prepare(sql) {
+                if let id = row[0] as? Int64 { list.append(Int(id)) }
+            }
+        } catch {
+            AxLogger.log("StoragePurger query failure:\(error)", level: .Error)
+        }
+        return list
+    }
+
+    // MARK: - 空间
+
+    // 分步回收空闲页，每步一个短写事务
+    private static func vacuum(_ db: Connection, _ schema: String = SessionStore.catalog) {
+        guard (try? db.scalar("PRAGMA \(schema).auto_vacuum")) as? Int64 == 2 else { return }
+        var free = (try? db.scalar("PRAGMA \(schema).freelist_count")) as? Int64 ?? 0
+        while free > 0 {
+            guard (try? db.run("PRAGMA \(schema).incremental_vacuum(\(vacuumStep))")) != nil else { return }
+            free -= Int64(vacuumStep)
+        }
+    }
+
+    // auto_vacuum 只能在建表前或 VACUUM 时切换，旧库较小时在这里切换一次
+    private func convertIfNeeded() {
+        guard let db = try? ASConfigration.getDefaultDB(), (try? db.scalar("PRAGMA auto_vacuum")) as? Int64 == 0 else { return }
+        guard StoragePurger.allocatedSize(MitmService.getDBPath()) <= StoragePurger.convertLimit else { return }
+        do {
+            try db.run("PRAGMA auto_vacuum = INCREMENTAL")
+            try db.run("VACUUM")
+        } catch {
+            AxLogger.log("StoragePurger convert auto_vacuum failure:\(error)", level: .Error)
+        }
+    }
+
+    // 数据库（含 WAL）和 Task 目录实际占用的磁盘块，打过洞的部分不计
+    static func diskUsage() -> Int64 {
+        let dbPath = MitmService.getDBPath()
+        var total = allocatedSize(dbPath) + allocatedSize(dbPath + "-wal") + allocatedSize(dbPath + "-shm")
+        let store = MitmService.getStoreFolder()
+        if let enumerator = FileManager.default.enumerator(atPath: store) {
+            while let name = enumerator.nextObject() as? String {
+                total += allocatedSize(store + name)
+            }
+        }
+        return total
+    }
+
+    private static func allocatedSize(_ path: String) -> Int64 {
+        var st = stat()
+        guard lstat(path, &st) == 0, (st.st_mode & S_IFMT) == S_IFREG else { return 0 }
+        return Int64(st.st_blocks) * 512
+    }
+}
@@ -17,6 +17,7 @@ import SQLite
 public let TaskDidChangedNotification = NSNotification.Name("TaskDidChangedNotification")
 public let TaskValueDidChanged = "TaskValueDidChanged"
 public let TaskConfigDidChanged = "TaskConfigDidChanged"
+public let RuleConfigDidChanged = "RuleConfigDidChanged"
 
 public class Task: ASModel {
 
@@ -35,6 +36,7 @@ public class Task: ASModel {
     
     //
     public var interceptCount:NSNumber = 0 //拦截数量
+    public var errorCount:Int = 0 //失败数量，来自 TaskStat，不保存
     public var uploadTraffic:NSNumber = 0 //上传流量
     public var downloadFlow:NSNumber = 0 //下载流量
     // wifi
@@ -113,40 +115,37 @@ public class Task: ASModel {
     }
     
     public static func getSQL(pageSize:Int = 999999,pageIndex:Int = 0,orderBy:String = "id") -> String {
-        let sql = "select t.id,t.startTime,t.stopTime,t.ruleName,t.ruleId,count(s.id) as sessionCount,sum(s.downloadFlow) as downloadFlowSum,sum(s.uploadTraffic) as uploadTrafficSum from task t left join session s on t.id = s.taskID group by t.id order by t.\(orderBy) desc limit \(pageSize) offset \(pageSize*pageIndex)"
+        // 有统计表时只读每个 Task 的一行统计，否则对所有会话汇总
+        if let db = try? ASConfigration.getDefaultDB(), TaskStats.prepare(db) {
+            return "select t.id,t.startTime,t.stopTime,t.ruleName,t.ruleId,ifnull(a.sessionCount,0) as sessionCount,ifnull(a.downloadFlow,0) as downloadFlowSum,ifnull(a.uploadTraffic,0) as uploadTrafficSum,ifnull(a.errorCount,0) as errorCount from task t left join \(TaskStats.tableName) a on t.id = a.taskID order by t.\(orderBy) desc limit \(pageSize) offset \(pageSize*pageIndex)"
+        }
+        let sql = "select t.id,t.startTime,t.stopTime,t.ruleName,t.ruleId,count(s.id) as sessionCount,sum(s.downloadFlow) as downloadFlowSum,sum(s.uploadTraffic) as uploadTrafficSum,sum(s.sstate = 'failure') as errorCount from task t left join session s on t.id = s.taskID group by t.id order by t.\(orderBy) desc limit \(pageSize) offset \(pageSize*pageIndex)"
         return sql
     }
     
+    // 会话、记录和 Task 目录一起删除，见 StoragePurger
     public static func deleteAll(taskIds:[Int]) -> Bool {
         if taskIds.count <= 0 { return true }
-        let s = taskIds.map { (id) -> String in return "\(id)" }
-        let sql = "delete from task where id in ( \(s.joined(separator: ",")) )"
-        print("sql:\(sql)")
-        let db = try! ASConfigration.getDefaultDB()
-        do {
-//            _ = try db.prepare(sql)
-            try db.run(sql)
-            return true
-        } catch  {
-            print("delete tasks error:\(error.localizedDescription)")
-            return false
-        }
+        return StoragePurger.deleteTasks(ids: taskIds)
     }
     
+    // 每个 Task 的会话在各自的分库中，逐个查询
     public static func findAll(taskIds:[Int]) -> [Session] {
         if taskIds.count <= 0 { return [] }
-        let s = taskIds.map { (id) -> String in return "\(id)" }
-        let sql = "select * from session where taskID in ( \(s.joined(separator: ",")) )"
-        print("sql:\(sql)")
-        let db = try! ASConfigration.getDefaultDB()
+        let db = try! ASConfigration.getReadDB()
         var sessions = [Session]()
         do {
 //            let startTime = CFAbsoluteTimeGetCurrent()
-            let result = try db.prepare(sql)
-            let columnNames:[String] = result.columnNames
-            for row in result {
-                let session = Session.getWith(columnNames: columnNames, row: row)
-                if session != nil { sessions.append(session!) }
+            for id in taskIds {
+                if let reader = SessionArchive.reader(taskID: id) {
+                    sessions.append(contentsOf: reader.sessions(reader.liveRows()))
+                    continue
+                }
+                let schema = SessionStore.schema(db, taskID: id)
+                defer { SessionStore.release(db, schema) }
+                let sql = "select * from \(schema).session where taskID = \(id)"
+                print("sql:\(sql)")
+                sessions.append(contentsOf: try Session.rowDecoder.decode(db, sql))
             }
 //            let endTime = CFAbsoluteTimeGetCurrent()
 //            print("查询时长：\((endTime - startTime)*1000) 毫秒" )
@@ -158,7 +157,7 @@ public class Task: ASModel {
     
     public static func getAllIds() -> [Int] {
         let sql = "select id from task"
-        let db = try! ASConfigration.getDefaultDB()
+        let db = try! ASConfigration.getReadDB()
         var results = [Int]()
         do {
             let result = try db.prepare(sql)
@@ -176,17 +175,11 @@ public class Task: ASModel {
     public static func findAll(pageSize:Int = 999999,pageIndex:Int = 0,orderBy:String?) -> [Task] {
         let sql = getSQL(pageSize: pageSize, pageIndex: pageIndex, orderBy: orderBy ?? "id")
 //        print("sql:\(sql)")
-        let db = try! ASConfigration.getDefaultDB()
+        let db = try! ASConfigration.getReadDB()
         var tasks = [Task]()
         do {
 //            let startTime = CFAbsoluteTimeGetCurrent()
-            let result = try db.prepare(sql)
-            let columnNames:[String] = result.columnNames
-            for row in result {
-                if let task = getWith(columnNames: columnNames, row: row) {
-                    tasks.append(task)
-                }
-            }
+            tasks = try rowDecoder.decode(db, sql)
 //            let endTime = CFAbsoluteTimeGetCurrent()
 //            print("查询时长：\((endTime - startTime)*1000) 毫秒" )
         } catch  {
@@ -195,32 +188,26 @@ public class Task: ASModel {
         return tasks
     }
     
-    static func getWith(columnNames:[String],row:Statement.Element) -> Task? {
-        let task = Task()
-        for i in 0..<columnNames.count {
-            let columnName = columnNames[i]
-            guard let value = row[i] else {
-                continue
-            }
-            switch columnName {
-            case "id":task.id =  value as? NSNumber
-            case "ruleName":task.ruleName =  value as? String ?? ""
-            case "ruleId":task.ruleId =  value as? NSNumber ?? -1
-            case "sessionCount":task.interceptCount =  value as? NSNumber ?? 0
-            case "downloadFlowSum":task.downloadFlow =  value as? NSNumber ?? 0
-            case "uploadTrafficSum":task.uploadTraffic =  value as? NSNumber ?? 0
-            case "startTime":task.startTime =  value as? NSNumber
-            case "stopTime":task.stopTime =  value as? NSNumber
-            default:
-                break
-            }
-        }
-        return task
-    }
+    // 列表查询的列，见 getSQL
+    typealias Decoder = RowDecoder<Task>
+    static let rowDecoder = Decoder({ Task() }, bindings: Task.bindings, [
+        "sessionCount": Decoder.number { $0.interceptCount = $1 },
+        "downloadFlowSum": Decoder.number { $0.downloadFlow = $1 },
+        "uploadTrafficSum": Decoder.number { $0.uploadTraffic = $1 },
+        "errorCount": Decoder.number { $0.errorCount = $1.intValue },
+        ])
     
     public func setNumbers(){
-        let sql = "select count(id) as sessionCount,sum(downloadFlow) as downloadFlowSum,sum(uploadTraffic) as uploadTrafficSum from session where taskID = \(id ?? -1)"
-        let db = try! ASConfigration.getDefaultDB()
+        let db = try! ASConfigration.getReadDB()
+        var sql = "select count(id) as sessionCount,sum(downloadFlow) as downloadFlowSum,sum(uploadTraffic) as uploadTrafficSum,sum(sstate = 'failure') as errorCount from session where taskID = \(id ?? -1)"
+        if TaskStats.prepare(try! ASConfigration.getDefaultDB()) {
+            sql = "select sessionCount,downloadFlow as downloadFlowSum,uploadTraffic as uploadTrafficSum,errorCount from \(TaskStats.tableName) where taskID = \(id ?? -1)"
+            // 还没有会话时统计表中没有这一行
+            interceptCount = 0
+            downloadFlow = 0
+            uploadTraffic = 0
+            errorCount = 0
+        }
         do {
             let result = try db.prepare(sql)
             let columnNames:[String] = result.columnNames
@@ -232,6 +219,7 @@ public class Task: ASModel {
                     case "sessionCount":interceptCount =  value as? NSNumber ?? 0
                     case "downloadFlowSum":downloadFlow =  value as? NSNumber ?? 0
                     case "uploadTrafficSum":uploadTraffic =  value as? NSNumber ?? 0
+                    case "errorCount":errorCount = (value as? NSNumber)?.intValue ?? 0
                     default:
                         break
                     }
@@ -243,6 +231,13 @@ public class Task: ASModel {
         }
     }
     
+    // body 去重率（含差分）：body 总长度 / 实际存储的长度，没有 body 时为 1
+    public func bodyDedupRatio() -> Double {
+        if fileFolder == "" { return 1 }
+        let stats = BodyStore.Reader.reader(for: fileFolder).dedupStats()
+        return stats.stored == 0 ? 1 : Double(stats.logical) / Double(stats.stored)
+    }
+    
     public static func getLast(_ parseConfig:Bool = true) -> Task?{
         let task = Task.findFirst(nil, ["id":false])
         if task == nil { return nil }
@@ -324,6 +319,16 @@ public class Task: ASModel {
                     AxLogger.log("TaskConfigDidChanged:\(json)", level: .Info)
                 }
             })
+            // 当前规则被修改后热加载，不需要重启服务
+            wormhole?.listenForMessage(withIdentifier: RuleConfigDidChanged, listener: { [weak self](jsonStr) in
+                guard let json = jsonStr as? String, let rule = self?.rule, let ruleId = rule.id else { return }
+                let dic = [String:String].fromJson(json)
+                guard dic["ruleId"] == "\(ruleId)", let newRule = Rule.findAll(["id":ruleId]).first else { return }
+                rule.config = newRule._config
+                rule.publishSnapshot()
+                self?.ruleName = rule.name
+                AxLogger.log("RuleConfigDidChanged:\(ruleId)", level: .Info)
+            })
         }
     }
     
@@ -369,3 +374,35 @@ public class Task: ASModel {
 extension Task: GCDAsyncUdpSocketDelegate{
     
 }
+
+// 持久化列表，与反射得到的列一致（doubleTypes 中的列用 double）
+extension Task: ASBindingProtocol {
+    public static let bindings: [ASBinding] = [
+        .number("id", \Task.id),
+        .number("numberOfUse", \Task.numberOfUse),
+        .string("localIP", \Task.localIP),
+        .number("localPort", \Task.localPort),
+        .number("localEnable", \Task.localEnable),
+        .number("localState", \Task.localState),
+        .string("wifiIP", \Task.wifiIP),
+        .number("wifiPort", \Task.wifiPort),
+        .number("wifiEnable", \Task.wifiEnable),
+        .number("wifiState", \Task.wifiState),
+        .number("interceptCount", \Task.interceptCount),
+        .double("uploadTraffic", \Task.uploadTraffic),
+        .double("downloadFlow", \Task.downloadFlow),
+        .number("wifiInterceptCount", \Task.wifiInterceptCount),
+        .double("wifiUploadTraffic", \Task.wifiUploadTraffic),
+        .double("wifiDownloadFlow", \Task.wifiDownloadFlow),
+        .string("ruleName", \Task.ruleName),
+        .number("ruleId", \Task.ruleId),
+        .number("sslEnable", \Task.sslEnable),
+        .number("creatTime", \Task.creatTime),
+        .double("startTime", \Task.startTime),
+        .double("stopTime", \Task.stopTime),
+        .string("note", \Task.note),
+        .string("extra", \Task.extra),
+        .number("saveCount", \Task.saveCount),
+        .string("fileFolder", \Task.fileFolder),
+    ]
+}
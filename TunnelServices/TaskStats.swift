@@ -0,0 +1,124 @@
+//
+//  TaskStats.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/7/4.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import SQLite
+import AxLogger
+import NIOConcurrencyHelpers
+
+// 每个 Task 的会话统计：会话数、上传、下载流量、失败数
+// 由 Session 表上的触发器在插入、更新、删除时增量维护，历史列表只读这张表，不再对所有会话 group by
+// SessionWriter 用 insert or replace 更新会话，replace 删除旧行时要触发删除触发器，需打开 recursive_triggers
+final class TaskStats {
+
+    static let tableName = "TaskStat"
+
+    private static let available = PreparedSchemas()
+
+    // Tunnel 启动和主 App 查询前调用；第一次建表时汇总已有的会话
+    // recursive_triggers 是连接级设置，按 (连接, schema) 记录，每个连接第一次调用时打开
+    // schema 为 main 时是 nio.db 中的目录表，Task 分库中也各有一张，见 SessionStore
+    @discardableResult
+    static func prepare(_ db: Connection, schema: String = SessionStore.catalog) -> Bool {
+        if available.contains(db, schema) { return true }
+        let session = Session.nameOfTable
+        let add = "sessionCount = sessionCount + 1, uploadTraffic = uploadTraffic + ifnull(new.uploadTraffic, 0), "
+            + "downloadFlow = downloadFlow + ifnull(new.downloadFlow, 0), errorCount = errorCount + (new.sstate IS 'failure')"
+        let remove = "sessionCount = sessionCount - 1, uploadTraffic = uploadTraffic - ifnull(old.uploadTraffic, 0), "
+            + "downloadFlow = downloadFlow - ifnull(old.downloadFlow, 0), errorCount = errorCount - (old.sstate IS 'failure')"
+        let insertNew = "INSERT OR IGNORE INTO \(tableName)(taskID) SELECT new.taskID WHERE new.taskID IS NOT NULL"
+        do {
+            try db.run("PRAGMA recursive_triggers = ON")
+            try db.transaction {
+                try db.run("""
+                    CREATE TABLE IF NOT EXISTS \(schema).\(tableName) (taskID INTEGER PRIMARY KEY, sessionCount INTEGER NOT NULL DEFAULT 0,
+                    uploadTraffic INTEGER NOT NULL DEFAULT 0, downloadFlow INTEGER NOT NULL DEFAULT 0, errorCount INTEGER NOT NULL DEFAULT 0)
+                    """)
+                // 触发器不存在说明是第一次建表，先汇总再建触发器
+                let count = try db.scalar("SELECT count(*) FROM \(schema).sqlite_master WHERE type = 'trigger' AND name = '\(tableName)_insert'") as? Int64 ?? 0
+                if count == 0 {
+                    try db.run("DELETE FROM \(schema).\(tableName)")
+                    try db.run("""
+                        INSERT INTO \(schema).\(tableName)(taskID, sessionCount, uploadTraffic, downloadFlow, errorCount)
+                        SELECT taskID, count(*), ifnull(sum(uploadTraffic), 0), ifnull(sum(downloadFlow), 0), ifnull(sum(sstate = 'failure'), 0)
+                        FROM \(schema).\(session) WHERE taskID IS NOT NULL GROUP BY taskID
+                        """)
+                }
+                try db.run("""
+                    CREATE TRIGGER IF NOT EXISTS \(schema).\(tableName)_insert AFTER INSERT ON \(session)
+                    BEGIN \(insertNew); UPDATE \(tableName) SET \(add) WHERE taskID = new.taskID; END
+                    """)
+                try db.run("""
+                    CREATE TRIGGER IF NOT EXISTS \(schema).\(tableName)_delete AFTER DELETE ON \(session)
+                    BEGIN UPDATE \(tableName) SET \(remove) WHERE taskID = old.taskID; END
+                    """)
+                try db.run("""
+                    CREATE TRIGGER IF NOT EXISTS \(schema).\(tableName)_update AFTER UPDATE OF taskID, uploadTraffic, downloadFlow, sstate ON \(session)
+                    BEGIN UPDATE \(tableName) SET \(remove) WHERE taskID = old.taskID;
+                    \(insertNew); UPDATE \(tableName) SET \(add) WHERE taskID = new.taskID; END
+                    """)
+                // Task 表只在目录库中
+                if schema == SessionStore.catalog {
+                    try db.run("""
+                        CREATE TRIGGER IF NOT EXISTS \(tableName)_task_delete AFTER DELETE ON \(Task.nameOfTable)
+                        BEGIN DELETE FROM \(tableName) WHERE taskID = old.id; END
+                        """)
+                }
+            }
+            available.insert(db, schema)
+            return true
+        } catch {
+            AxLogger.log("TaskStats unavailable(\(schema)):\(error)", level: .Info)
+            return false
+        }
+    }
+
+    // 分库被删除时调用
+    static func reset(_ schema: String) {
+        available.remove(schema)
+    }
+}
+
+// 按 (连接, schema) 记录已建好表和触发器、并打开了 recursive_triggers 的组合
+// 弱引用连接，连接释放后地址被复用时不会误认为已准备好
+final class PreparedSchemas {
+
+    private final class Entry {
+        weak var db: Connection?
+        var schemas = Set<String>()
+        init(_ db: Connection) { self.db = db }
+    }
+
+    private let lock = Lock()
+    private var entries = [ObjectIdentifier: Entry]()
+
+    func contains(_ db: Connection, _ schema: String) -> Bool {
+        return lock.withLock {
+            guard let entry = entries[ObjectIdentifier(db)], entry.db === db else { return false }
+            return entry.schemas.contains(schema)
+        }
+    }
+
+    func insert(_ db: Connection, _ schema: String) {
+        lock.withLockVoid {
+            let key = ObjectIdentifier(db)
+            if entries[key]?.db !== db {
+                entries = entries.filter { $0.value.db != nil }
+                entries[key] = Entry(db)
+            }
+            entries[key]?.schemas.insert(schema)
+        }
+    }
+
+    // 分库被删除时从所有连接上移除
+    func remove(_ schema: String) {
+        lock.withLockVoid {
+            entries.values.forEach { $0.schemas.remove(schema) }
+        }
+    }
+}
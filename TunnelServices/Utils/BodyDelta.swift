@@ -0,0 +1,119 @@
+//
+//  BodyDelta.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/7/9.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+
+// body 的差分编码，类似 VCDIFF 的 COPY/ADD 指令序列
+// 每条指令以 varint 开头：长度 << 1 | 类型；ADD(0) 后面跟长度个字节，COPY(1) 后面跟基准中的偏移（varint）
+// 编码：基准按 blockSize 对齐分块建哈希表，目标上滚动哈希逐字节查找，命中后向前、向后扩展匹配
+// 解码：逐条指令输出，COPY 通过回调按需读取基准的一段，不需要先还原出整个基准
+enum BodyDelta {
+
+    static let blockSize = 16
+    private static let prime: UInt64 = 1_099_511_628_211
+
+    // 结果不小于 limit 时返回 nil，调用方保存完整的 body
+    static func encode(base: [UInt8], target: [UInt8], limit: Int) -> [UInt8]? {
+        guard base.count >= blockSize, target.count >= blockSize else { return nil }
+        var index = [UInt64: Int](minimumCapacity: base.count / blockSize)
+        var offset = 0
+        while offset + blockSize <= base.count {
+            let h = hash(base, offset)
+            if index[h] == nil { index[h] = offset }
+            offset += blockSize
+        }
+        // 滚动哈希移出最早一个字节时的系数 prime^(blockSize-1)
+        var outFactor: UInt64 = 1
+        for _ in 1..<blockSize { outFactor = outFactor &* prime }
+        var out = [UInt8]()
+        var literalStart = 0
+        var position = 0
+        var h = hash(target, 0)
+        while position + blockSize <= target.count {
+            if let candidate = index[h], base[candidate..<candidate + blockSize] == target[position..<position + blockSize] {
+                var s = candidate, t = position
+                while t > literalStart, s > 0, base[s - 1] == target[t - 1] {
+                    s -= 1
+                    t -= 1
+                }
+                var e = candidate + blockSize, f = position + blockSize
+                while e < base.count, f < target.count, base[e] == target[f] {
+                    e += 1
+                    f += 1
+                }
+                add(&out, target[literalStart..<t])
+                varint(&out, UInt64(f - t) << 1 | 1)
+                varint(&out, UInt64(s))
+                if out.count >= limit { return nil }
+                position = f
+                literalStart = f
+                if position + blockSize <= target.count { h = hash(target, position) }
+                continue
+            }
+            if position + blockSize < target.count {
+                h = (h &- UInt64(target[position]) &* outFactor) &* prime &+ UInt64(target[position + blockSize])
+            }
+            position += 1
+        }
+        add(&out, target[literalStart..<target.count])
+        return out.count < limit ? out : nil
+    }
+
+    // 逐条指令输出还原的内容；readBase(偏移, 长度) 读取基准的一段，失败或数据不完整时返回 false
+    static func apply(_ delta: Data, readBase: (Int, Int) -> Data?, _ body: (Data) -> Void) -> Bool {
+        var index = delta.startIndex
+        func next() -> UInt64? {
+            var result: UInt64 = 0
+            var shift: UInt64 = 0
+            while index < delta.endIndex, shift < 64 {
+                let byte = delta[index]
+                index += 1
+                result |= UInt64(byte & 0x7F) << shift
+                if byte & 0x80 == 0 { return result }
+                shift += 7
+            }
+            return nil
+        }
+        while index < delta.endIndex {
+            guard let op = next() else { return false }
+            let length = Int(clamping: op >> 1)
+            if op & 1 == 1 {
+                guard let offset = next(), let chunk = readBase(Int(clamping: offset), length), chunk.count == length else { return false }
+                body(chunk)
+            } else {
+                guard length <= delta.endIndex - index else { return false }
+                body(delta.subdata(in: index..<index + length))
+                index += length
+            }
+        }
+        return true
+    }
+
+    private static func hash(_ bytes: [UInt8], _ offset: Int) -> UInt64 {
+        var h: UInt64 = 0
+        for i in offset..<offset + blockSize {
+            h = h &* prime &+ UInt64(bytes[i])
+        }
+        return h
+    }
+
+    private static func add(_ out: inout [UInt8], _ literal: ArraySlice<UInt8>) {
+        if literal.isEmpty { return }
+        varint(&out, UInt64(literal.count) << 1)
+        out.append(contentsOf: literal)
+    }
+
+    private static func varint(_ out: inout [UInt8], _ value: UInt64) {
+        var v = value
+        while v >= 0x80 {
+            out.append(UInt8(v & 0x7F) | 0x80)
+            v >>= 7
+        }
+        out.append(UInt8(v))
+    }
+}
@@ -0,0 +1,126 @@
+//
+//  HeaderBlock.swift
+//  TunnelServices
+//
+//  Created by LiuJie on 2019/7/2.
+//  Copyright © 2019 Lojii. All rights reserved.
+//
+
+import Foundation
+import NIO
+import NIOHTTP1
+import NIOHPACK
+import NIOFoundationCompat
+import NIOConcurrencyHelpers
+import SQLite
+
+// 请求头、响应头的二进制存储格式
+// 每个头部块是一段 HPACK：头部名在静态表中时只写下标（content-type、user-agent 等一个字节），值做 Huffman 编码
+// 不使用动态表，每块都能单独解码；保留原始顺序和重复的头部（Set-Cookie 等）
+// 头部名按 HTTP/2 的规则转小写
+// 二进制内容不能直接按字节过滤：关键词搜索和头部筛选走搜索索引中解码后的文本，没有索引时用 headertext() 解码后匹配
+public enum HeaderBlock {
+
+    private static let allocator = ByteBufferAllocator()
+    static let functionName = "headertext"
+
+    // EventLoop 上调用，替代原来的字典 + JSON 序列化
+    static func encode(_ headers: HTTPHeaders) -> Data {
+        var encoder = HPACKEncoder(allocator: allocator, useHuffmanEncoding: true, maxDynamicTableSize: 0)
+        do {
+            try encoder.beginEncoding(allocator: allocator)
+            for header in headers {
+                try encoder.appendNonIndexed(header: header.name.lowercased(), value: header.value)
+            }
+            var buffer = try encoder.endEncoding()
+            return buffer.readData(length: buffer.readableBytes) ?? literal(headers)
+        } catch {
+            print("HeaderBlock encode failure:\(error)")
+            return literal(headers)
+        }
+    }
+
+    // 编码器出错时的退路：全部按不索引的字面量写，解码结果相同
+    private static func literal(_ headers: HTTPHeaders) -> Data {
+        var data = Data()
+        for header in headers {
+            data.append(0x00)       // Literal Header Field without Indexing — New Name
+            appendString(&data, header.name.lowercased())
+            appendString(&data, header.value)
+        }
+        return data
+    }
+
+    // H = 0，长度为 7 位前缀的整数
+    private static func appendString(_ data: inout Data, _ string: String) {
+        let bytes = Array(string.utf8)
+        var length = bytes.count
+        if length < 0x7f {
+            data.append(UInt8(length))
+        } else {
+            data.append(0x7f)
+            length -= 0x7f
+            while length >= 0x80 {
+                data.append(UInt8(length & 0x7f) | 0x80)
+                length >>= 7
+            }
+            data.append(UInt8(length))
+        }
+        data.append(contentsOf: bytes)
+    }
+
+    // 详情页、导出时才解码
+    public static func decode(_ data: Data) -> [(name: String, value: String)] {
+        var buffer = allocator.buffer(capacity: data.count)
+        buffer.writeBytes(data)
+        var decoder = HPACKDecoder(allocator: allocator, maxDynamicTableSize: 0, maxHeaderListSize: Int(Int32.max))
+        do {
+            return try decoder.decodeHeaders(from: &buffer).map { (name: $0.name, value: $0.value) }
+        } catch {
+            print("HeaderBlock decode failure:\(error)")
+            return []
+        }
+    }
+
+    // 兼容原来以 JSON 字典为输入的页面；同名头部合并，Set-Cookie 按行分隔，其余按逗号分隔
+    public static func json(_ data: Data) -> String {
+        var dic = [String:String]()
+        for header in decode(data) {
+            if let old = dic[header.name] {
+                dic[header.name] = old + (header.name == "set-cookie" ? "\n" : ", ") + header.value
+            } else {
+                dic[header.name] = header.value
+            }
+        }
+        return dic.toJson()
+    }
+
+    // 搜索索引使用的文本："name: value" 每行一个
+    static func text(_ data: Data) -> String {
+        return decode(data).map { "\($0.name): \($0.value)" }.joined(separator: "\n")
+    }
+
+    // 在连接上注册 headertext(blob)，返回 text(_:)；每个连接只注册一次
+    // 弱引用记录已注册的连接，连接释放后地址被复用时重新注册
+    private final class Registered {
+        weak var db: Connection?
+        init(_ db: Connection) { self.db = db }
+    }
+    private static let lock = Lock()
+    private static var registered = [ObjectIdentifier: Registered]()
+
+    static func register(_ db: Connection) {
+        let first: Bool = lock.withLock {
+            let key = ObjectIdentifier(db)
+            if registered[key]?.db === db { return false }
+            registered = registered.filter { $0.value.db != nil }
+            registered[key] = Registered(db)
+            return true
+        }
+        guard first else { return }
+        db.createFunction(functionName, argumentCount: 1, deterministic: true) { args -> Binding? in
+            guard let blob = args[0] as? Blob else { return nil }
+            return text(Data.fromDatatypeValue(blob))
+        }
+    }
+}
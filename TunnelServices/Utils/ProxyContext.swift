@@ -27,6 +27,7 @@ class ProxyContext: NSObject {
                 case .success(_):
                     self.session.outState = "\(self.session.outState ?? "")->close"
                     self.session.endTime = NSNumber(value: Date().timeIntervalSince1970)
+                    self.session.finishBodies()
                     try? self.session.saveToDB()
                     self.serverChannel?.close(mode: .all, promise: nil)
                     break
@@ -50,6 +51,7 @@ class ProxyContext: NSObject {
                 case .success(_):
                     self.session.inState = "\(self.session.inState ?? "")->close"
                     self.session.endTime = NSNumber(value: Date().timeIntervalSince1970)
+                    self.session.finishBodies()
                     try? self.session.saveToDB()
                     // 发送实时状态数据到主App
                     if !self.session.ignore {